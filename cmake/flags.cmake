@@ -20,7 +20,14 @@ set(CTUNING "-fpack-struct -fshort-enums -funsigned-bitfields -funsigned-char ${
 
 set(COPT "-Os")
 
-set(FLOAT_PRINT "-Wl,-u,vfprintf -lprintf_flt") # TODO: This should be an optional flag
+# The nodes print with fixed point (fixed.h), so printf without float support
+# is enough. Configure with -DFLOAT_PRINTF=ON to link the float version.
+option(FLOAT_PRINTF "Link printf with %f support (-lprintf_flt)" OFF)
+if(FLOAT_PRINTF)
+	set(FLOAT_PRINT "-Wl,-u,vfprintf -lprintf_flt")
+else()
+	set(FLOAT_PRINT "")
+endif()
 
 add_definitions(-DF_CPU=${F_CPU} -DCAN_BAUDRATE=${CAN_BAUDRATE})
 set(CFLAGS "${CMCU} ${CINCS} ${CSTANDARD} ${CDEBUG} ${CWARN} ${CTUNING} ${COPT} ${CEXTRA} ${FLOAT_PRINT}")
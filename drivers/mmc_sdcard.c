@@ -39,6 +39,14 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  * the specification can be found at:
  * https://www.sdcard.org/downloads/pls/simplified_specs/
  * In the "Physical Layer Simplified Specification" document.
+ *
+ * The card is busy for a while after a block is written. Instead of waiting for
+ * that after the write we wait before the next command or block, so the card
+ * programs the block while the caller does something else.
+ *
+ * Sequential data like a log can be written as a stream with sd_stream_begin(),
+ * sd_stream_write() and sd_stream_end(), which keep one WRITE_MULTIPLE_BLOCK
+ * open to the card across calls.
  */
 
 #define SS_L()	IO_SET_LOW(SPI_PORT, SS_PIN);
@@ -199,6 +207,18 @@ struct response {
 
 enum card_type card_type = 0;
 
+/**
+ * Sectors given to sd_stream_begin(). They are written with one
+ * WRITE_MULTIPLE_BLOCK that is kept open between calls of sd_stream_write(). Any
+ * other access to the card stops it and the next sd_stream_write() opens a new
+ * one at the next sector.
+ */
+static struct {
+	uint32_t next; //!< Sector the next sd_stream_write() writes
+	uint32_t left; //!< Sectors left of the stream
+	bool open;     //!< WRITE_MULTIPLE_BLOCK in progress
+} stream;
+
 /**
  * Transmit a byte to the sd card
  * @param x Byte that is trasmitted
@@ -240,8 +260,11 @@ static void idle_clock(int n) {
 }
 
 static int wait_ready(uint16_t ms) {
-	for (ms *= 10; rx() != IDLE_BYTE; --ms) _delay_us(100);
-	return (ms == 0) ? -1: 0;
+	for (ms *= 10; rx() != IDLE_BYTE; --ms) {
+		if (ms == 0) return -1;
+		_delay_us(100);
+	}
+	return 0;
 }
 
 /**
@@ -254,6 +277,14 @@ static int wait_ready(uint16_t ms) {
 static int8_t send_cmd(enum command cmd, uint32_t arg, struct response *r) {
 	SS_L();
 
+	// Wait for the end of the last write. STOP_TRANSMISSION is sent in the
+	// middle of a multiple block read where the card is sending data, so it
+	// would never see the card ready.
+	if (cmd != STOP_TRANSMISSION && wait_ready(500) != 0) {
+		SS_H();
+		return 1;
+	}
+
 	// Transmit the cmd
 	{
 		if (IS_ACMD(cmd)) {
@@ -264,12 +295,6 @@ static int8_t send_cmd(enum command cmd, uint32_t arg, struct response *r) {
 			SS_L();
 		}
 
-		if (R_TYPE(cmd) == R1B) {
-			//!< @TODO use timer tick to make this take about 200ms
-			int16_t max_idles = 20000/4;
-			while (rx() == IDLE_BYTE && --max_idles);
-		}
-
 		// Send the command
 		tx((uint8_t)cmd);
 
@@ -283,6 +308,9 @@ static int8_t send_cmd(enum command cmd, uint32_t arg, struct response *r) {
 		if ((cmd == CMD(8)) && (arg == 0x1AA)) 	crc7 = CMD8_CRC;
 		crc7 = (crc7<<1) | (1<<0); // Set the stop bit
 		tx(crc7);
+
+		// The card sends one more byte of the data before the response
+		if (cmd == STOP_TRANSMISSION) rx();
 	}
 
 	// Wait for a valid response and then store it
@@ -431,7 +459,10 @@ static int recv_block(uint8_t *buf, size_t n) {
 }
 
 
+static int8_t stream_stop(void);
+
 int8_t sd_read(uint8_t *buff, uint32_t sector, size_t n) {
+	if (stream_stop() != 0) return -1;
 	sector = adjust_sector(sector);
 
 	const uint8_t cmd = (n > 1) ? READ_MULTIPLE_BLOCK : READ_SINGLE_BLOCK;
@@ -448,6 +479,12 @@ int8_t sd_read(uint8_t *buff, uint32_t sector, size_t n) {
 static int send_block(const uint8_t buf[SD_BLOCKSIZE], uint8_t token) {
 	SS_L();
 
+	// Wait for the end of the last block with a timeout of 500ms
+	if (wait_ready(500) != 0) {
+		SS_H();
+		return -1;
+	}
+
 	tx(token);
 
 	if (buf != NULL) {
@@ -472,12 +509,8 @@ static int send_block(const uint8_t buf[SD_BLOCKSIZE], uint8_t token) {
 				SS_H();
 				return -1;
 		}
-	}
-
-	// Wait for end of write with a timeout of 500ms
-	if (wait_ready(500) != 0) {
-		SS_H();
-		return -1;
+	} else {
+		rx(); // The card goes busy one byte after the Stop Tran token
 	}
 
 	SS_H();
@@ -487,6 +520,7 @@ static int send_block(const uint8_t buf[SD_BLOCKSIZE], uint8_t token) {
 
 int8_t sd_write(const uint8_t *buf, uint32_t sector, size_t n) {
 	if (buf == NULL) return 1;
+	if (stream_stop() != 0) return -1;
 	sector = adjust_sector(sector);
 
 	if (n == 1) {
@@ -496,11 +530,13 @@ int8_t sd_write(const uint8_t *buf, uint32_t sector, size_t n) {
 		if (send_block(buf, 0xFE) != 0) return -1;
 	} else {
 		// Write multi block
-		if (!USES_BLOCK_ADDRESSING(card_type)) {
+		if (!(card_type & CT_MMC)) {
 			send_cmd(SET_WR_BLK_ERASE_COUNT, n, &(struct response){0});
 		}
 		if (send_cmd(WRITE_MULTIPLE_BLOCK, sector, &(struct response){0}) != 0) return -1;
-		while (n--) if (send_block(buf, 0xFC) != 0) return -1;
+		for (; n != 0; --n, buf += SD_BLOCKSIZE) {
+			if (send_block(buf, 0xFC) != 0) return -1;
+		}
 		if (send_block(NULL, 0xFD) != 0) return -1;
 	}
 
@@ -509,8 +545,73 @@ int8_t sd_write(const uint8_t *buf, uint32_t sector, size_t n) {
 	return 0;
 }
 
+/**
+ * Sends the Stop Tran token if a stream is open.
+ * @return 0 on success
+ */
+static int8_t stream_stop(void) {
+	if (!stream.open) return 0;
+	stream.open = false;
+	return send_block(NULL, 0xFD);
+}
+
+/**
+ * Starts a stream of n sectors from sector. The sectors are written in order by
+ * sd_stream_write() with a single WRITE_MULTIPLE_BLOCK, which saves a command
+ * and the busy time after it for every sector.
+ * @return 0 on success
+ */
+int8_t sd_stream_begin(uint32_t sector, uint32_t n) {
+	if (stream_stop() != 0) return -1;
+	stream.next = sector;
+	stream.left = n;
+	return 0;
+}
+
+/**
+ * Writes the next sector of the stream. The first write after
+ * sd_stream_begin() or after any other access to the card opens the
+ * WRITE_MULTIPLE_BLOCK and tells the card to pre-erase the sectors left.
+ * @return 0 on success, non zero on error or if the stream has no sectors left
+ */
+int8_t sd_stream_write(const uint8_t buf[SD_BLOCKSIZE]) {
+	if (stream.left == 0) return -1;
+
+	if (!stream.open) {
+		if (!(card_type & CT_MMC)) {
+			const uint32_t erase = (stream.left < 0x7FFFFF) ? stream.left : 0x7FFFFF;
+			send_cmd(SET_WR_BLK_ERASE_COUNT, erase, &(struct response){0});
+		}
+		struct response r = {0};
+		if (send_cmd(WRITE_MULTIPLE_BLOCK, adjust_sector(stream.next), &r) != 0
+			|| r.r1[0] != 0) return -1;
+		stream.open = true;
+	}
+
+	if (send_block(buf, 0xFC) != 0) {
+		stream_stop();
+		return -1;
+	}
+	++stream.next;
+	--stream.left;
+
+	return 0;
+}
+
+/**
+ * Ends the stream. Sectors of it that were not written are left undefined.
+ * @return 0 on success
+ */
+int8_t sd_stream_end(void) {
+	stream.left = 0;
+	return stream_stop();
+}
+
 int sd_sync(void) {
-	return wait_ready(500);
+	SS_L();
+	const int rc = wait_ready(500);
+	SS_H();
+	return rc;
 }
 
 int read_csd(uint8_t csd[static CSD_SIZE]) {
@@ -101,6 +101,10 @@ int8_t sd_init(void);
 int8_t sd_read(uint8_t *buff, uint32_t sector, size_t n);
 int8_t sd_write(const uint8_t *buf, uint32_t sector, size_t n);
 
+int8_t sd_stream_begin(uint32_t sector, uint32_t n);
+int8_t sd_stream_write(const uint8_t buf[SD_BLOCKSIZE]);
+int8_t sd_stream_end(void);
+
 int sd_sync(void);
 
 int read_csd(uint8_t csd[static CSD_SIZE]);
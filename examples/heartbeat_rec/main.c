@@ -36,11 +36,11 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 
 #define HEARTBEAT_TIMEOUT 100
+#define CAN_BUDGET        4
 
 
-void recieve_heartbeat(void);
 void decl_dead(uint32_t tick);
-void handle_heartbeat(struct can_message msg);
+void handle_heartbeat(const struct can_message *msg);
 
 static uint8_t buf_in[64];
 static uint8_t buf_out[64];
@@ -52,8 +52,9 @@ uint32_t last_heartbeat[5] = {0};
 static void init(void) {
 	usart1_init(115200, buf_in, ARR_LEN(buf_in), buf_out, ARR_LEN(buf_out));
 	sysclock_init();
-	can_subscribe(HEARTBEAT);
 	can_init();
+	can_on(HEARTBEAT, handle_heartbeat);
+	can_update_filters();
 
 	sei();
 	puts_P(PSTR("Init complete\n\n"));
@@ -71,9 +72,7 @@ int main(void) {
 			timers[0] += 10;
 		}
 
-		if (can_has_data()) {
-			recieve_heartbeat();
-		}
+		can_dispatch(CAN_BUDGET);
 	}
 
 	return 0;
@@ -92,21 +91,9 @@ void decl_dead(uint32_t tick) {
 }
 
 
-void recieve_heartbeat() {
-	while (can_has_data()) {
-		struct can_message msg;
-		read_message(&msg);
-
-		switch(msg.id) {
-			case HEARTBEAT: handle_heartbeat(msg); break;
-			default: break;
-		}
-	}
-}
-
-
-void handle_heartbeat(struct can_message msg) {
-	uint8_t node_id = msg.data[0];
+void handle_heartbeat(const struct can_message *msg) {
+	const uint8_t node_id = msg->data[0];
+	if (node_id >= ARR_LEN(node_state)) return;
 
 	last_heartbeat[node_id] = get_tick();
 	if (!node_state[node_id]) {
@@ -100,6 +100,7 @@ struct bson_element {
 int32_t serialize_element(uint8_t *buff, struct bson_element *e, size_t len);
 int32_t serialize(uint8_t *buff, struct bson_element *elements, size_t n_elem,
 				  size_t len);
+int32_t find_key(struct bson_element *e, uint8_t *bson, int32_t n);
 
 
 #endif /* BSON_H */
@@ -35,11 +35,14 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <stdint.h>    // for uint8_t, uint16_t, int8_t, uint32_t
 #include <util/atomic.h>
 #include <stdbool.h>
+#include <string.h>    // for memcpy, memmove
 
 #include "can.h"       // for can_counters::NO_MOB_ERR, etc
 #include "can_baud.h"  // for CANBT1_VALUE, CANBT2_VALUE, CANBT3_VALUE
+#include "can_filter.h" // for can_filter, can_filter_solve
+#include "can_queue.h" // for can_queue, cq_claim, cq_publish, cq_pop, etc
+#include "sysclock.h"  // for get_tick, get_us, sysclock_running, etc
 #include "utils.h"     // for BIT_CLEAR, BIT_SET, BITMASK_SET, BIT_CHECK, etc
-#include "ringbuffer.h"
 #include "system_messages.h"
 
 
@@ -49,12 +52,25 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define CAN_DISABLE()     ( CANGCON &= ~(1<<ENASTB))
 #define CAN_FULL_ABORT()  { CANGCON |=  (1<<ABRQ); CANGCON &= ~(1<<ABRQ); }
 
-#define RINGBF_SIZE     ( 64        ) //!< Size of ringbuffer for recieved CAN frames.
 #define NB_MOB          ( 15        ) //!< Number of MOB's
 #define DATA_MAX        ( 8         ) //!< The can can max transmit a payload of 8 uint8_t
 #define LAST_MOB_NB     ( NB_MOB-1  ) //!< Index of the last MOB. This is useful when looping over all MOB's
-#define NB_SPYMOB       ( 10        ) //!< Number of spymobs used.
+#define NB_RX_MOB       ( 10        ) //!< Number of MOB's used for reception.
+#define FIRST_RX_MOB    ( NB_MOB-NB_RX_MOB ) //!< The reception MOB's are the last NB_RX_MOB MOB's
 #define NO_MOB          ( 0xFF      )
+#define NB_MAILBOX      ( 8         ) //!< Number of messages that can be received in mailbox mode
+#define TX_QUEUE_SIZE   ( 8         ) //!< Number of frames that can wait for a free MOB
+#define NB_TX_MOB       ( NB_MOB-NB_RX_MOB ) //!< Number of MOB's used for transmission. These are the first NB_TX_MOB MOB's
+#define TX_MAX_RETRIES  ( 8         ) //!< Default number of retransmissions before a frame is given up
+#define TX_TIMEOUT      ( 50        ) //!< Default milliseconds before a frame that has not been sent is given up
+#define TX_HOLD_MIN     ( 20        ) //!< Milliseconds transmission is held back after a bus off
+#define TX_HOLD_MAX     ( 1000      ) //!< Longest hold back after repeated bus offs
+#define BUS_OFF_FORGET  ( 5000      ) //!< Milliseconds without a bus off before the hold back starts over at TX_HOLD_MIN
+
+//!< The CAN timer CANTIM runs at F_CPU/8/(CAN_TIMER_PRESCALER+1), 25.6 kHz at
+//!< 11.0592 MHz, so it wraps after about 2.5 s.
+#define CAN_TIMER_PRESCALER ( 53 )
+#define CAN_TIMER_US_Q8     ( (uint16_t)((8ULL * (CAN_TIMER_PRESCALER + 1) * 1000000 * 256 + F_CPU / 2) / F_CPU) ) //!< Microseconds per CAN timer tick in Q8, 39.0625 exactly
 
 #define DLC_MSK         ( (1<<DLC3)|(1<<DLC2)|(1<<DLC1)|(1<<DLC0)   ) //!< Mask for Data Length Coding bits in CANCDMOB
 #define MOB_CONMOB_MSK  ( (1 << CONMOB1) | (1 << CONMOB0)           ) //!< Mask for Configuration MOB bits in CANCDMOB
@@ -110,6 +126,8 @@ enum mob_status_t {
 #define CAN_SEI()          ( BIT_SET(CANGIE, ENIT) ) //!< Enable global CAN interrupts
 #define CAN_EN_TX_INT()    ( BIT_SET(CANGIE, ENTX) ) //!< Enable CAN Tx interrupts
 #define CAN_EN_RX_INT()    ( BIT_SET(CANGIE, ENRX) ) //!< Enable CAN Rx interrupts
+#define CAN_EN_ERR_INT()   ( BIT_SET(CANGIE, ENERR) ) //!< Enable CAN MOB error interrupts
+#define CAN_EN_BOFF_INT()  ( BIT_SET(CANGIE, ENBOFF) ) //!< Enable CAN bus off interrupt
 //!< @} ----------
 
 
@@ -177,7 +195,7 @@ enum mob_status_t {
 //!< @} ----------
 
 //Please insert comment !
-#define CAN_INT_ALL()  do {CAN_SEI(); CAN_EN_RX_INT(); CAN_EN_TX_INT();} while (0)
+#define CAN_INT_ALL()  do {CAN_SEI(); CAN_EN_RX_INT(); CAN_EN_TX_INT(); CAN_EN_ERR_INT(); CAN_EN_BOFF_INT();} while (0)
 #define CAN_INT_RX()   do {CAN_SEI(); CAN_EN_RX_INT();                 } while (0)
 #define CAN_INT_TX()   do {CAN_SEI(); CAN_EN_TX_INT();                 } while (0)
 
@@ -185,13 +203,64 @@ enum mob_status_t {
 //_____ D E C L A R A T I O N S ________________________________________________
 
 static inline int8_t find_me_a_mob(void);
-static inline void enable_spy_mob(uint8_t mob);
+static inline void enable_rx_mob(uint8_t mob, const struct can_filter *f);
+static void load_tx_mob(const uint8_t mob, const struct can_message *msg);
+static void release_tx_mob(const uint8_t mob);
+static void abort_tx_mob(const uint8_t mob);
+static void tx_failed(const uint8_t mob);
+static void reclaim_timed_out_mobs(const uint32_t tick);
+static void count_errors(const uint8_t canst);
+static bool tx_enqueue(const struct can_message *msg, const bool ahead);
+static uint8_t send_frame(const struct can_message *frame);
+static void enter_bus_off(void);
+static void update_bus_state(const uint32_t tick);
+static inline void poll_bus_state(void);
 static void receive_frame(const uint8_t mob, const uint16_t id);
+static struct can_mailbox* find_mailbox(const uint16_t id);
+static uint32_t rx_stamp(void);
 static void reset_counters(void);
 
+/**
+ * Holds the latest frame of a single message id.
+ * The ISR increments seq every time it has overwritten the frame, skipping 0
+ * which means that nothing has been received yet. The reader
+ * retries the copy if seq changed underneath it, and remembers the seq it
+ * read last so it can tell if the frame is new.
+ */
+struct can_mailbox {
+	struct can_message msg;
+	volatile uint8_t seq;   //!< Only written by the ISR
+	uint8_t read_seq;       //!< Only written by the reader
+};
+
 static volatile uint16_t mob_on_job;
-static volatile ringbuffer_t rb;
-static uint8_t buff[RINGBF_SIZE];
+static struct can_queue rx_queue;
+static struct can_mailbox mailbox[NB_MAILBOX];
+static uint8_t nb_mailbox;
+static can_handler_t handlers[END_OF_LIST];
+
+/**
+ * Frames waiting for a free MOB, sorted so the frame to send next is last.
+ * That is the one with the lowest id, and of those the one queued first.
+ * Frames on the way out carry their CAN identifier from get_msg_can_id() in
+ * id, not the message_id, so they are sorted as they arbitrate on the bus.
+ * Only accessed from the ISR or with interrupts disabled.
+ */
+static struct can_message tx_queue[TX_QUEUE_SIZE];
+static uint8_t tx_queue_len;
+static uint8_t tx_queue_peak;
+static struct can_message tx_staging; //!< Frame being written by the caller of can_broadcast_begin()
+
+/**
+ * State of the transmission in each TX MOB while it is on the job.
+ * A MOB is reclaimed when its frame has failed more than tx_max_retries times
+ * or has not been sent by its deadline. Deadlines are sysclock ticks, which is
+ * why can_init() makes sure the sysclock runs.
+ */
+static uint8_t tx_attempts[NB_TX_MOB];
+static uint32_t tx_deadline[NB_TX_MOB];
+static uint8_t tx_max_retries = TX_MAX_RETRIES;
+static uint16_t tx_timeout = TX_TIMEOUT;
 
 static volatile uint16_t dlcw_err;
 static volatile uint16_t rx_comp;
@@ -203,6 +272,22 @@ static volatile uint16_t stuff_err;
 static volatile uint16_t bit_err;
 static volatile uint16_t no_mob_err;
 static volatile uint16_t alloc_err;
+static volatile uint16_t tx_queued;
+static volatile uint16_t tx_retry;
+static volatile uint16_t tx_aborted;
+static volatile uint16_t tx_timed_out;
+static volatile uint16_t bus_off_events;
+
+/**
+ * The controller leaves bus off by itself after 128 times 11 recessive bits.
+ * The driver then holds transmission back for tx_hold ms so a node with a
+ * fault does not take the bus down again right away. The hold back doubles
+ * with each bus off that comes within BUS_OFF_FORGET ms of the last one.
+ */
+static volatile enum can_bus_state bus_state;
+static uint32_t bus_off_tick;
+static uint32_t tx_hold_until;
+static uint16_t tx_hold;
 
 
 //______________________________________________________________________________
@@ -218,6 +303,11 @@ static void reset_counters() {
 	crc_err   = 0;
 	stuff_err = 0;
 	bit_err   = 0;
+	tx_queued = 0;
+	tx_retry  = 0;
+	tx_aborted = 0;
+	tx_timed_out = 0;
+	bus_off_events = 0;
 }
 
 
@@ -238,8 +328,18 @@ uint16_t get_counter(enum can_counters counter) {
 		case BIT_ERR: 	return bit_err;
 		case NO_MOB_ERR:return no_mob_err;
 		case ALLOC_ERR: return alloc_err;
+		case TX_QUEUED: return tx_queued;
+		case TX_QUEUE_DEPTH: return tx_queue_len;
+		case TX_QUEUE_PEAK: return tx_queue_peak;
+		case TX_RETRY: return tx_retry;
+		case TX_ABORTED: return tx_aborted;
+		case TX_TIMED_OUT: return tx_timed_out;
+		case BUS_OFF_EVENTS: return bus_off_events;
+		case TX_ERR_COUNT: return CANTEC;
+		case RX_ERR_COUNT: return CANREC;
 		case TOTAL_ERR: return ack_err + form_err + crc_err +
-								stuff_err + bit_err + no_mob_err;
+								stuff_err + bit_err + no_mob_err +
+								tx_aborted + tx_timed_out;
 		default: 		return 0;
 	}
 }
@@ -247,14 +347,30 @@ uint16_t get_counter(enum can_counters counter) {
 
 /**
  * Initializes the CAN driver, which involves:
- * Initializing the ringbuffer,
+ * Initializing the receive queue,
  * reset counters,
  * set baudrate,
  * reset mobs,
- * enable listening mobs (spy mobs).
+ * enable the reception mobs with filters for the subscribed messages.
+ *
+ * Everything in flight is lost, so this is only meant for start up. The driver
+ * recovers from error passive and bus off by itself, see can_get_bus_state().
+ *
+ * The TX timeouts and the hold back after bus off count sysclock ticks, so the
+ * sysclock is started here unless the node has done it already. Without it a
+ * stuck MOB would never be reclaimed and transmission would stay held back
+ * forever after the first bus off.
  */
 void can_init() {
-	rb_init((ringbuffer_t*)&rb, buff, RINGBF_SIZE);
+	if (!sysclock_running()) {
+		sysclock_init();
+	}
+
+	cq_init(&rx_queue);
+	tx_queue_len = 0;
+	tx_queue_peak = 0;
+	bus_state = CAN_ERROR_ACTIVE;
+	tx_hold = 0;
 
 	CAN_RESET();
 	reset_counters();
@@ -262,6 +378,7 @@ void can_init() {
 	CANBT1 = CANBT1_VALUE;
 	CANBT2 = CANBT2_VALUE;
 	CANBT3 = CANBT3_VALUE;
+	CANTCON = CAN_TIMER_PRESCALER;
 
 	// It reset CANSTMOB, CANCDMOB, CANIDTx & CANIDMx and clears data FIFO of
 	// MOb[0] upto MOb[LAST_MOB_NB].
@@ -272,14 +389,14 @@ void can_init() {
 		CAN_DISABLE_MOB_INTERRUPT(mob);
 	}
 
+	// The reception mobs are never handed out for transmission
 	mob_on_job = 0;
-
-	// Enable all spymobs
-	uint8_t i = NB_SPYMOB;
-	while (i--) {
-		enable_spy_mob(LAST_MOB_NB - i);
+	for (uint8_t mob = FIRST_RX_MOB; mob < NB_MOB; ++mob) {
+		BIT_SET(mob_on_job, mob);
 	}
 
+	can_update_filters();
+
 	CAN_ENABLE();
 	CAN_INT_ALL();
 }
@@ -287,28 +404,296 @@ void can_init() {
 
 /**
  * Broadcasts a frame on the CAN bus.
- * @return err SUCCES or NO_MOB_ERR.
+ * If all MOBs are busy the frame waits in the transmit queue and is sent as
+ * soon as a MOB is freed, in order of CAN id priority.
+ * @return err SUCCES or NO_MOB_ERR if the frame was dropped because the
+ * transmit queue was full of frames with a higher priority.
  */
 uint8_t can_broadcast(const enum message_id id, const void* msg) {
-	const uint16_t can_id = (uint16_t)id;
-	int8_t mob = find_me_a_mob();
-	if (mob == -1) {
-		return NO_MOB_ERR;
+	struct can_message frame = {
+		.id = get_msg_can_id(id),
+		.len = get_msg_length(id),
+	};
+	memcpy(frame.data, msg, frame.len);
+
+	return send_frame(&frame);
+}
+
+
+/**
+ * Starts a broadcast where the payload is written in place instead of being
+ * copied in from a buffer. Write get_msg_length(id) bytes to the returned
+ * pointer and then call can_broadcast_commit().
+ * @note only one broadcast can be in progress at a time, so this must not be
+ * used from an ISR.
+ * @return Pointer to the payload of the frame.
+ */
+uint8_t* can_broadcast_begin(const enum message_id id) {
+	tx_staging.id = get_msg_can_id(id);
+	tx_staging.len = get_msg_length(id);
+	return tx_staging.data;
+}
+
+
+/**
+ * Sends the frame started by can_broadcast_begin().
+ * @return err as can_broadcast().
+ */
+uint8_t can_broadcast_commit(void) {
+	return send_frame(&tx_staging);
+}
+
+
+static uint8_t send_frame(const struct can_message *frame) {
+	const uint32_t tick = get_tick();
+	uint8_t err = SUCCES;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		update_bus_state(tick);
+		reclaim_timed_out_mobs(tick);
+		const int8_t mob = (bus_state < CAN_BUS_OFF) ? find_me_a_mob() : -1;
+		if (mob != -1) {
+			load_tx_mob(mob, frame);
+		} else if (!tx_enqueue(frame, false)) {
+			err = NO_MOB_ERR;
+		}
 	}
+	return err;
+}
 
-	uint8_t len = get_msg_length(id);
 
+/**
+ * Gets the fault confinement state of the controller. While it is CAN_BUS_OFF
+ * or CAN_TX_HELD frames passed to can_broadcast() are kept in the transmit
+ * queue and sent once the hold back is over. Reception goes on as soon as the
+ * controller is back on the bus, so there is no need to call can_init().
+ */
+enum can_bus_state can_get_bus_state(void) {
+	const uint32_t tick = get_tick();
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		update_bus_state(tick);
+	}
+	return bus_state;
+}
+
+
+/**
+ * Follows the controller out of bus off and the hold back, and between error
+ * active and error passive. Loads the frames that queued up while transmission
+ * was held back once it is over.
+ * @note must be called with interrupts disabled.
+ */
+static void update_bus_state(const uint32_t tick) {
+	if (bus_state == CAN_BUS_OFF && !BIT_CHECK(CANGSTA, BOFF)) {
+		bus_state = CAN_TX_HELD;
+	}
+
+	if (bus_state == CAN_TX_HELD) {
+		if ((int32_t)(tick - tx_hold_until) < 0) {
+			return;
+		}
+		int8_t mob;
+		while (tx_queue_len && (mob = find_me_a_mob()) != -1) {
+			load_tx_mob(mob, &tx_queue[--tx_queue_len]);
+		}
+	}
+
+	if (bus_state != CAN_BUS_OFF) {
+		bus_state = BIT_CHECK(CANGSTA, ERRP) ? CAN_ERROR_PASSIVE : CAN_ERROR_ACTIVE;
+	}
+}
+
+
+/**
+ * Nothing signals the end of bus off or of the hold back, so the receiving
+ * functions the main loop calls anyway look for it.
+ */
+static inline void poll_bus_state(void) {
+	if (bus_state >= CAN_BUS_OFF) {
+		can_get_bus_state();
+	}
+}
+
+
+/**
+ * Takes the frames out of the TX MOBs when the controller goes bus off, so they
+ * are not sent the moment it is back on the bus, and queues them to be sent
+ * after the hold back instead. The reception MOBs are left armed.
+ * @note must be called with interrupts disabled.
+ */
+static void enter_bus_off(void) {
+	const uint32_t tick = get_tick();
+
+	++bus_off_events;
+	if (tx_hold == 0 || (tick - bus_off_tick) > BUS_OFF_FORGET) {
+		tx_hold = TX_HOLD_MIN;
+	} else if (tx_hold < TX_HOLD_MAX / 2) {
+		tx_hold *= 2;
+	} else {
+		tx_hold = TX_HOLD_MAX;
+	}
+	bus_off_tick = tick;
+	tx_hold_until = tick + tx_hold;
+	bus_state = CAN_BUS_OFF;
+
+	// The controller sends the lowest numbered MOB first, so it goes in last
+	for (int8_t mob = NB_TX_MOB - 1; mob >= 0; --mob) {
+		if (!BIT_CHECK(mob_on_job, mob)) continue;
+
+		CAN_SET_MOB(mob);
+		struct can_message msg = {
+			.id = MOB_GET_STD_ID(),
+			.len = MOB_GET_DLC(),
+		};
+		for (uint8_t i = 0; i < msg.len; ++i) {
+			msg.data[i] = CANMSG;
+		}
+		MOB_ABORT();
+		MOB_CLEAR_INT_STATUS();
+		CAN_DISABLE_MOB_INTERRUPT(mob);
+		BIT_CLEAR(mob_on_job, mob);
+
+		if (!tx_enqueue(&msg, true)) {
+			++tx_aborted;
+		}
+	}
+}
+
+
+/**
+ * Loads a frame into a free MOB and starts the transmission.
+ * @note must be called with interrupts disabled.
+ */
+static void load_tx_mob(const uint8_t mob, const struct can_message *msg) {
 	BIT_SET(mob_on_job, mob);
 	CAN_SET_MOB(mob);
-	MOB_SET_STD_ID(can_id);
-	MOB_SET_DLC(len);
-	for (uint8_t i = 0; i < len; ++i) {
-		CANMSG = ((uint8_t*)msg)[i];
+	CANCDMOB = 0; // Clear any DLC left over from the last frame
+	MOB_SET_STD_ID(msg->id);
+	MOB_SET_DLC(msg->len);
+	for (uint8_t i = 0; i < msg->len; ++i) {
+		CANMSG = msg->data[i];
 	}
 
+	tx_attempts[mob] = 0;
+	tx_deadline[mob] = get_tick() + tx_timeout;
+
 	MOB_EN_TX();
 	CAN_ENABLE_MOB_INTERRUPT(mob);
-	return SUCCES;
+}
+
+
+/**
+ * Frees a TX MOB and loads the next frame waiting in the transmit queue.
+ * @note must be called with interrupts disabled and the MOB selected.
+ */
+static void release_tx_mob(const uint8_t mob) {
+	BIT_CLEAR(mob_on_job, mob);
+	if (tx_queue_len && bus_state < CAN_BUS_OFF) {
+		load_tx_mob(mob, &tx_queue[--tx_queue_len]);
+	}
+}
+
+
+/**
+ * Gives up on the frame in a TX MOB and frees the MOB.
+ * @note must be called with interrupts disabled.
+ */
+static void abort_tx_mob(const uint8_t mob) {
+	CAN_SET_MOB(mob);
+	MOB_ABORT();
+	MOB_CLEAR_INT_STATUS();
+	CAN_DISABLE_MOB_INTERRUPT(mob);
+	release_tx_mob(mob);
+}
+
+
+/**
+ * Called for every failed transmission attempt. The controller retransmits
+ * the frame by itself, so all there is to do is to stop it once the retry
+ * limit is exceeded.
+ * @note must be called with interrupts disabled.
+ */
+static void tx_failed(const uint8_t mob) {
+	if (!BIT_CHECK(mob_on_job, mob)) {
+		return;
+	}
+
+	if (++tx_attempts[mob] > tx_max_retries) {
+		++tx_aborted;
+		abort_tx_mob(mob);
+	} else {
+		++tx_retry;
+	}
+}
+
+
+/**
+ * Reclaims the TX MOBs that have not managed to send their frame in time, fx.
+ * because the controller is error passive or bus off.
+ * @note must be called with interrupts disabled.
+ */
+static void reclaim_timed_out_mobs(const uint32_t tick) {
+	for (uint8_t mob = 0; mob < NB_TX_MOB; ++mob) {
+		if (BIT_CHECK(mob_on_job, mob) &&
+		    (int32_t)(tick - tx_deadline[mob]) >= 0) {
+			++tx_timed_out;
+			abort_tx_mob(mob);
+		}
+	}
+}
+
+
+/**
+ * Set how hard the driver tries to send a frame before giving up on it.
+ * @param max_retries Number of retransmissions after a failed attempt
+ * @param timeout_ms  Milliseconds from a frame is loaded into a MOB until it is
+ *                    given up, counted by the sysclock
+ */
+void can_set_tx_limits(uint8_t max_retries, uint16_t timeout_ms) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		tx_max_retries = max_retries;
+		tx_timeout = timeout_ms;
+	}
+}
+
+
+/**
+ * Inserts a frame in the transmit queue. If the queue is full the frame with
+ * the lowest priority, which may be the new one, is dropped.
+ * @note must be called with interrupts disabled.
+ * @param ahead Send the frame before those with the same id already queued.
+ * @return false if the new frame was dropped.
+ */
+static bool tx_enqueue(const struct can_message *msg, const bool ahead) {
+	++tx_queued;
+
+	if (tx_queue_len == TX_QUEUE_SIZE) {
+		++no_mob_err;
+		if (msg->id >= tx_queue[0].id) {
+			return false;
+		}
+
+		// Make room by dropping the frame that would be sent last
+		memmove(&tx_queue[0], &tx_queue[1],
+		        (TX_QUEUE_SIZE - 1) * sizeof(tx_queue[0]));
+		--tx_queue_len;
+	}
+
+	// Skip past the frames that should be sent after this one
+	uint8_t i = 0;
+	while (i < tx_queue_len && (tx_queue[i].id > msg->id ||
+	                            (ahead && tx_queue[i].id == msg->id))) {
+		++i;
+	}
+
+	memmove(&tx_queue[i + 1], &tx_queue[i],
+	        (tx_queue_len - i) * sizeof(tx_queue[0]));
+	tx_queue[i] = *msg;
+	++tx_queue_len;
+
+	if (tx_queue_len > tx_queue_peak) {
+		tx_queue_peak = tx_queue_len;
+	}
+	return true;
 }
 
 
@@ -319,27 +704,67 @@ uint8_t can_broadcast(const enum message_id id, const void* msg) {
  * @return mob MOB number or -1 for no MOB.
  */
 static inline int8_t find_me_a_mob(void) {
-	for (uint8_t i = 0; i < 15; i++)
+	for (uint8_t i = 0; i < NB_TX_MOB; i++)
 		if (!BIT_CHECK(mob_on_job, i))
 			return i;
 
-	++no_mob_err;
 	return -1;
 }
 
 
 /**
- * Initializes a mob that listens to all ID's.
- * This is essentially a recievemob.
- * Even though the MOB will recieve frames with
- * any ID's, not all frames are saved.
- * Non subscribed frames are dropped immediately.
+ * Reprograms the acceptance filters of the reception MOBs to match the
+ * subscribed messages, so frames nobody on this node wants are dropped by the
+ * CAN controller without raising an interrupt.
+ * Must be called after changing subscriptions. can_init() calls it as well.
+ *
+ * If there are fewer filters than reception MOBs the filters are repeated, so
+ * back to back frames matching the same filter can still be buffered.
+ */
+void can_update_filters(void) {
+	// Accepted ids are put at the front and rejected ids at the back
+	uint16_t ids[END_OF_LIST];
+	uint8_t n_accept = 0;
+	uint8_t n_reject = END_OF_LIST;
+	for (uint8_t id = 0; id < END_OF_LIST; ++id) {
+		if (can_is_subscribed(id)) {
+			ids[n_accept++] = get_msg_can_id(id);
+		} else {
+			ids[--n_reject] = get_msg_can_id(id);
+		}
+	}
+
+	struct can_filter filters[NB_RX_MOB];
+	const uint8_t n = can_filter_solve(ids, n_accept,
+	                                   &ids[n_reject], END_OF_LIST - n_reject,
+	                                   filters, NB_RX_MOB);
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		for (uint8_t i = 0; i < NB_RX_MOB; ++i) {
+			const uint8_t mob = FIRST_RX_MOB + i;
+			CAN_SET_MOB(mob);
+			MOB_ABORT();
+			CAN_DISABLE_MOB_INTERRUPT(mob);
+
+			if (n) {
+				enable_rx_mob(mob, &filters[i % n]);
+			}
+		}
+	}
+}
+
+
+/**
+ * Initializes a mob that receives the frames accepted by the given filter.
  * @param mob The MOB to enable.
+ * @param f The acceptance filter.
  */
-static inline void enable_spy_mob(uint8_t mob) {
-	BIT_SET(mob_on_job, mob);
+static inline void enable_rx_mob(uint8_t mob, const struct can_filter *f) {
 	CAN_SET_MOB(mob);
-	MOB_SET_STD_FILTER_NONE();
+	CANCDMOB = 0; // Clear any DLC and configuration left over from the last frame
+	MOB_SET_STD_ID(f->id);
+	MOB_SET_STD_MASK_FILTER(f->mask);
+	BIT_SET(CANIDM4, IDEMSK); // Only accept standard frames
 	MOB_SET_DLC(8); // Set the expected payload length
 	CAN_ENABLE_MOB_INTERRUPT(mob);
 	MOB_EN_RX();
@@ -347,53 +772,211 @@ static inline void enable_spy_mob(uint8_t mob) {
 
 
 /**
- * Reads a CAN frame from the bus and pushes it onto the
- * CAN input ring-buffer.
- * It pushes the id, data length and data itself.
+ * Reads a CAN frame from the bus into the mailbox for its id, or else straight
+ * into a free slot of the CAN receive queue, and rearms the MOB.
  * @param mob The mob to read data from.
  * @param id The id of the recieved message.
  */
 static void receive_frame(const uint8_t mob, const uint16_t id) {
-	const uint8_t len = MOB_GET_DLC();
-
-	if (rb_left((ringbuffer_t*)&rb) > (3 + len)) {
-		rb_push((ringbuffer_t*)&rb, HIGH_BYTE(id));
-		rb_push((ringbuffer_t*)&rb, LOW_BYTE(id));
-		rb_push((ringbuffer_t*)&rb, len);
+	struct can_mailbox *box = find_mailbox(id);
+	struct can_message *msg = (box != NULL) ? &box->msg : cq_claim(&rx_queue);
+
+	if (msg != NULL) {
+		msg->id = id;
+		msg->stamp = rx_stamp();
+		// A DLC of 9 to 15 is legal on the bus but still means 8 data bytes
+		uint8_t len = MOB_GET_DLC();
+		if (len > 8) len = 8;
+		msg->len = len;
 		for (uint8_t i = 0; i < len; ++i) {
-			rb_push((ringbuffer_t*)&rb, CANMSG);
+			msg->data[i] = CANMSG;
 		}
 
-		CAN_ENABLE_MOB_INTERRUPT(mob);
-		MOB_EN_RX();
+		if (box != NULL) {
+			CQ_MEMORY_BARRIER();
+			const uint8_t seq = box->seq + 1;
+			box->seq = (seq != 0) ? seq : 1; // 0 is kept for never received
+		} else {
+			cq_publish(&rx_queue);
+		}
 		++rx_comp;
 	} else {
-		CAN_ENABLE_MOB_INTERRUPT(mob);
-		MOB_EN_RX();
 		++alloc_err;
 	}
+
+	CAN_ENABLE_MOB_INTERRUPT(mob);
+	MOB_EN_RX();
 }
 
 
 /**
- * Reads a message from the CAN buffer.
+ * Converts the time stamp the controller took at the end of the frame in the
+ * current MOB to the get_us() timebase. Runs in the ISR for every frame, so it
+ * multiplies and shifts rather than divides, as does get_us().
+ */
+static uint32_t rx_stamp(void) {
+	const uint16_t elapsed = CANTIM - CANSTM;
+	return get_us() - (((uint32_t)elapsed * CAN_TIMER_US_Q8) >> 8);
+}
+
+
+static struct can_mailbox* find_mailbox(const uint16_t id) {
+	for (uint8_t i = 0; i < nb_mailbox; ++i) {
+		if (mailbox[i].msg.id == id) {
+			return &mailbox[i];
+		}
+	}
+	return NULL;
+}
+
+
+/**
+ * Receive the given message in mailbox mode and subscribe to it.
+ * Instead of being queued, every new frame overwrites the previous one, so
+ * only the latest value is kept and a burst of frames can never overflow the
+ * receive queue. Use can_get_latest() to read it.
+ * @note call can_update_filters() afterwards, as with can_subscribe().
+ * @return false if all NB_MAILBOX mailboxes are already in use.
+ */
+bool can_mailbox_enable(enum message_id id) {
+	if (find_mailbox(id) != NULL) {
+		return true;
+	}
+
+	if (nb_mailbox == NB_MAILBOX) {
+		return false;
+	}
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		struct can_mailbox *box = &mailbox[nb_mailbox];
+		box->msg.id = id;
+		box->msg.len = 0;
+		box->seq = box->read_seq = 0;
+		++nb_mailbox;
+	}
+
+	can_subscribe(id);
+	return true;
+}
+
+
+/**
+ * Get the latest frame received for a message in mailbox mode.
+ * @param  id  The message id
+ * @param  msg Filled with the latest frame. Left untouched if none has arrived
+ * @param  age Set to the milliseconds since the frame arrived. May be NULL
+ * @return     true if the frame is new since the last call for this id
+ */
+bool can_get_latest(enum message_id id, struct can_message *msg, uint32_t *age) {
+	poll_bus_state();
+
+	struct can_mailbox *box = find_mailbox(id);
+	if (box == NULL) {
+		return false;
+	}
+
+	uint8_t seq;
+	do {
+		seq = box->seq;
+		CQ_MEMORY_BARRIER();
+		*msg = box->msg;
+		CQ_MEMORY_BARRIER();
+	} while (seq != box->seq);
+
+	if (seq == 0) {
+		return false; // Nothing received yet
+	}
+
+	if (age != NULL) {
+		*age = (get_us() - msg->stamp) / 1000;
+	}
+
+	const bool fresh = (seq != box->read_seq);
+	box->read_seq = seq;
+	return fresh;
+}
+
+
+/**
+ * Reads a message from the CAN receive queue.
+ * The ISR only ever moves the head of the queue and this only moves the tail,
+ * so there is no need to mask interrupts while copying the frame out.
  * @param Pointer to CAN data struct to fill.
  */
 void read_message(struct can_message* msg) {
-	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-		if (can_has_data()) {
-			uint8_t c;
-			rb_pop((ringbuffer_t*)&rb, &c);
-			msg->id = c << 8;
-			rb_pop((ringbuffer_t*)&rb, &c);
-			msg->id += c;
-			rb_pop((ringbuffer_t*)&rb, &msg->len);
-
-			for (uint8_t i = 0; i < msg->len; ++i) {
-				rb_pop((ringbuffer_t*)&rb, &msg->data[i]);
-			}
+	cq_pop(&rx_queue, msg);
+}
+
+
+/**
+ * Gets the oldest frame in the receive queue without copying it out. The frame
+ * stays in place until can_release_message() is called.
+ * @return Pointer to the frame or NULL if the queue is empty.
+ */
+const struct can_message* can_peek_message(void) {
+	poll_bus_state();
+	return cq_peek(&rx_queue);
+}
+
+
+/**
+ * Removes the frame returned by can_peek_message() from the receive queue.
+ */
+void can_release_message(void) {
+	cq_release(&rx_queue);
+}
+
+
+/**
+ * Register a function that can_dispatch() calls for every frame received with
+ * the given id, and subscribe to it. Passing NULL removes the handler, but
+ * keeps the subscription.
+ * @note call can_update_filters() afterwards, as with can_subscribe().
+ */
+void can_on(enum message_id id, can_handler_t handler) {
+	if (id >= END_OF_LIST) return;
+
+	handlers[id] = handler;
+	if (handler != NULL) {
+		can_subscribe(id);
+	}
+}
+
+
+/**
+ * Calls the registered handler of up to budget received frames, oldest first.
+ * Frames in the receive queue are handed to the handler in place, so the
+ * handler must not keep the pointer after it returns. Frames without a handler
+ * are dropped. Mailboxes with a handler are passed on when they hold a frame
+ * that has not been read yet.
+ * @param  budget The maximum number of frames to handle in this call.
+ * @return        The number of frames handled.
+ */
+uint8_t can_dispatch(uint8_t budget) {
+	uint8_t n = 0;
+
+	poll_bus_state();
+
+	for (uint8_t i = 0; i < nb_mailbox && n < budget; ++i) {
+		const can_handler_t handler = handlers[mailbox[i].msg.id];
+		struct can_message msg;
+		if (handler != NULL && can_get_latest(mailbox[i].msg.id, &msg, NULL)) {
+			handler(&msg);
+			++n;
+		}
+	}
+
+	const struct can_message *msg;
+	while (n < budget && (msg = cq_peek(&rx_queue)) != NULL) {
+		const can_handler_t handler = handlers[msg->id];
+		if (handler != NULL) {
+			handler(msg);
 		}
+		cq_release(&rx_queue);
+		++n;
 	}
+
+	return n;
 }
 
 
@@ -402,58 +985,76 @@ void read_message(struct can_message* msg) {
  * @preturn Boolean on buffer status.
  */
 bool can_has_data() {
-	return (rb_left((ringbuffer_t*)&rb) < RINGBF_SIZE-1) ? true : false;
+	poll_bus_state();
+	return !cq_is_empty(&rx_queue);
 }
 
 
+/**
+ * Counts each error flagged in a MOB status.
+ */
+static void count_errors(const uint8_t canst) {
+	if (canst & MOB_ACK_ERROR)   ++ack_err;
+	if (canst & MOB_FORM_ERROR)  ++form_err;
+	if (canst & MOB_CRC_ERROR)   ++crc_err;
+	if (canst & MOB_STUFF_ERROR) ++stuff_err;
+	if (canst & MOB_BIT_ERROR)   ++bit_err;
+}
+
+
+/**
+ * The handler runs with interrupts disabled throughout. It must not nest, as
+ * it is the only producer of the receive queue and it owns CANPAGE while it
+ * runs.
+ */
 ISR (CANIT_vect) {
+	if (BIT_CHECK(CANGIT, BOFFIT)) {
+		CANGIT = (1 << BOFFIT);
+		enter_bus_off();
+	}
+
 	while (PRIORITY_MOB() != NB_MOB) { /* True if mob have pending interrupt */
 		const uint8_t mob = PRIORITY_MOB();
 		CAN_SET_MOB(mob);
 		const uint8_t canst = CANSTMOB;
 		const uint16_t id = MOB_GET_STD_ID();
 		MOB_CLEAR_INT_STATUS();
-		sei();
 
 		switch (canst) {
 			case MOB_RX_COMPLETED_DLCW:
 				++dlcw_err;
-			case MOB_RX_COMPLETED:
-
-				if (!can_is_subscribed(id)) {
+			case MOB_RX_COMPLETED: {
+				// Merged filters can let a few unsubscribed ids through
+				const enum message_id msg_id = get_msg_id(id);
+				if (msg_id == END_OF_LIST || !can_is_subscribed(msg_id)) {
 					CAN_ENABLE_MOB_INTERRUPT(mob);
 					MOB_EN_RX();
 					continue;
 				} else {
-					receive_frame(mob, id);
+					receive_frame(mob, msg_id);
 				}
 				break;
+			}
 
 			case MOB_TX_COMPLETED:
 				++tx_comp;
-				BIT_CLEAR(mob_on_job, mob);
-				break;
-
-			case MOB_ACK_ERROR:
-				++ack_err;
-				break;
-
-			case MOB_FORM_ERROR:
-				++form_err;
-				break;
-
-			case MOB_CRC_ERROR:
-				++crc_err;
-				break;
-
-			case MOB_STUFF_ERROR:
-				++stuff_err;
+				release_tx_mob(mob);
 				break;
 
-			case MOB_BIT_ERROR:
-				++bit_err;
+			default:
+				count_errors(canst);
+				if (mob < NB_TX_MOB) {
+					tx_failed(mob);
+				}
+				if (bus_state < CAN_BUS_OFF) {
+					bus_state = BIT_CHECK(CANGSTA, ERRP) ?
+					            CAN_ERROR_PASSIVE : CAN_ERROR_ACTIVE;
+				}
 				break;
 		}
-		cli();
+	}
+
+	if (bus_state >= CAN_BUS_OFF) {
+		update_bus_state(get_tick());
 	}
 }
@@ -51,22 +51,57 @@ enum can_counters{
 	BIT_ERR,
 	NO_MOB_ERR,
 	ALLOC_ERR,
+	TX_QUEUED,
+	TX_QUEUE_DEPTH,
+	TX_QUEUE_PEAK,
+	TX_RETRY,
+	TX_ABORTED,
+	TX_TIMED_OUT,
+	BUS_OFF_EVENTS,
+	TX_ERR_COUNT,  //!< The transmit error counter TEC of the controller
+	RX_ERR_COUNT,  //!< The receive error counter REC of the controller
 	ID_ERR,
 	TOTAL_ERR,
 };
 
 
+/**
+ * Fault confinement state of the CAN controller, see can_get_bus_state().
+ */
+enum can_bus_state {
+	CAN_ERROR_ACTIVE,  //!< Normal operation
+	CAN_ERROR_PASSIVE, //!< TEC or REC above 127, errors are only signalled passively
+	CAN_BUS_OFF,       //!< TEC above 255, the controller has left the bus
+	CAN_TX_HELD,       //!< Back on the bus, transmission held back after a bus off
+};
+
+
 struct can_message {
-	uint16_t id;
+	uint16_t id;    //!< enum message_id
+	uint32_t stamp; //!< get_us() time the frame was received on the wire
 	uint8_t len;
 	uint8_t data[8];
 };
 
+//!< Called by can_dispatch() with a frame of the id it was registered for.
+typedef void (*can_handler_t)(const struct can_message *msg);
+
 
 void can_init(void);
+void can_update_filters(void);
 uint8_t can_broadcast(const enum message_id id, const void* msg);
+uint8_t* can_broadcast_begin(const enum message_id id);
+uint8_t can_broadcast_commit(void);
+void can_set_tx_limits(uint8_t max_retries, uint16_t timeout_ms);
 uint16_t get_counter(enum can_counters counter);
+enum can_bus_state can_get_bus_state(void);
 void read_message(struct can_message* msg);
+const struct can_message* can_peek_message(void);
+void can_release_message(void);
 bool can_has_data(void);
+bool can_mailbox_enable(enum message_id id);
+bool can_get_latest(enum message_id id, struct can_message *msg, uint32_t *age);
+void can_on(enum message_id id, can_handler_t handler);
+uint8_t can_dispatch(uint8_t budget);
 
 #endif /* CAN_H */
@@ -0,0 +1,210 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 UnicornRaceEngineering
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+* @file can_filter.c
+* @brief
+*   Computes CAN acceptance filters (ID/mask pairs) from a set of identifiers
+*   that should be received and a set that must be rejected.
+*
+*   Identifiers that are in neither set never appear on the bus, so the filters
+*   are free to accept them. The solver first tries to cover the accepted
+*   identifiers exactly. Every uncovered identifier is grown into the largest
+*   filter that still rejects everything in the reject set, and filters made
+*   redundant by later ones are dropped. When a new filter is needed and there
+*   is no room left, the two filters whose union lets the fewest rejected
+*   identifiers through are merged. Frames let through by such a merge still
+*   have to be dropped in software.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "can_filter.h"
+
+
+static uint8_t n_matching(const struct can_filter *f,
+                          const uint16_t *ids, uint8_t n);
+static struct can_filter expand(uint16_t id,
+                                const uint16_t *accept, uint8_t n_accept,
+                                const uint16_t *reject, uint8_t n_reject);
+static struct can_filter merge(const struct can_filter *a,
+                               const struct can_filter *b);
+static bool covers(const struct can_filter *outer,
+                   const struct can_filter *inner);
+static uint8_t remove_filter(struct can_filter *filters, uint8_t n, uint8_t i);
+
+
+static uint8_t n_matching(const struct can_filter *f,
+                          const uint16_t *ids, uint8_t n) {
+	uint8_t matches = 0;
+	while (n--) {
+		if (CAN_FILTER_MATCH(f, ids[n])) ++matches;
+	}
+	return matches;
+}
+
+
+/**
+ * Grow an exact filter for id one don't care bit at a time, starting from the
+ * least significant bit, as long as no rejected id is let through. Of the bits
+ * that can be freed, those that pull in more accepted ids are tried first.
+ */
+static struct can_filter expand(uint16_t id,
+                                const uint16_t *accept, uint8_t n_accept,
+                                const uint16_t *reject, uint8_t n_reject) {
+	struct can_filter f = { .id = id, .mask = CAN_STD_ID_MSK };
+
+	while (1) {
+		int8_t best_bit = -1;
+		uint8_t best_gain = 0;
+
+		for (uint8_t bit = 0; bit < CAN_STD_ID_BITS; ++bit) {
+			if (!(f.mask & (1 << bit))) continue;
+
+			const struct can_filter t = {
+				.id = f.id & ~(1 << bit),
+				.mask = f.mask & ~(1 << bit),
+			};
+			if (n_matching(&t, reject, n_reject)) continue;
+
+			const uint8_t gain = n_matching(&t, accept, n_accept);
+			if (best_bit < 0 || gain > best_gain) {
+				best_bit = bit;
+				best_gain = gain;
+			}
+		}
+
+		if (best_bit < 0) break;
+		f.mask &= ~(1 << best_bit);
+		f.id &= f.mask;
+	}
+
+	return f;
+}
+
+
+/**
+ * The smallest filter accepting everything that either a or b accepts.
+ */
+static struct can_filter merge(const struct can_filter *a,
+                               const struct can_filter *b) {
+	struct can_filter f;
+	f.mask = a->mask & b->mask & ~(a->id ^ b->id);
+	f.id = a->id & f.mask;
+	return f;
+}
+
+
+static bool covers(const struct can_filter *outer,
+                   const struct can_filter *inner) {
+	return ((outer->mask & inner->mask) == outer->mask) &&
+	       CAN_FILTER_MATCH(outer, inner->id);
+}
+
+
+static uint8_t remove_filter(struct can_filter *filters, uint8_t n, uint8_t i) {
+	filters[i] = filters[--n];
+	return n;
+}
+
+
+/**
+ * Find a small set of ID/mask pairs that accepts every id in accept.
+ * Ids in reject are kept out as long as that can be done within max_filters.
+ * @param  accept      Identifiers that must be received
+ * @param  n_accept    Number of identifiers in accept
+ * @param  reject      Identifiers that should not be received
+ * @param  n_reject    Number of identifiers in reject
+ * @param  filters     Output array with room for max_filters filters
+ * @param  max_filters Number of filters the hardware has room for
+ * @return             Number of filters written to filters
+ */
+uint8_t can_filter_solve(const uint16_t *accept, uint8_t n_accept,
+                         const uint16_t *reject, uint8_t n_reject,
+                         struct can_filter *filters, uint8_t max_filters) {
+	uint8_t n = 0;
+
+	if (max_filters == 0) return 0;
+
+	// Cover every accepted id that no filter accepts yet
+	for (uint8_t i = 0; i < n_accept; ++i) {
+		bool covered = false;
+		for (uint8_t j = 0; j < n; ++j) {
+			if (CAN_FILTER_MATCH(&filters[j], accept[i])) {
+				covered = true;
+				break;
+			}
+		}
+		if (covered) continue;
+
+		const struct can_filter f = expand(accept[i], accept, n_accept,
+		                                   reject, n_reject);
+
+		// Drop the filters the new one makes redundant
+		for (uint8_t j = n; j--; ) {
+			if (covers(&f, &filters[j])) n = remove_filter(filters, n, j);
+		}
+
+		if (n == max_filters) {
+			// Out of room. Merge the cheapest pair among the filters in use
+			// and the new one, index n standing in for the new filter.
+			uint8_t best_a = 0;
+			uint8_t best_b = n;
+			uint8_t best_cost = UINT8_MAX;
+			for (uint8_t a = 0; a < n; ++a) {
+				for (uint8_t b = a + 1; b <= n; ++b) {
+					const struct can_filter *fb = (b == n) ? &f : &filters[b];
+					const struct can_filter m = merge(&filters[a], fb);
+					const uint8_t cost = n_matching(&m, reject, n_reject);
+					if (cost < best_cost) {
+						best_a = a;
+						best_b = b;
+						best_cost = cost;
+					}
+				}
+			}
+
+			if (best_b == n) {
+				filters[best_a] = merge(&filters[best_a], &f);
+			} else {
+				filters[best_a] = merge(&filters[best_a], &filters[best_b]);
+				filters[best_b] = f;
+			}
+		} else {
+			filters[n++] = f;
+		}
+	}
+
+	// Merging may have made some filters redundant
+	for (uint8_t i = n; i--; ) {
+		for (uint8_t j = 0; j < n; ++j) {
+			if (i != j && covers(&filters[j], &filters[i])) {
+				n = remove_filter(filters, n, i);
+				break;
+			}
+		}
+	}
+
+	return n;
+}
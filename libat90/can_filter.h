@@ -0,0 +1,57 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 UnicornRaceEngineering
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+* @file can_filter.h
+* @brief
+*   Computes CAN acceptance filters (ID/mask pairs) from a set of identifiers
+*   that should be received and a set that must be rejected.
+*
+*   This is kept free of any hardware access so it can be tested and
+*   benchmarked on the host.
+*/
+
+#ifndef CAN_FILTER_H
+#define CAN_FILTER_H
+
+#include <stdint.h>
+
+#define CAN_STD_ID_BITS	( 11 )
+#define CAN_STD_ID_MSK	( (1 << CAN_STD_ID_BITS) - 1 )
+
+/**
+ * A frame with identifier x is accepted when (x & mask) == (id & mask).
+ * A set mask bit means that bit must match, as in the CANIDM registers.
+ */
+struct can_filter {
+	uint16_t id;
+	uint16_t mask;
+};
+
+#define CAN_FILTER_MATCH(f, x)	( (((x) ^ (f)->id) & (f)->mask) == 0 )
+
+uint8_t can_filter_solve(const uint16_t *accept, uint8_t n_accept,
+                         const uint16_t *reject, uint8_t n_reject,
+                         struct can_filter *filters, uint8_t max_filters);
+
+#endif /* CAN_FILTER_H */
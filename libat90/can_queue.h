@@ -0,0 +1,148 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 UnicornRaceEngineering
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+* @file can_queue.h
+* @brief
+*   Single-producer/single-consumer queue of preallocated CAN frame slots.
+*
+*   The producer (the CAN ISR) claims the next free slot with cq_claim(), fills
+*   it directly from the MOB and hands it over with cq_publish(). The consumer
+*   copies a frame out with cq_pop(). The producer only ever writes head and
+*   the consumer only ever writes tail. Both are single byte indices so they are
+*   read and written atomically on the AVR, and neither side has to mask
+*   interrupts.
+*
+*   The indices are free running and wrapped with a mask when used, so all
+*   CAN_QUEUE_SIZE slots can hold a frame.
+*/
+
+#ifndef CAN_QUEUE_H
+#define CAN_QUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>  // for NULL
+#include <stdint.h>
+
+#include "can.h"     // for can_message
+#include "utils.h"   // for IS_POW2
+
+#ifndef CAN_QUEUE_SIZE
+#define CAN_QUEUE_SIZE	( 8 ) //!< Number of frame slots. @note must be a pow2 value no larger than 128
+#endif
+
+#if !IS_POW2(CAN_QUEUE_SIZE) || (CAN_QUEUE_SIZE > 128)
+#error "CAN_QUEUE_SIZE must be a power of 2 no larger than 128"
+#endif
+
+#define CAN_QUEUE_MASK	( CAN_QUEUE_SIZE - 1 )
+
+//!< Keep the compiler from moving slot accesses across an index update.
+#define CQ_MEMORY_BARRIER()	__asm__ __volatile__ ("" ::: "memory")
+
+struct can_queue {
+	struct can_message slot[CAN_QUEUE_SIZE];
+	volatile uint8_t head; //!< Next slot to fill. Only written by the producer
+	volatile uint8_t tail; //!< Next slot to read. Only written by the consumer
+};
+
+
+static inline void cq_init(struct can_queue *q) {
+	q->head = q->tail = 0;
+}
+
+
+/**
+ * Number of frames waiting in the queue.
+ */
+static inline uint8_t cq_used(const struct can_queue *q) {
+	return (uint8_t)(q->head - q->tail);
+}
+
+
+static inline bool cq_is_empty(const struct can_queue *q) {
+	return q->head == q->tail;
+}
+
+
+static inline bool cq_is_full(const struct can_queue *q) {
+	return cq_used(q) == CAN_QUEUE_SIZE;
+}
+
+
+/**
+ * Get the next free slot for the producer to fill.
+ * The slot does not become visible to the consumer until cq_publish() is
+ * called.
+ * @return Pointer to the free slot or NULL if the queue is full.
+ */
+static inline struct can_message* cq_claim(struct can_queue *q) {
+	if (cq_is_full(q)) return NULL;
+	return &q->slot[q->head & CAN_QUEUE_MASK];
+}
+
+
+/**
+ * Hand the slot returned by the last cq_claim() over to the consumer.
+ */
+static inline void cq_publish(struct can_queue *q) {
+	CQ_MEMORY_BARRIER();
+	q->head = q->head + 1;
+}
+
+
+/**
+ * Copy the oldest frame out of the queue and release its slot.
+ * @param  msg Where the frame is copied to
+ * @return     false if the queue was empty
+ */
+static inline bool cq_pop(struct can_queue *q, struct can_message *msg) {
+	if (cq_is_empty(q)) return false;
+
+	*msg = q->slot[q->tail & CAN_QUEUE_MASK];
+	CQ_MEMORY_BARRIER();
+	q->tail = q->tail + 1;
+	return true;
+}
+
+
+/**
+ * Get the oldest frame without copying it out of the queue. The slot stays
+ * owned by the consumer until cq_release() is called.
+ * @return Pointer to the oldest frame or NULL if the queue is empty.
+ */
+static inline const struct can_message* cq_peek(const struct can_queue *q) {
+	if (cq_is_empty(q)) return NULL;
+	return &q->slot[q->tail & CAN_QUEUE_MASK];
+}
+
+
+/**
+ * Hand the slot returned by the last cq_peek() back to the producer.
+ */
+static inline void cq_release(struct can_queue *q) {
+	CQ_MEMORY_BARRIER();
+	q->tail = q->tail + 1;
+}
+
+#endif /* CAN_QUEUE_H */
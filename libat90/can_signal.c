@@ -0,0 +1,197 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 UnicornRaceEngineering
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+* @file can_signal.c
+* @brief
+*   Packs several scaled integer signals into a single CAN frame.
+*
+*   A frame carrying four 16 bit signals costs 47 + 64 bits on the bus instead
+*   of four frames of 47 + 32 bits when every signal is sent as a float on its
+*   own id. The layout of each signal is generated from "lists/can_frames.inc"
+*   into a table in flash, indexed by message id so no searching is needed.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+#include "can.h"
+#include "can_signal.h"
+#include "system_messages.h"
+
+enum signal_type {
+	SIG_U8,
+	SIG_I8,
+	SIG_U16,
+	SIG_I16,
+};
+
+struct signal_layout {
+	uint8_t frame;
+	uint8_t pos;
+	uint8_t type;
+	float scale;
+	float inv_scale;
+	float offset;
+};
+
+// Every signal gets a slot in the layout table.
+enum signal_slot {
+	#define CAN_FRAME(frame)
+	#define CAN_SIGNAL(frame, signal, pos, type, scale, offset) SLOT_##signal,
+	#include "lists/can_frames.inc"
+	#undef CAN_FRAME
+	#undef CAN_SIGNAL
+
+	NB_SIGNALS
+};
+
+static const struct signal_layout layout[NB_SIGNALS] PROGMEM = {
+	#define CAN_FRAME(frame)
+	#define CAN_SIGNAL(frame, signal, pos, type, scale, offset) \
+	[SLOT_##signal] = { frame, pos, SIG_##type, scale, 1.0 / (scale), offset },
+	#include "lists/can_frames.inc"
+	#undef CAN_FRAME
+	#undef CAN_SIGNAL
+};
+
+// Maps a message id to its slot + 1. Zero means the id is not packed.
+static const uint8_t slot_of[END_OF_LIST] PROGMEM = {
+	#define CAN_FRAME(frame)
+	#define CAN_SIGNAL(frame, signal, pos, type, scale, offset) \
+	[signal] = SLOT_##signal + 1,
+	#include "lists/can_frames.inc"
+	#undef CAN_FRAME
+	#undef CAN_SIGNAL
+};
+
+// Catch signals that do not fit inside their frame at compile time.
+#define CAN_FRAME(frame)
+#define CAN_SIGNAL(frame, signal, pos, type, scale, offset) \
+	typedef char signal##_fits[ \
+		((pos) + ((SIG_##type) >= SIG_U16 ? 2 : 1) <= CAN_FRAME_LEN) ? 1 : -1];
+#include "lists/can_frames.inc"
+#undef CAN_FRAME
+#undef CAN_SIGNAL
+
+
+static bool read_layout(enum message_id signal, struct signal_layout *l) {
+	if (signal >= END_OF_LIST) return false;
+	const uint8_t slot = pgm_read_byte(&slot_of[signal]);
+	if (slot == 0) return false;
+	memcpy_P(l, &layout[slot - 1], sizeof(*l));
+	return true;
+}
+
+
+static int32_t round_clamp(float x, int32_t min, int32_t max) {
+	if (x <= min) return min;
+	if (x >= max) return max;
+	return (int32_t)(x < 0 ? x - 0.5f : x + 0.5f);
+}
+
+
+/**
+ * @return The id of the frame that carries signal or END_OF_LIST if the
+ *         signal is sent on its own id.
+ */
+enum message_id can_signal_frame(enum message_id signal) {
+	struct signal_layout l;
+	return read_layout(signal, &l) ? (enum message_id)l.frame : END_OF_LIST;
+}
+
+
+/**
+ * Scales value and stores it in the data of the frame that carries signal.
+ * Values outside the range of the signal saturate.
+ * @param  data   The CAN_FRAME_LEN byte data field of the frame.
+ * @return        false if the signal is not part of any frame.
+ */
+bool can_signal_pack(uint8_t *data, enum message_id signal, float value) {
+	struct signal_layout l;
+	if (!read_layout(signal, &l)) return false;
+
+	const float x = (value - l.offset) * l.inv_scale;
+	int32_t raw;
+	switch (l.type) {
+	case SIG_U8:  raw = round_clamp(x, 0, UINT8_MAX); break;
+	case SIG_I8:  raw = round_clamp(x, INT8_MIN, INT8_MAX); break;
+	case SIG_U16: raw = round_clamp(x, 0, UINT16_MAX); break;
+	case SIG_I16: raw = round_clamp(x, INT16_MIN, INT16_MAX); break;
+	default: return false;
+	}
+
+	data[l.pos] = raw & 0xFF;
+	if (l.type >= SIG_U16) {
+		data[l.pos + 1] = (raw >> 8) & 0xFF;
+	}
+	return true;
+}
+
+
+/**
+ * Extracts signal from a received frame.
+ * @return false if msg is not the frame that carries signal.
+ */
+bool can_signal_unpack(const struct can_message *msg, enum message_id signal,
+                       float *value) {
+	struct signal_layout l;
+	if (!read_layout(signal, &l) || msg->id != l.frame) return false;
+
+	const uint8_t *d = &msg->data[l.pos];
+	int32_t raw;
+	switch (l.type) {
+	case SIG_U8:  raw = d[0]; break;
+	case SIG_I8:  raw = (int8_t)d[0]; break;
+	case SIG_U16: raw = (uint16_t)(d[0] | (d[1] << 8)); break;
+	case SIG_I16: raw = (int16_t)(d[0] | (d[1] << 8)); break;
+	default: return false;
+	}
+
+	*value = raw * l.scale + l.offset;
+	return true;
+}
+
+
+/**
+ * Extracts every signal carried by a received frame.
+ * @param  signals Filled with the id of each signal, at most CAN_FRAME_LEN.
+ * @param  values  Filled with the value of each signal.
+ * @return         The number of signals extracted.
+ */
+uint8_t can_signal_unpack_frame(const struct can_message *msg,
+                                enum message_id *signals, float *values) {
+	uint8_t n = 0;
+
+	#define CAN_FRAME(frame)
+	#define CAN_SIGNAL(frame, signal, pos, type, scale, offset) \
+	if (msg->id == frame && can_signal_unpack(msg, signal, &values[n])) { \
+		signals[n++] = signal; \
+	}
+	#include "lists/can_frames.inc"
+	#undef CAN_FRAME
+	#undef CAN_SIGNAL
+
+	return n;
+}
@@ -0,0 +1,53 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 UnicornRaceEngineering
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+* @file can_signal.h
+* @brief
+*   Packs several scaled integer signals into a single CAN frame.
+*
+*   The frames and the position, type and scaling of every signal in them are
+*   declared in "lists/can_frames.inc". A signal that is part of a frame is
+*   never sent on its own id, instead the frame is filled with
+*   can_signal_pack() and sent with can_broadcast() on the frame id.
+*/
+
+#ifndef CAN_SIGNAL_H
+#define CAN_SIGNAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "can.h"
+#include "system_messages.h"
+
+#define CAN_FRAME_LEN	( 8 )
+
+enum message_id can_signal_frame(enum message_id signal);
+bool can_signal_pack(uint8_t *data, enum message_id signal, float value);
+bool can_signal_unpack(const struct can_message *msg, enum message_id signal,
+                       float *value);
+uint8_t can_signal_unpack_frame(const struct can_message *msg,
+                                enum message_id *signals, float *values);
+
+#endif /* CAN_SIGNAL_H */
@@ -26,7 +26,9 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define EEPROM_H
 
 
+#include <avr/interrupt.h>
 #include <avr/io.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -38,10 +40,21 @@ inline void EEPROM_write (uintptr_t address, uint8_t data)
 	/* Set up address and data registers */
 	EEAR = address;
 	EEDR = data;
+	/* EEWE must be set within four cycles of EEMWE, so no interrupts between */
+	const uint8_t sreg = SREG;
+	cli();
 	/* Write logical one to EEMWE */
 	EECR |= (1<<EEMWE);
 	/* Start eeprom write by setting EEWE */
 	EECR |= (1<<EEWE);
+	SREG = sreg;
+}
+
+
+/* True when a write can start without waiting for the previous one */
+inline bool EEPROM_ready(void)
+{
+	return !(EECR & (1<<EEWE));
 }
 
 
@@ -0,0 +1,255 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 UnicornRaceEngineering
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file fixed.c
+ * Fixed point arithmetic, see fixed.h.
+ *
+ * The AVR multiplies 8 by 8 bits in hardware, and gcc builds 16 by 16 to 32 bit
+ * multiplies from it cheaply. Products are therefore made from 16 bit halves
+ * instead of with 64 bit integers, which avr-libgcc only has slow generic
+ * routines for.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fixed.h"
+
+#define LN_2	Q16(0.69314718056)
+
+
+/**
+ * Multiplies and rounds a * b / 2^shift, saturated to the range of q16_t.
+ * Inlined so shift is a constant at every use.
+ */
+static inline q16_t mul_shift(int32_t a, int32_t b, const uint8_t shift) {
+	const bool negative = (a < 0) != (b < 0);
+	const uint32_t ua = (a < 0) ? -(uint32_t)a : (uint32_t)a;
+	const uint32_t ub = (b < 0) ? -(uint32_t)b : (uint32_t)b;
+
+	const uint16_t ah = ua >> 16, al = ua;
+	const uint16_t bh = ub >> 16, bl = ub;
+
+	// The 64 bit product as hi:lo
+	uint32_t hi = (uint32_t)ah * bh;
+	uint32_t lo = (uint32_t)al * bl;
+	const uint32_t mid1 = (uint32_t)ah * bl;
+	const uint32_t mid2 = (uint32_t)al * bh;
+	const uint32_t mid = mid1 + mid2;
+	if (mid < mid1) {
+		hi += (uint32_t)1 << 16;
+	}
+	hi += mid >> 16;
+	const uint32_t mid_lo = mid << 16;
+	lo += mid_lo;
+	if (lo < mid_lo) {
+		++hi;
+	}
+
+	const uint32_t half = (uint32_t)1 << (shift - 1);
+	lo += half;
+	if (lo < half) {
+		++hi;
+	}
+
+	const uint32_t limit = negative ? (uint32_t)1 << 31 : INT32_MAX;
+	if ((hi >> shift) != 0) {
+		return negative ? Q16_MIN : Q16_MAX;
+	}
+	const uint32_t result = (lo >> shift) | (hi << (32 - shift));
+	if (result > limit) {
+		return negative ? Q16_MIN : Q16_MAX;
+	}
+	return negative ? (q16_t)-result : (q16_t)result;
+}
+
+
+/**
+ * @return a * b
+ */
+q16_t q16_mul(q16_t a, q16_t b) {
+	return mul_shift(a, b, 16);
+}
+
+
+/**
+ * @return x * gain
+ */
+q16_t q16_scale(q16_t x, q24_t gain) {
+	return mul_shift(x, gain, 24);
+}
+
+
+/**
+ * @return raw * map->gain + map->offset, which is the value / 2^map->shift
+ */
+q16_t q16_map(int32_t raw, const struct q16_map *map) {
+	return q16_add(mul_shift(raw, map->gain, 8), map->offset);
+}
+
+
+/**
+ * Divides by shifting and subtracting, one quotient bit at a time.
+ * @return a / b rounded to nearest, or the limit of the sign of a if b is 0.
+ */
+q16_t q16_div(q16_t a, q16_t b) {
+	if (b == 0) {
+		return (a < 0) ? Q16_MIN : Q16_MAX;
+	}
+
+	const bool negative = (a < 0) != (b < 0);
+	uint32_t remainder = (a < 0) ? -(uint32_t)a : (uint32_t)a;
+	uint32_t divider = (b < 0) ? -(uint32_t)b : (uint32_t)b;
+	uint32_t quotient = 0;
+	uint32_t bit = (uint32_t)1 << 16;
+
+	// Scale the divider up to the remainder. The quotient overflows if bit
+	// is shifted out.
+	while (divider < remainder) {
+		divider <<= 1;
+		bit <<= 1;
+	}
+	if (bit == 0) {
+		return negative ? Q16_MIN : Q16_MAX;
+	}
+
+	// Take the first step by hand so remainder can be shifted without overflow
+	if (divider & ((uint32_t)1 << 31)) {
+		if (remainder >= divider) {
+			quotient |= bit;
+			remainder -= divider;
+		}
+		divider >>= 1;
+		bit >>= 1;
+	}
+
+	while (bit != 0 && remainder != 0) {
+		if (remainder >= divider) {
+			quotient |= bit;
+			remainder -= divider;
+		}
+		remainder <<= 1;
+		bit >>= 1;
+	}
+
+	if (remainder >= divider) {
+		++quotient;
+	}
+
+	if (quotient > (negative ? (uint32_t)1 << 31 : (uint32_t)INT32_MAX)) {
+		return negative ? Q16_MIN : Q16_MAX;
+	}
+	return negative ? (q16_t)-quotient : (q16_t)quotient;
+}
+
+
+/**
+ * Logarithm base 2 by repeated squaring of the mantissa, one bit of the
+ * fraction per squaring.
+ * @return log2(x), or Q16_MIN if x <= 0.
+ */
+q16_t q16_log2(q16_t x) {
+	if (x <= 0) {
+		return Q16_MIN;
+	}
+
+	uint32_t m = x;
+	q16_t result = 0;
+
+	// Normalize m to [1, 2)
+	while (m >= 2 * (uint32_t)Q16_ONE) {
+		result += Q16_ONE;
+		m >>= 1;
+	}
+	while (m < (uint32_t)Q16_ONE) {
+		result -= Q16_ONE;
+		m <<= 1;
+	}
+
+	for (uint32_t bit = Q16_ONE >> 1; bit != 0; bit >>= 1) {
+		m = mul_shift(m, m, 16);
+		if (m >= 2 * (uint32_t)Q16_ONE) {
+			m >>= 1;
+			result += bit;
+		}
+	}
+	return result;
+}
+
+
+/**
+ * @return ln(x), or Q16_MIN if x <= 0.
+ */
+q16_t q16_ln(q16_t x) {
+	if (x <= 0) {
+		return Q16_MIN;
+	}
+	return q16_mul(q16_log2(x), LN_2);
+}
+
+
+/**
+ * Formats x as a decimal number without printf() float support.
+ * @param buf Room for at least 8 + decimals characters.
+ * @param decimals Number of digits after the decimal point, at most 4.
+ * @return buf
+ */
+char* q16_to_str(q16_t x, char *buf, uint8_t decimals) {
+	uint32_t u = (x < 0) ? -(uint32_t)x : (uint32_t)x;
+	char *p = buf;
+
+	// Round at the last digit printed
+	uint32_t half = Q16_ONE / 2;
+	for (uint8_t i = 0; i < decimals; ++i) {
+		half /= 10;
+	}
+	u += half;
+
+	if (x < 0) {
+		*p++ = '-';
+	}
+
+	char digits[5];
+	uint8_t n = 0;
+	uint16_t integer = u >> 16;
+	do {
+		digits[n++] = '0' + integer % 10;
+		integer /= 10;
+	} while (integer != 0);
+	while (n != 0) {
+		*p++ = digits[--n];
+	}
+
+	if (decimals != 0) {
+		*p++ = '.';
+		uint32_t fraction = u & 0xFFFF;
+		while (decimals--) {
+			fraction *= 10;
+			*p++ = '0' + (fraction >> 16);
+			fraction &= 0xFFFF;
+		}
+	}
+	*p = '\0';
+	return buf;
+}
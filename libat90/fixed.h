@@ -0,0 +1,146 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 UnicornRaceEngineering
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file fixed.h
+ * Fixed point arithmetic for sensor conversions, so the nodes do not need soft
+ * float for scaling, offsets and the like.
+ *
+ * Values are q16_t, Q16.16 with a range of +-32768 and a resolution of 1/65536.
+ * Gains are q24_t, Q8.24 with a range of +-128, which keeps small conversion
+ * factors like 1/16384 precise. All operations saturate instead of wrapping.
+ *
+ * Constants are made at compile time with Q16() and Q24(), e.g.
+ *   static const struct q16_map rpm = Q16_MAP_RANGE(0.9408, 0, 0.9408 * 65535);
+ *   float v = q16_map_to_float(q16_map(raw, &rpm), &rpm);
+ */
+
+#ifndef FIXED_H
+#define FIXED_H
+
+#include <stdint.h>
+
+typedef int32_t q16_t; //!< Q16.16
+typedef int32_t q24_t; //!< Q8.24
+
+#define Q16_ONE	((q16_t)1 << 16)
+#define Q16_MAX	INT32_MAX
+#define Q16_MIN	INT32_MIN
+
+#define Q_ROUND(x)	(((x) >= 0) ? 0.5 : -0.5)
+#define Q16(x)		((q16_t)((x) * 65536.0 + Q_ROUND(x))) //!< Constant to Q16.16
+#define Q24(x)		((q24_t)((x) * 16777216.0 + Q_ROUND(x))) //!< Constant to Q8.24
+
+/**
+ * A linear map from raw sensor counts to a physical value,
+ * raw * gain + offset.
+ *
+ * Values beyond +-32768 are mapped pre-shifted: gain and offset are stored
+ * divided by 2^shift, so q16_map() gives the value / 2^shift, in effect a
+ * Q(16+shift).(16-shift) value. The gain keeps 24 significant bits, like a
+ * float.
+ */
+struct q16_map {
+	q24_t gain;
+	q16_t offset;
+	uint8_t shift;
+};
+
+#define Q16_MAP_SHIFTED(gain, offset, shift) \
+	{Q24((gain) / (double)(1L << (shift))), Q16((offset) / (double)(1L << (shift))), (shift)}
+#define Q16_MAP(gain, offset)	Q16_MAP_SHIFTED(gain, offset, 0)
+
+/** The least shift of a map whose values reach +-max, up to 8 */
+#define Q16_SHIFT_FOR(max) \
+	(((max) < 32767.0) ? 0 : ((max) < 65535.0) ? 1 : ((max) < 131071.0) ? 2 : \
+	 ((max) < 262143.0) ? 3 : ((max) < 524287.0) ? 4 : ((max) < 1048575.0) ? 5 : \
+	 ((max) < 2097151.0) ? 6 : ((max) < 4194303.0) ? 7 : 8)
+
+/** A map for values up to +-max, pre-shifted only as far as max needs */
+#define Q16_MAP_RANGE(gain, offset, max) \
+	Q16_MAP_SHIFTED(gain, offset, Q16_SHIFT_FOR(max))
+
+
+static inline q16_t q16_from_int(int16_t i) {
+	return (q16_t)i * Q16_ONE;
+}
+
+/**
+ * @return x rounded to the nearest integer.
+ */
+static inline int16_t q16_to_int(q16_t x) {
+	return (x >= Q16(32767.5)) ? INT16_MAX : (int16_t)((x + Q16_ONE / 2) >> 16);
+}
+
+static inline float q16_to_float(q16_t x) {
+	return x * (1.0f / Q16_ONE);
+}
+
+/**
+ * @return The value x from q16_map() stands for, shifted back by the map.
+ */
+static inline float q16_map_to_float(q16_t x, const struct q16_map *map) {
+	const float f = q16_to_float(x);
+	return map->shift ? f * (float)(1L << map->shift) : f;
+}
+
+static inline q16_t q16_add(q16_t a, q16_t b) {
+	const q16_t sum = (q16_t)((uint32_t)a + (uint32_t)b);
+	// Overflow if both have the same sign and the sum has another
+	if (!((a ^ b) & INT32_MIN) && ((a ^ sum) & INT32_MIN)) {
+		return (a < 0) ? Q16_MIN : Q16_MAX;
+	}
+	return sum;
+}
+
+static inline q16_t q16_sub(q16_t a, q16_t b) {
+	const q16_t diff = (q16_t)((uint32_t)a - (uint32_t)b);
+	if (((a ^ b) & INT32_MIN) && ((a ^ diff) & INT32_MIN)) {
+		return (a < 0) ? Q16_MIN : Q16_MAX;
+	}
+	return diff;
+}
+
+q16_t q16_mul(q16_t a, q16_t b);
+q16_t q16_scale(q16_t x, q24_t gain);
+q16_t q16_map(int32_t raw, const struct q16_map *map);
+q16_t q16_div(q16_t a, q16_t b);
+q16_t q16_log2(q16_t x);
+q16_t q16_ln(q16_t x);
+char* q16_to_str(q16_t x, char *buf, uint8_t decimals);
+
+/**
+ * @return acc + a * b
+ */
+static inline q16_t q16_mac(q16_t acc, q16_t a, q16_t b) {
+	return q16_add(acc, q16_mul(a, b));
+}
+
+/**
+ * @return 1 / x
+ */
+static inline q16_t q16_recip(q16_t x) {
+	return q16_div(Q16_ONE, x);
+}
+
+#endif /* FIXED_H */
@@ -24,44 +24,43 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 /**
  * @file ringbuffer.h
  * @brief
- * 	A simple always keep one slop open ring buffer of size RB_BUFFER_SIZE. The
- * 	buffer size is determined at compile time on a per module basis. That is a.c
- * 	can use a size of 64 but c.c cannot have both a 32 and 64 length buffer. The
- *  buffer size can be altered by defining RB_BUFFER_SIZE as the desired buffer
- *  size before including ringbuffer.h The default value for RB_BUFFER_SIZE is
- *  32
+ * 	Ring buffers that always keep one slot open.
  *
- * 	The datatype of the buffer is uint8_t by default but this can also be
- * 	overridden by defining RB_DATA_t to another type before including
- * 	ringbuffer.h
+ * 	ringbuffer_t works on a byte buffer given at run time, whose size must be a
+ * 	power of 2 no larger than 256. The indices and the mask are single bytes
+ * 	so the push and pop in an ISR never do 16 bit loads.
  *
- * 	The buffer size is recommended to a power of 2 value as this allows for
- * 	faster calculating the next index values. However non power of 2 values can
- * 	be used.
+ * 	RB_DEFINE() generates a ring buffer type of any element type where the size
+ * 	is a compile time constant, so the mask folds into the instructions. It
+ * 	comes with bulk read and write functions that copy in at most two memcpy
+ * 	calls.
  */
 
 #ifndef RINGBUFFER_H
 #define RINGBUFFER_H
 
+#include <stdbool.h>
 #include <stddef.h>  // for size_t
 #include <stdint.h>  // for uint8_t
-#include <string.h>  // for memset
+#include <string.h>  // for memset, memcpy
 
 #include "utils.h"   // for IS_POW2
 
-// #define RB_BUFFER_MASK	(RB_BUFFER_SIZE-1)
-#define RB_BUFFER_MASK(B)	((B)->size-1)
+#define RB_BUFFER_MASK(B)	((B)->mask)
+
+//!< Keep the compiler from moving buffer accesses across an index update.
+#define RB_MEMORY_BARRIER()	__asm__ __volatile__ ("" ::: "memory")
 
 typedef struct ringbuffer_t{
 	uint8_t *buffer; //!< Pointer to the actual buffer
-	size_t start; //!< Index of the start of valid data in the buffer
-	size_t end; //!< Index of the end of valid data in the buffer
-	size_t size; //!< Size of the buffer @note muster be pow2 value
+	uint8_t start; //!< Index of the start of valid data in the buffer
+	uint8_t end; //!< Index of the end of valid data in the buffer
+	uint8_t mask; //!< Size of the buffer minus 1 @note size must be pow2 value
 } ringbuffer_t;
 
 
-#define rb_nextStart(B)		(((B)->start+1) & RB_BUFFER_MASK((B)))
-#define rb_nextEnd(B)		(((B)->end+1) & RB_BUFFER_MASK((B)))
+#define rb_nextStart(B)		((uint8_t)((B)->start+1) & RB_BUFFER_MASK((B)))
+#define rb_nextEnd(B)		((uint8_t)((B)->end+1) & RB_BUFFER_MASK((B)))
 
 /**
  * Check if the ring buffer is empty.
@@ -84,22 +83,23 @@ typedef struct ringbuffer_t{
  * @param  B pointer to the ringbuffer_t
  * @return   size_t bytes
  */
-#define rb_bytesUsed(B)			(((B)->end - (B)->start) + (-((int)((B)->end < (B)->start)) & (B)->size))
+#define rb_bytesUsed(B)			((size_t)((uint8_t)((B)->end - (B)->start) & RB_BUFFER_MASK((B))))
 
 
 /**
  * @brief
  * Initializes the ring buffer to it's initial values and zero the buffer.
  * @param buffer The buffer to initialize
+ * @return -1 if size is not a power of 2 no larger than 256
  */
 static inline int rb_init(ringbuffer_t* const rb, uint8_t *buf, size_t size){
-	if (!IS_POW2(size)) return -1;
+	if (!IS_POW2(size) || size > 256) return -1;
 
 	rb->buffer = buf;
-	rb->size = size;
+	rb->mask = (uint8_t)(size - 1);
 
 	rb->end = rb->start = 0;
-	memset(rb->buffer, 0, sizeof(rb->size));
+	memset(rb->buffer, 0, size);
 
 	return 0;
 }
@@ -110,7 +110,6 @@ static inline int rb_init(ringbuffer_t* const rb, uint8_t *buf, size_t size){
  * should check if the buffer is full using the rb_isFull() call.
  * @param  buffer The ring buffer
  * @param  data   The data point that is added to buffer
- * @return        1 on overflow error and 0 on success
  */
 static inline void rb_push(ringbuffer_t *rb, uint8_t data) {
 	rb->buffer[rb->end] = data;
@@ -125,7 +124,7 @@ static inline void rb_push(ringbuffer_t *rb, uint8_t data) {
  * Get a byte from ring buffer.
  * @param  buffer The ring buffer
  * @param  data   pointer where returned byte is stored
- * @return        1 if no data is available and 0 on success
+ * @return        -1 if no data is available and 0 on success
  */
 static inline int rb_pop(ringbuffer_t *rb, uint8_t *data) {
 	if (rb_isEmpty(rb)) return -1; // No data available
@@ -137,24 +136,226 @@ static inline int rb_pop(ringbuffer_t *rb, uint8_t *data) {
 }
 
 static inline unsigned rb_left(ringbuffer_t *rb) {
-	return ((rb->start > rb->end) ? (rb->start - rb->end) : (rb->size - (rb->end - rb->start))) - 1;
+	return RB_BUFFER_MASK(rb) - rb_bytesUsed(rb);
 }
 
 /**
  * @brief
- * Get the next byte in the ring buffer without removing it from the buffer.
- * This will work the same as rb_pop except, successive calls to rb_peek will
- * return the same byte.
+ * Get a byte in the ring buffer without removing it from the buffer.
+ * rb_peek(rb, 0, &data) gives the byte rb_pop would return.
  * @param  buffer The ring buffer
+ * @param  index  Position of the byte counted from the oldest
  * @param  data   pointer where returned byte is stored
- * @return        1 if no data is available and 0 on success
+ * @return        -1 if there is no byte at index and 0 on success
  */
 static inline int rb_peek(ringbuffer_t *rb, size_t index, uint8_t *data) {
-	if (rb_isEmpty(rb)) return -1; // No data available
+	if (index >= rb_bytesUsed(rb)) return -1; // No data available
 
-	// *data = rb->buffer[rb->start];
-	*data = (rb->start + index) & RB_BUFFER_MASK(rb);
+	*data = rb->buffer[(rb->start + index) & RB_BUFFER_MASK(rb)];
 	return 0; // Success
 }
 
+
+/**
+ * @name Spans
+ * Let a parser run directly over the buffer memory and a producer format
+ * straight into the free space. A span never wraps, so data that wraps around
+ * the end of the buffer is handed out as two spans in two rounds.
+ *
+ * 	uint8_t *p;
+ * 	size_t len;
+ * 	rb_read_span(rb, &p, &len);
+ * 	rb_commit(rb, parse(p, len));
+ *
+ * The reader must be the only one moving start and the writer the only one
+ * moving end, so rb_push() must not overwrite old data while a read span is
+ * in use. Check rb_isFull() before pushing.
+ * @{
+ */
+
+/**
+ * Get the longest run of unread bytes that does not wrap.
+ * @param ptr Set to the oldest byte
+ * @param len Set to the number of bytes at ptr. 0 if the buffer is empty
+ */
+static inline void rb_read_span(ringbuffer_t *rb, uint8_t **ptr, size_t *len) {
+	const uint8_t start = rb->start;
+	const uint8_t end = rb->end;
+	*ptr = &rb->buffer[start];
+	*len = (end >= start) ? (size_t)(end - start)
+	                      : (size_t)RB_BUFFER_MASK(rb) + 1 - start;
+}
+
+/**
+ * Release n bytes of the span from rb_read_span() back to the writer.
+ */
+static inline void rb_commit(ringbuffer_t *rb, size_t n) {
+	RB_MEMORY_BARRIER();
+	rb->start = (uint8_t)(rb->start + n) & RB_BUFFER_MASK(rb);
+}
+
+/**
+ * Get the longest run of free bytes that does not wrap.
+ * @param ptr Set to the first free byte
+ * @param len Set to the number of bytes at ptr. 0 if the buffer is full
+ */
+static inline void rb_write_span(ringbuffer_t *rb, uint8_t **ptr, size_t *len) {
+	const uint8_t start = rb->start;
+	const uint8_t end = rb->end;
+	*ptr = &rb->buffer[end];
+	if (start > end) {
+		*len = start - end - 1;
+	} else {
+		*len = (size_t)RB_BUFFER_MASK(rb) + 1 - end - (start == 0);
+	}
+}
+
+/**
+ * Hand n bytes written into the span from rb_write_span() to the reader.
+ */
+static inline void rb_write_commit(ringbuffer_t *rb, size_t n) {
+	RB_MEMORY_BARRIER();
+	rb->end = (uint8_t)(rb->end + n) & RB_BUFFER_MASK(rb);
+}
+//!< @}
+
+
+/**
+ * @name Typed ring buffers
+ * RB_DEFINE(name, type, size) defines struct name holding up to size - 1
+ * elements of type together with these functions:
+ *
+ * 	void     name_init(struct name *rb);
+ * 	uint8_t  name_used(const struct name *rb);
+ * 	uint8_t  name_free(const struct name *rb);
+ * 	bool     name_is_empty(const struct name *rb);
+ * 	bool     name_is_full(const struct name *rb);
+ * 	bool     name_push(struct name *rb, type v);        // false if full
+ * 	bool     name_pop(struct name *rb, type *v);        // false if empty
+ * 	bool     name_peek(const struct name *rb, uint8_t i, type *v);
+ * 	uint8_t  name_write(struct name *rb, const type *src, uint8_t n);
+ * 	uint8_t  name_read(struct name *rb, type *dst, uint8_t n);
+ * 	uint8_t  name_read_span(struct name *rb, type **ptr);
+ * 	void     name_commit(struct name *rb, uint8_t n);
+ * 	uint8_t  name_write_span(struct name *rb, type **ptr);
+ * 	void     name_write_commit(struct name *rb, uint8_t n);
+ *
+ * The size must be a power of 2 no larger than 256. RB_DEFINE_INDEXED() takes
+ * the index type as well, for larger buffers.
+ *
+ * Unlike rb_push(), name_push() never overwrites old data. The producer only
+ * writes head and the consumer only writes tail, so with single byte indices
+ * one side can be an ISR without either of them masking interrupts.
+ * @{
+ */
+#define RB_DEFINE(name, type, size)	RB_DEFINE_INDEXED(name, type, size, uint8_t)
+
+#define RB_DEFINE_INDEXED(name, type, size, index_t) \
+typedef char name##_size_check[(IS_POW2(size) && \
+                                (size) - 1 <= (index_t)~(index_t)0) ? 1 : -1]; \
+\
+struct name { \
+	type buf[size]; \
+	volatile index_t head; /* Next slot to write. Only written by the producer */ \
+	volatile index_t tail; /* Next slot to read. Only written by the consumer */ \
+}; \
+\
+static inline void name##_init(struct name *rb) { \
+	rb->head = rb->tail = 0; \
+} \
+\
+static inline index_t name##_used(const struct name *rb) { \
+	return (index_t)(rb->head - rb->tail) & ((size) - 1); \
+} \
+\
+static inline index_t name##_free(const struct name *rb) { \
+	return (size) - 1 - name##_used(rb); \
+} \
+\
+static inline bool name##_is_empty(const struct name *rb) { \
+	return rb->head == rb->tail; \
+} \
+\
+static inline bool name##_is_full(const struct name *rb) { \
+	return (index_t)((rb->head + 1) & ((size) - 1)) == rb->tail; \
+} \
+\
+static inline bool name##_push(struct name *rb, type v) { \
+	const index_t head = rb->head; \
+	const index_t next = (head + 1) & ((size) - 1); \
+	if (next == rb->tail) return false; \
+	rb->buf[head] = v; \
+	RB_MEMORY_BARRIER(); \
+	rb->head = next; \
+	return true; \
+} \
+\
+static inline bool name##_pop(struct name *rb, type *v) { \
+	const index_t tail = rb->tail; \
+	if (tail == rb->head) return false; \
+	*v = rb->buf[tail]; \
+	RB_MEMORY_BARRIER(); \
+	rb->tail = (tail + 1) & ((size) - 1); \
+	return true; \
+} \
+\
+static inline bool name##_peek(const struct name *rb, index_t i, type *v) { \
+	if (i >= name##_used(rb)) return false; \
+	*v = rb->buf[(rb->tail + i) & ((size) - 1)]; \
+	return true; \
+} \
+\
+/* Writes up to n elements, as many as there is room for. */ \
+static inline index_t name##_write(struct name *rb, const type *src, index_t n) { \
+	const index_t room = name##_free(rb); \
+	if (n > room) n = room; \
+	const index_t head = rb->head; \
+	const index_t first = ((size) - head < n) ? (size) - head : n; \
+	memcpy(&rb->buf[head], src, first * sizeof(type)); \
+	memcpy(&rb->buf[0], src + first, (n - first) * sizeof(type)); \
+	RB_MEMORY_BARRIER(); \
+	rb->head = (head + n) & ((size) - 1); \
+	return n; \
+} \
+\
+/* Reads up to n elements, as many as there are. */ \
+static inline index_t name##_read(struct name *rb, type *dst, index_t n) { \
+	const index_t used = name##_used(rb); \
+	if (n > used) n = used; \
+	const index_t tail = rb->tail; \
+	const index_t first = ((size) - tail < n) ? (size) - tail : n; \
+	memcpy(dst, &rb->buf[tail], first * sizeof(type)); \
+	memcpy(dst + first, &rb->buf[0], (n - first) * sizeof(type)); \
+	RB_MEMORY_BARRIER(); \
+	rb->tail = (tail + n) & ((size) - 1); \
+	return n; \
+} \
+\
+/* Unread elements from tail up to head or the end of buf. */ \
+static inline index_t name##_read_span(struct name *rb, type **ptr) { \
+	const index_t head = rb->head; \
+	const index_t tail = rb->tail; \
+	*ptr = &rb->buf[tail]; \
+	return (head >= tail) ? head - tail : (size) - tail; \
+} \
+\
+static inline void name##_commit(struct name *rb, index_t n) { \
+	RB_MEMORY_BARRIER(); \
+	rb->tail = (rb->tail + n) & ((size) - 1); \
+} \
+\
+/* Free slots from head up to tail or the end of buf. */ \
+static inline index_t name##_write_span(struct name *rb, type **ptr) { \
+	const index_t head = rb->head; \
+	const index_t tail = rb->tail; \
+	*ptr = &rb->buf[head]; \
+	return (tail > head) ? tail - head - 1 : (size) - head - (tail == 0); \
+} \
+\
+static inline void name##_write_commit(struct name *rb, index_t n) { \
+	RB_MEMORY_BARRIER(); \
+	rb->head = (rb->head + n) & ((size) - 1); \
+}
+//!< @}
+
 #endif /* RINGBUFFER_H */
@@ -34,6 +34,15 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <stdint.h>  // for uint32_t
 #include <util/atomic.h>
 
+#include "sysclock.h"
+#include "utils.h"   // for BIT_CHECK
+
+#define SYSCLOCK_TOP	( 11059 ) //!< Timer 3 counts from 0 to SYSCLOCK_TOP every millisecond
+
+//!< Microseconds per timer 3 count in Q16, so get_us() multiplies and shifts
+//!< instead of dividing. It is off by less than 0.1 us at the top.
+#define SYSCLOCK_US_Q16	( ((1000UL << 16) + (SYSCLOCK_TOP + 1) / 2) / (SYSCLOCK_TOP + 1) )
+
 
 static volatile uint32_t tick;
 
@@ -51,7 +60,7 @@ void sysclock_init(void) {
 
 	// Output Compare Register A to 11059
 	// equal to 1ms
-	OCR3A = 11059;
+	OCR3A = SYSCLOCK_TOP;
 
 	// Set counter value to 0
 	TCNT3L = 0;
@@ -62,6 +71,14 @@ void sysclock_init(void) {
 }
 
 
+/**
+ * @return true once sysclock_init() has started the timer.
+ */
+bool sysclock_running(void) {
+	return BIT_CHECK(TIMSK3, OCIE3A);
+}
+
+
 /**
  * Atommically reads the milliseconds counted since clock init.
  * @preturn numbers of counted milliseconds since clock init.
@@ -74,6 +91,24 @@ uint32_t get_tick(void) {
 	return read_tick;
 }
 
+/**
+ * Microseconds since sysclock_init(), interpolated from the timer 3 counter.
+ * @note wraps around after about 71 minutes, so only use it for differences.
+ */
+uint32_t get_us(void) {
+	uint32_t ms;
+	uint16_t count;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		ms = tick;
+		count = TCNT3;
+		// The counter has wrapped but the tick has not been counted yet
+		if (BIT_CHECK(TIFR3, OCF3A) && count < (SYSCLOCK_TOP / 2)) {
+			++ms;
+		}
+	}
+	return ms * 1000 + (((uint32_t)count * SYSCLOCK_US_Q16) >> 16);
+}
+
 ISR(TIMER3_COMPA_vect) {
 	++tick;
 }
@@ -31,10 +31,13 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #ifndef SYSCLOCK_H
 #define SYSCLOCK_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 
 void sysclock_init(void);
+bool sysclock_running(void);
 uint32_t get_tick(void);
+uint32_t get_us(void);
 
 #endif /* SYSCLOCK_H */
\ No newline at end of file
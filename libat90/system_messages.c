@@ -26,73 +26,66 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  * Contains the actual CAN message type information.
  */
 
+#include <avr/pgmspace.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 
 #include "system_messages.h"
 
+#define MSG_BITSET_BYTES	((END_OF_LIST + 7) / 8)
+#define MEDIUM_COUNT		3 //!< Bits in enum medium
 
-struct message_detail message_info[END_OF_LIST] = {
-	[ECU_EMPTY]                    = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_FUEL_PRESSURE]            = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_STATUS_LAP_COUNT]         = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_STATUS_INJ_SUM]           = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_LAST_GEAR_SHIFT]          = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_MOTOR_OILTEMP]            = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_OIL_PRESSURE]             = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_STATUS_TIME]              = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_STATUS_LAP_TIME]          = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_GEAR_OIL_TEMP]            = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_STATUS_TRACTION]          = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_STATUS_GAS]               = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_STATUS_LAMBDA_V2]         = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_STATUS_CAM_TRIG_P1]       = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_STATUS_CAM_TRIG_P2]       = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_STATUS_CHOKER_ADD]        = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_STATUS_LAMBDA_PWM]        = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_WATER_TEMP]               = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_MANIFOLD_AIR_TEMP]        = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_SPEEDER_POTMETER]         = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_RPM]                      = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_TRIGGER_ERR]              = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_CAM_ANGLE1]               = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_CAM_ANGLE2]               = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_ROAD_SPEED]               = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_MAP_SENSOR]               = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_BATTERY_V]                = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_LAMBDA_V]                 = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_LOAD]                     = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_INJECTOR_TIME]            = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_IGNITION_TIME]            = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_DWELL_TIME]               = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_GX]                       = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_GY]                       = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_GZ]                       = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_MOTOR_FLAGS]              = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_OUT_BITS]                 = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[ECU_TIME]                     = { .subscribed = false,    .len = 4,    .transport = 0 },
-
-	[GPS_DATA]                     = { .subscribed = false,    .len = 8,    .transport = 0 },
-	[PADDLE_STATUS]                = { .subscribed = false,    .len = 1,    .transport = 0 },
-	[FRONT_RIGHT_WHEEL_SPEED]      = { .subscribed = false,    .len = 4,    .transport = 0 },
-	[FRONT_LEFT_WHEEL_SPEED]       = { .subscribed = false,    .len = 4,    .transport = 0 },
-
-	[HEARTBEAT]                    = { .subscribed = false,    .len = 1,    .transport = 0 },
-	[NODE_STATUS]                  = { .subscribed = false,    .len = 2,    .transport = 0 },
-	[CURRENT_GEAR]                 = { .subscribed = false,    .len = 1,    .transport = 0 },
-	[NEUTRAL_ENABLED]              = { .subscribed = false,    .len = 1,    .transport = 0 },
-	[SYSTIME]                      = { .subscribed = false,    .len = 4,    .transport = 0 },
+// The message_id must fit below the priority class in the CAN identifier
+typedef char msg_id_check[(END_OF_LIST <= (1 << MSG_CAN_ID_BITS)) ? 1 : -1];
+
+#define MSG_BYTE(id)	((uint8_t)(id) / 8)
+#define MSG_BIT(id)	(1 << ((uint8_t)(id) % 8))
+
+
+#define MESSAGE(id, prio, len, type, scale, transport, name) \
+	static const char name_##id[] PROGMEM = name;
+#include "lists/messages.inc"
+#undef MESSAGE
+
+#define CAN_FRAME(frame) \
+	static const char name_##frame[] PROGMEM = #frame;
+#define CAN_SIGNAL(frame, signal, pos, type, scale, offset)
+#include "lists/can_frames.inc"
+#undef CAN_FRAME
+#undef CAN_SIGNAL
+
+static const struct message_detail message_info[END_OF_LIST] PROGMEM = {
+	#define MESSAGE(id, prio, len, type, scale, transport, name) \
+	[id] = { PRIO_##prio, len, MSG_##type, transport, scale, name_##id },
+	#include "lists/messages.inc"
+	#undef MESSAGE
+
+	#define CAN_FRAME(frame) \
+	[frame] = { PRIO_TELEMETRY, 8, MSG_RAW, 0, 1.0, name_##frame },
+	#define CAN_SIGNAL(frame, signal, pos, type, scale, offset)
+	#include "lists/can_frames.inc"
+	#undef CAN_FRAME
+	#undef CAN_SIGNAL
 };
 
+static uint8_t subscribed[MSG_BITSET_BYTES];
+
+/**
+ * Mediums that have been set or cleared away from the default in message_info,
+ * one bitset for each bit of enum medium. Keeping the difference lets all of
+ * RAM start out zeroed.
+ */
+static uint8_t transport_flip[MEDIUM_COUNT][MSG_BITSET_BYTES];
+
 
 void can_subscribe(enum message_id id) {
-	message_info[(size_t)id].subscribed = true;
+	subscribed[MSG_BYTE(id)] |= MSG_BIT(id);
 }
 
 
 void can_unsubscribe(enum message_id id) {
-	message_info[(size_t)id].subscribed = false;
+	subscribed[MSG_BYTE(id)] &= ~MSG_BIT(id);
 }
 
 
@@ -101,7 +94,7 @@ void can_unsubscribe(enum message_id id) {
  */
 void can_subscribe_all(void) {
 	for (size_t i = 0; i < END_OF_LIST; ++i) {
-		message_info[i].subscribed = true;
+		can_subscribe(i);
 	}
 }
 
@@ -110,32 +103,93 @@ void can_subscribe_all(void) {
  * Unsubscribe to to all messages.
  */
 void can_unsubscribe_all(void) {
-	for (size_t i = 0; i < END_OF_LIST; ++i) {
-		message_info[i].subscribed = false;
+	for (size_t i = 0; i < MSG_BITSET_BYTES; ++i) {
+		subscribed[i] = 0;
 	}
 }
 
 
 bool can_is_subscribed(enum message_id id) {
-	return message_info[(size_t)id].subscribed;
+	return subscribed[MSG_BYTE(id)] & MSG_BIT(id);
 }
 
 
 size_t get_msg_length(enum message_id id) {
-	return message_info[(size_t)id].len;
+	return pgm_read_byte(&message_info[(size_t)id].len);
 }
 
 
 uint8_t get_msg_transport(enum message_id id) {
-	return message_info[(size_t)id].transport;
+	uint8_t t = pgm_read_byte(&message_info[(size_t)id].transport);
+	for (uint8_t m = 0; m < MEDIUM_COUNT; ++m) {
+		if (transport_flip[m][MSG_BYTE(id)] & MSG_BIT(id)) {
+			t ^= 1 << m;
+		}
+	}
+	return t;
 }
 
 
 void set_msg_transport(enum message_id id, enum medium t) {
-	message_info[(size_t)id].transport |= t;
+	const uint8_t flip = ~get_msg_transport(id) & t;
+	for (uint8_t m = 0; m < MEDIUM_COUNT; ++m) {
+		if (flip & (1 << m)) {
+			transport_flip[m][MSG_BYTE(id)] ^= MSG_BIT(id);
+		}
+	}
 }
 
 
 void clear_msg_transport(enum message_id id, enum medium t) {
-	message_info[(size_t)id].transport &= ~t;
+	const uint8_t flip = get_msg_transport(id) & t;
+	for (uint8_t m = 0; m < MEDIUM_COUNT; ++m) {
+		if (flip & (1 << m)) {
+			transport_flip[m][MSG_BYTE(id)] ^= MSG_BIT(id);
+		}
+	}
+}
+
+
+enum msg_type get_msg_type(enum message_id id) {
+	return pgm_read_byte(&message_info[(size_t)id].type);
+}
+
+
+float get_msg_scale(enum message_id id) {
+	return pgm_read_float(&message_info[(size_t)id].scale);
+}
+
+
+/**
+ * Gets the human readable name of a message.
+ * @return Pointer to the name in flash. Use the _P functions to read it.
+ */
+const char* get_msg_name(enum message_id id) {
+	return (const char*)pgm_read_ptr(&message_info[(size_t)id].name);
+}
+
+
+enum msg_prio get_msg_prio(enum message_id id) {
+	return pgm_read_byte(&message_info[(size_t)id].prio);
+}
+
+
+/**
+ * Gets the identifier a message is sent with on the CAN bus.
+ */
+uint16_t get_msg_can_id(enum message_id id) {
+	return MSG_CAN_ID(get_msg_prio(id), id);
+}
+
+
+/**
+ * Gets the message sent with a CAN identifier.
+ * @return END_OF_LIST if no message is sent with can_id.
+ */
+enum message_id get_msg_id(uint16_t can_id) {
+	const uint8_t id = can_id & ((1 << MSG_CAN_ID_BITS) - 1);
+	if (id >= END_OF_LIST || get_msg_can_id(id) != can_id) {
+		return END_OF_LIST;
+	}
+	return id;
 }
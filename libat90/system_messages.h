@@ -24,6 +24,9 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 /**
  * @files system_messages.h
  * Defines the message types for the high-level can transmission.
+ *
+ * Every message is declared once in "lists/messages.inc". The enum, the
+ * constant table in flash and the names all come from there.
  */
 
 #ifndef SYSTEM_MESSAGES_H
@@ -34,32 +37,68 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <stdlib.h>
 
 
-enum message_id {
-	// ECU
-	#include "lists/ecu_keys.inc"
+enum medium {
+	CAN  = 1 << 0,
+	XBEE = 1 << 1,
+	SD   = 1 << 2,
+};
+
 
-	// All sensors
-	#include "lists/sensor_keys.inc"
+enum message_id {
+	#define MESSAGE(id, prio, len, type, scale, transport, name) id,
+	#include "lists/messages.inc"
+	#undef MESSAGE
 
-	// System messages
-	#include "lists/system_keys.inc"
+	// Frames packing several signals
+	#define CAN_FRAME(frame) frame,
+	#define CAN_SIGNAL(frame, signal, pos, type, scale, offset)
+	#include "lists/can_frames.inc"
+	#undef CAN_FRAME
+	#undef CAN_SIGNAL
 
 	// end
 	END_OF_LIST,
 };
 
 
-enum medium {
-	CAN  = 1 << 0,
-	XBEE = 1 << 1,
-	SD   = 1 << 2,
+/**
+ * Priority classes. A message of a class earlier in this list always wins
+ * arbitration on the CAN bus over one of a class later in the list.
+ */
+enum msg_prio {
+	PRIO_CONTROL,     //!< Commands that something must act on now
+	PRIO_STATUS,      //!< State other nodes act on
+	PRIO_TELEMETRY,   //!< Sensor and ECU readings
+	PRIO_DIAGNOSTIC,  //!< Heartbeats and the like
+};
+
+/**
+ * The CAN identifier of a message is its priority class followed by its
+ * message_id, so ids keep their order within a class.
+ */
+#define MSG_CAN_ID_BITS	( 7 )
+#define MSG_CAN_ID(prio, id)	( ((uint16_t)(prio) << MSG_CAN_ID_BITS) | (id) )
+
+
+//!< Encoding of a message payload
+enum msg_type {
+	MSG_F32,
+	MSG_U8,
+	MSG_U16,
+	MSG_U32,
+	MSG_I16,
+	MSG_RAW, //!< Bytes that only the sender and receiver know the layout of
 };
 
 
+//!< Constant information about a message, kept in flash.
 struct message_detail {
-	const unsigned len : 4;
-	unsigned transport : 3;
-	unsigned subscribed : 1;
+	uint8_t prio;       //!< enum msg_prio
+	uint8_t len;
+	uint8_t type;       //!< enum msg_type
+	uint8_t transport;  //!< Default enum medium mask
+	float scale;
+	const char *name;   //!< Points to flash
 };
 
 
@@ -72,5 +111,11 @@ size_t get_msg_length(enum message_id id);
 uint8_t get_msg_transport(enum message_id id);
 void set_msg_transport(enum message_id id, enum medium t);
 void clear_msg_transport(enum message_id id, enum medium t);
+enum msg_type get_msg_type(enum message_id id);
+enum msg_prio get_msg_prio(enum message_id id);
+uint16_t get_msg_can_id(enum message_id id);
+enum message_id get_msg_id(uint16_t can_id);
+float get_msg_scale(enum message_id id);
+const char* get_msg_name(enum message_id id);
 
 #endif /* SYSTEM_MESSAGES_H */
@@ -0,0 +1,129 @@
+/**
+ * Host tests and benchmark of the CAN acceptance filter solver.
+ *
+ * Build and run on the host:
+ *   gcc -std=gnu99 -O2 -I.. can_filter_test.c -o can_filter_test
+ *   ./can_filter_test
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../can_filter.c"
+#include "../system_messages.h"
+
+#define NB_RX_MOB	10
+#define N_RANDOM	10000
+
+
+static uint8_t solve_subscribed(const bool *subscribed, uint8_t n_ids,
+                                struct can_filter *filters, uint8_t max) {
+	uint16_t ids[END_OF_LIST];
+	uint8_t n_accept = 0;
+	uint8_t n_reject = n_ids;
+	for (uint8_t id = 0; id < n_ids; ++id) {
+		if (subscribed[id]) {
+			ids[n_accept++] = id;
+		} else {
+			ids[--n_reject] = id;
+		}
+	}
+	return can_filter_solve(ids, n_accept, &ids[n_reject], n_ids - n_reject,
+	                        filters, max);
+}
+
+
+static bool accepted(const struct can_filter *filters, uint8_t n, uint16_t id) {
+	for (uint8_t i = 0; i < n; ++i) {
+		if (CAN_FILTER_MATCH(&filters[i], id)) return true;
+	}
+	return false;
+}
+
+
+/**
+ * Every subscribed id must get through.
+ * @return Number of unsubscribed ids that also get through
+ */
+static uint8_t check(const bool *subscribed, uint8_t n_ids,
+                     const struct can_filter *filters, uint8_t n, uint8_t max) {
+	uint8_t leaked = 0;
+	assert(n <= max);
+	for (uint8_t id = 0; id < n_ids; ++id) {
+		if (subscribed[id]) {
+			assert(accepted(filters, n, id));
+		} else if (accepted(filters, n, id)) {
+			++leaked;
+		}
+	}
+	return leaked;
+}
+
+
+int main(void) {
+	struct can_filter filters[NB_RX_MOB];
+	bool subscribed[END_OF_LIST] = {false};
+	uint8_t n;
+
+	// Nothing subscribed means no receive MOB at all
+	n = solve_subscribed(subscribed, END_OF_LIST, filters, NB_RX_MOB);
+	assert(n == 0);
+
+	// Everything subscribed is a single filter that accepts everything
+	for (int i = 0; i < END_OF_LIST; ++i) subscribed[i] = true;
+	n = solve_subscribed(subscribed, END_OF_LIST, filters, NB_RX_MOB);
+	assert(n == 1 && filters[0].mask == 0);
+
+	// SteeringNode
+	for (int i = 0; i < END_OF_LIST; ++i) subscribed[i] = false;
+	subscribed[CURRENT_GEAR] = subscribed[ECU_RPM] = true;
+	subscribed[ECU_BATTERY_V] = subscribed[ECU_WATER_TEMP] = true;
+	n = solve_subscribed(subscribed, END_OF_LIST, filters, NB_RX_MOB);
+	assert(check(subscribed, END_OF_LIST, filters, n, NB_RX_MOB) == 0);
+	printf("SteeringNode: %u filters\n", n);
+	for (uint8_t i = 0; i < n; ++i) {
+		printf("  id 0x%03x mask 0x%03x\n", filters[i].id, filters[i].mask);
+	}
+
+	// GearNode
+	for (int i = 0; i < END_OF_LIST; ++i) subscribed[i] = false;
+	subscribed[PADDLE_STATUS] = subscribed[NEUTRAL_ENABLED] = true;
+	subscribed[GEAR_STOP_BUTTON] = subscribed[RESET_GEAR_ESTIMATE] = true;
+	n = solve_subscribed(subscribed, END_OF_LIST, filters, NB_RX_MOB);
+	assert(check(subscribed, END_OF_LIST, filters, n, NB_RX_MOB) == 0);
+	printf("GearNode: %u filters\n", n);
+
+	// Too few filters for an exact cover still receives everything subscribed
+	for (int i = 0; i < END_OF_LIST; ++i) subscribed[i] = (i % 3 == 0);
+	n = solve_subscribed(subscribed, END_OF_LIST, filters, 2);
+	check(subscribed, END_OF_LIST, filters, n, 2);
+
+	// Random subscription tables
+	srand(1);
+	unsigned long total_filters = 0;
+	unsigned long total_ids = 0;
+	unsigned long total_leaked = 0;
+	clock_t t = clock();
+	for (int r = 0; r < N_RANDOM; ++r) {
+		const int density = 1 + rand() % 50;
+		for (int i = 0; i < END_OF_LIST; ++i) {
+			subscribed[i] = (rand() % 100) < density;
+			total_ids += subscribed[i];
+		}
+		n = solve_subscribed(subscribed, END_OF_LIST, filters, NB_RX_MOB);
+		total_leaked += check(subscribed, END_OF_LIST, filters, n, NB_RX_MOB);
+		total_filters += n;
+	}
+	t = clock() - t;
+
+	printf("random: %.2f ids -> %.2f filters letting %.2f unsubscribed ids through on average\n",
+	       (double)total_ids / N_RANDOM, (double)total_filters / N_RANDOM,
+	       (double)total_leaked / N_RANDOM);
+	printf("random: %.2f us per solve\n",
+	       (double)t * 1e6 / CLOCKS_PER_SEC / N_RANDOM);
+
+	printf("%s: all tests passed\n", __FILE__);
+	return 0;
+}
@@ -0,0 +1,121 @@
+/**
+ * Host benchmark of the CAN receive path.
+ *
+ * Compares the byte wise ringbuffer that can.c used to queue received frames
+ * in (RINGBF_SIZE = 64) with the slot based can_queue.h. Each frame is
+ * produced the way the ISR does it and consumed the way read_message() does it.
+ *
+ * Build and run on the host:
+ *   gcc -std=gnu99 -O2 -I.. can_queue_bench.c -o can_queue_bench
+ *   ./can_queue_bench
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define READ_CYCLES()	__rdtsc()
+#else
+#define READ_CYCLES()	0
+#endif
+
+#include "../ringbuffer.h"
+#include "../can_queue.h"
+
+#define RINGBF_SIZE	64
+#define N_FRAMES	(1UL << 22)
+#define BURST		4 // Frames produced between each drain of the queue
+
+/* Stands in for the CANMSG register, which auto increments on every read */
+static volatile uint8_t canmsg;
+
+static ringbuffer_t rb;
+static uint8_t buff[RINGBF_SIZE];
+static struct can_queue rx_queue;
+
+static uint32_t checksum;
+
+
+static void rb_receive_frame(const uint16_t id, const uint8_t len) {
+	if (rb_left(&rb) > (3 + len)) {
+		rb_push(&rb, HIGH_BYTE(id));
+		rb_push(&rb, LOW_BYTE(id));
+		rb_push(&rb, len);
+		for (uint8_t i = 0; i < len; ++i) {
+			rb_push(&rb, canmsg);
+		}
+	}
+}
+
+
+static void rb_read_message(struct can_message *msg) {
+	uint8_t c;
+	rb_pop(&rb, &c);
+	msg->id = c << 8;
+	rb_pop(&rb, &c);
+	msg->id += c;
+	rb_pop(&rb, &msg->len);
+	for (uint8_t i = 0; i < msg->len; ++i) {
+		rb_pop(&rb, &msg->data[i]);
+	}
+}
+
+
+static void cq_receive_frame(const uint16_t id, uint8_t len) {
+	struct can_message *msg = cq_claim(&rx_queue);
+	if (msg != NULL) {
+		msg->id = id;
+		if (len > 8) len = 8;
+		msg->len = len;
+		for (uint8_t i = 0; i < len; ++i) {
+			msg->data[i] = canmsg;
+		}
+		cq_publish(&rx_queue);
+	}
+}
+
+
+static double now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+static void report(const char *name, double ns, uint64_t cycles) {
+	printf("%-24s %8.2f ns/frame %8.2f cycles/frame\n", name,
+	       ns / N_FRAMES, (double)cycles / N_FRAMES);
+}
+
+
+int main(void) {
+	struct can_message msg = {0};
+
+	rb_init(&rb, buff, RINGBF_SIZE);
+	double t = now_ns();
+	uint64_t c = READ_CYCLES();
+	for (unsigned long n = 0; n < N_FRAMES; n += BURST) {
+		for (int i = 0; i < BURST; ++i) rb_receive_frame(n + i, 4);
+		while (!rb_isEmpty(&rb)) {
+			rb_read_message(&msg);
+			checksum += msg.id;
+		}
+	}
+	report("byte ringbuffer", now_ns() - t, READ_CYCLES() - c);
+
+	cq_init(&rx_queue);
+	t = now_ns();
+	c = READ_CYCLES();
+	for (unsigned long n = 0; n < N_FRAMES; n += BURST) {
+		for (int i = 0; i < BURST; ++i) cq_receive_frame(n + i, 4);
+		while (cq_pop(&rx_queue, &msg)) {
+			checksum += msg.id;
+		}
+	}
+	report("frame slot queue", now_ns() - t, READ_CYCLES() - c);
+
+	printf("checksum %u\n", (unsigned)checksum);
+	return 0;
+}
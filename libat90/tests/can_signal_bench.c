@@ -0,0 +1,157 @@
+/**
+ * Host benchmark of the CAN signal packing.
+ *
+ * Reports the bus load of sending every signal declared in
+ * "lists/can_frames.inc" as a 4 byte float on its own id, as the nodes did
+ * before, against sending the packed frames. Also checks that every signal
+ * survives a pack and unpack to within half its scale, and times both.
+ *
+ * Build and run on the host:
+ *   gcc -std=gnu99 -O2 -I.. -Ihost can_signal_bench.c -o can_signal_bench -lm
+ *   ./can_signal_bench
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../can_signal.c"
+
+#define CAN_BAUDRATE	125000
+#define FRAME_OVERHEAD	47 // Bits of a standard frame besides its data field
+#define UPDATE_HZ	16 // One full ECU packet is 114 bytes at 19200 baud
+#define N_ROUNDS	100000
+
+// Worst case number of stuff bits in a standard frame with len data bytes.
+#define STUFF_BITS(len)	((34 + 8 * (len) - 1) / 4)
+
+struct signal_info {
+	enum message_id id;
+	enum message_id frame;
+	float scale;
+	float offset;
+	float min, max;
+};
+
+#define RAW_MIN_U8	0
+#define RAW_MAX_U8	UINT8_MAX
+#define RAW_MIN_I8	INT8_MIN
+#define RAW_MAX_I8	INT8_MAX
+#define RAW_MIN_U16	0
+#define RAW_MAX_U16	UINT16_MAX
+#define RAW_MIN_I16	INT16_MIN
+#define RAW_MAX_I16	INT16_MAX
+
+static const struct signal_info signals[] = {
+	#define CAN_FRAME(frame)
+	#define CAN_SIGNAL(frame, signal, pos, type, scale, offset) \
+	{ signal, frame, scale, offset, \
+	  RAW_MIN_##type * (scale) + (offset), RAW_MAX_##type * (scale) + (offset) },
+	#include "../lists/can_frames.inc"
+	#undef CAN_FRAME
+	#undef CAN_SIGNAL
+};
+
+static const enum message_id frames[] = {
+	#define CAN_FRAME(frame) frame,
+	#define CAN_SIGNAL(frame, signal, pos, type, scale, offset)
+	#include "../lists/can_frames.inc"
+	#undef CAN_FRAME
+	#undef CAN_SIGNAL
+};
+
+#define NB_SIG	(sizeof(signals) / sizeof(signals[0]))
+#define NB_FRAMES	(sizeof(frames) / sizeof(frames[0]))
+
+
+static double now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+static void report_load(const char *name, unsigned n_frames, unsigned len) {
+	const unsigned bits = n_frames * (FRAME_OVERHEAD + 8 * len);
+	const unsigned stuffed = bits + n_frames * STUFF_BITS(len);
+	printf("%-16s %2u frames %5u bits %5.2f%% load (%5.2f%% worst case stuffing)\n",
+	       name, n_frames, bits,
+	       100.0 * bits * UPDATE_HZ / CAN_BAUDRATE,
+	       100.0 * stuffed * UPDATE_HZ / CAN_BAUDRATE);
+}
+
+
+static void check_round_trip(void) {
+	for (size_t i = 0; i < NB_SIG; ++i) {
+		struct can_message msg = { .id = signals[i].frame, .len = CAN_FRAME_LEN };
+		assert(can_signal_frame(signals[i].id) == signals[i].frame);
+
+		for (int k = -100; k <= 100; ++k) {
+			const float v = signals[i].offset + k * 3.7f * signals[i].scale;
+			float out;
+			if (!can_signal_pack(msg.data, signals[i].id, v)) assert(0);
+			if (!can_signal_unpack(&msg, signals[i].id, &out)) assert(0);
+			// Values outside the range of the signal saturate.
+			const float expect = fminf(fmaxf(v, signals[i].min), signals[i].max);
+			assert(fabsf(out - expect) <= signals[i].scale / 2 + 1e-6f * fabsf(v));
+		}
+	}
+
+	// Packing one signal must not disturb its neighbours.
+	struct can_message msg = { .id = ECU_FRAME_TEMPS, .len = CAN_FRAME_LEN };
+	can_signal_pack(msg.data, ECU_WATER_TEMP, 95.3);
+	can_signal_pack(msg.data, ECU_MANIFOLD_AIR_TEMP, -12.4);
+	can_signal_pack(msg.data, ECU_MOTOR_OILTEMP, 110.0);
+	can_signal_pack(msg.data, ECU_BATTERY_V, 13.812);
+	enum message_id ids[CAN_FRAME_LEN];
+	float values[CAN_FRAME_LEN];
+	assert(can_signal_unpack_frame(&msg, ids, values) == 4);
+	assert(ids[0] == ECU_WATER_TEMP && fabsf(values[0] - 95.3f) < 0.051f);
+	assert(ids[1] == ECU_MANIFOLD_AIR_TEMP && fabsf(values[1] + 12.4f) < 0.051f);
+	assert(ids[2] == ECU_MOTOR_OILTEMP && fabsf(values[2] - 110.0f) < 0.051f);
+	assert(ids[3] == ECU_BATTERY_V && fabsf(values[3] - 13.812f) < 0.0006f);
+
+	// Signals that are not packed and frames that do not match are refused.
+	float v;
+	assert(can_signal_frame(ECU_RPM) == ECU_FRAME_ENGINE);
+	assert(can_signal_frame(PADDLE_STATUS) == END_OF_LIST);
+	assert(!can_signal_pack(msg.data, PADDLE_STATUS, 1));
+	assert(!can_signal_unpack(&msg, ECU_RPM, &v));
+}
+
+
+int main(void) {
+	check_round_trip();
+
+	report_load("float per id", NB_SIG, sizeof(float));
+	report_load("packed", NB_FRAMES, CAN_FRAME_LEN);
+	printf("%u signals in %u frames, updated at %u Hz on a %u bit/s bus\n",
+	       (unsigned)NB_SIG, (unsigned)NB_FRAMES, UPDATE_HZ, CAN_BAUDRATE);
+
+	struct can_message msg = { .len = CAN_FRAME_LEN };
+	float sum = 0;
+	double t = now_ns();
+	for (uint32_t r = 0; r < N_ROUNDS; ++r) {
+		for (size_t i = 0; i < NB_SIG; ++i) {
+			can_signal_pack(msg.data, signals[i].id, (float)(r & 0xFF));
+		}
+	}
+	const double pack_ns = (now_ns() - t) / ((double)N_ROUNDS * NB_SIG);
+
+	t = now_ns();
+	for (uint32_t r = 0; r < N_ROUNDS; ++r) {
+		msg.data[r & 7] = r;
+		for (size_t i = 0; i < NB_SIG; ++i) {
+			float v;
+			msg.id = signals[i].frame;
+			can_signal_unpack(&msg, signals[i].id, &v);
+			sum += v;
+		}
+	}
+	const double unpack_ns = (now_ns() - t) / ((double)N_ROUNDS * NB_SIG);
+
+	printf("pack %.1f ns/signal, unpack %.1f ns/signal (checksum %g)\n",
+	       pack_ns, unpack_ns, sum);
+	return 0;
+}
@@ -0,0 +1,269 @@
+/**
+ * Host tests and benchmark of fixed.c.
+ *
+ * Every operation is checked against the same computation in double over
+ * random inputs, and the worst error is held to a bound close to the
+ * resolution of the result. Conversions are checked the same way over their
+ * input range against the float versions they replace: linear maps of 16 bit
+ * counts, one pre-shifted as it goes beyond +-32768, the wheel speed of
+ * SensorFrontNode, the thermistor of SensorRearNode and GPS_DMS_TO_DD of
+ * GPSNode, which is in integer 1e-7 degrees as Q16.16 resolves only 1.7 m
+ * (all copied below).
+ *
+ * Finally the cycles of each conversion are compared with the float version.
+ * The host has a hardware FPU and says nothing about the AVR, which does float
+ * in software.
+ *
+ * Build and run on the host:
+ *   gcc -std=gnu99 -O2 -I.. fixed_test.c ../fixed.c -lm -o fixed_test
+ *   ./fixed_test
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define READ_CYCLES()	__rdtsc()
+#else
+#define READ_CYCLES()	0
+#endif
+
+#include "../fixed.h"
+
+#define N_RANDOM	(1L << 20)
+#define N_BENCH		(1L << 16)
+#define RESOLUTION	(1.0 / 65536)
+
+
+static double worst;
+
+static double to_double(q16_t x) {
+	return x / 65536.0;
+}
+
+static q16_t random_q16(int32_t range) {
+	return (q16_t)((((uint32_t)rand() << 16) ^ (uint32_t)rand()) % (2 * (uint32_t)range + 1)) - range;
+}
+
+static void check(const char *what, double expect, double got, double bound) {
+	const double err = fabs(expect - got);
+	if (err > bound) {
+		printf("%s: got %.9f, expected %.9f (error %g > %g)\n",
+		       what, got, expect, err, bound);
+		exit(1);
+	}
+	if (err / bound > worst) worst = err / bound;
+}
+
+static void report(const char *what) {
+	printf("%-14s worst error %4.0f%% of the bound\n", what, worst * 100);
+	worst = 0;
+}
+
+
+/* The conversions of the nodes in float, as they were, and as they are now */
+
+static float wheel_speed_float(uint32_t duration, uint16_t wheel_tick) {
+	const float holes_pr_ms = (float)wheel_tick / duration;
+	const float rpm = (1000.0 * 60.0) / (56 / holes_pr_ms);
+	const float v_mps = 0.264 * 2 * 3.1415926535 * rpm / 60.0;
+	return v_mps * ((60.0*60.0)/1000.0);
+}
+
+static q16_t wheel_speed_fixed(uint32_t duration, uint16_t wheel_tick) {
+	const struct q16_map kmph = {Q24(0.264 * 2 * 3.1415926535 * 3600.0 / 56) / duration, 0, 0};
+	return q16_map(wheel_tick, &kmph);
+}
+
+static float thermistor_float(const uint16_t rawADC) {
+	float temp;
+	temp = log(10000.0 * ((1024.0 / rawADC - 1)));
+	temp = 1 / (0.001129148 + (0.000234125 + (0.0000000876741 * temp * temp)) * temp);
+	return temp - 273.15;
+}
+
+static q16_t thermistor_fixed(const uint16_t rawADC) {
+	if (rawADC == 0) {
+		return Q16(-273.15);
+	}
+
+	const q16_t r_kohm = q16_div(q16_from_int(10 * (1024 - rawADC)), q16_from_int(rawADC));
+	const q16_t ln_r = q16_add(q16_ln(r_kohm), Q16(6.907755279));
+	const q16_t ln_r3 = q16_mul(q16_mul(ln_r, ln_r), ln_r);
+
+	q16_t kilo_inv_t = Q16(1000 * 0.001129148);
+	kilo_inv_t = q16_add(kilo_inv_t, q16_scale(ln_r, Q24(1000 * 0.000234125)));
+	kilo_inv_t = q16_add(kilo_inv_t, q16_scale(ln_r3, Q24(1000 * 0.0000000876741)));
+
+	return q16_sub(q16_div(Q16(1000), kilo_inv_t), Q16(273.15));
+}
+
+struct gps_coordinate {
+	char direction;
+	int16_t degrees;
+	uint8_t minutes;
+	uint16_t milliseconds;
+};
+
+static double gps_dms_to_dd_float(const struct gps_coordinate *dms) {
+	return (dms->degrees + dms->minutes / 60.0 + dms->milliseconds / 3600000.0) *
+	       ((dms->direction == 'N' || dms->direction == 'E') ? 1 : -1);
+}
+
+#define GPS_DD_SCALE	(10000000L)
+#define GPS_DMS_TO_DD(dms)	((int32_t)((dms)->degrees * GPS_DD_SCALE + \
+									  ((dms)->minutes * 60000UL + \
+									   (dms)->milliseconds) * 25 / 9) * \
+										(((dms)->direction == 'N' || \
+										  (dms)->direction == 'E') \
+											? 1 : -1))
+
+static const struct q16_map water_temp = Q16_MAP(-150.0 / 3840, 120);
+static const struct q16_map rpm = Q16_MAP_RANGE(0.9408, 0, 0.9408 * 65535);
+
+
+static void test_operations(void) {
+	for (long n = 0; n < N_RANDOM; ++n) {
+		const q16_t a = random_q16(Q16(180));
+		const q16_t b = random_q16(Q16(180));
+		const q16_t small = random_q16(Q16(1));
+		const q24_t gain = random_q16(Q24(100));
+
+		check("add", to_double(a) + to_double(b), to_double(q16_add(a, b)), 0);
+		check("sub", to_double(a) - to_double(b), to_double(q16_sub(a, b)), 0);
+		check("mul", to_double(a) * to_double(b), to_double(q16_mul(a, b)), RESOLUTION / 2);
+		check("mul", to_double(a) * to_double(small), to_double(q16_mul(a, small)), RESOLUTION / 2);
+		check("mac", to_double(a) + to_double(small) * to_double(b),
+		      to_double(q16_mac(a, small, b)), RESOLUTION / 2);
+		check("scale", to_double(a) * (gain / 16777216.0), to_double(q16_scale(a, gain)), RESOLUTION / 2);
+		if (b != 0 && fabs(to_double(a) / to_double(b)) < 32767) {
+			check("div", to_double(a) / to_double(b), to_double(q16_div(a, b)), RESOLUTION / 2);
+		}
+		if (b != 0 && fabs(1 / to_double(b)) < 32767) {
+			check("recip", 1 / to_double(b), to_double(q16_recip(b)), RESOLUTION / 2);
+		}
+		if (a > 0) {
+			check("log2", log2(to_double(a)), to_double(q16_log2(a)), 4 * RESOLUTION);
+			check("ln", log(to_double(a)), to_double(q16_ln(a)), 4 * RESOLUTION);
+		}
+
+		const int32_t raw = (int32_t)(rand() % 65536) - 32768;
+		const struct q16_map m = {gain / 256, a / 256};
+		check("map", raw * (m.gain / 16777216.0) + to_double(m.offset),
+		      to_double(q16_map(raw, &m)), RESOLUTION / 2 + RESOLUTION);
+	}
+	report("operations");
+
+	// Saturation instead of wrapping
+	check("add max", to_double(Q16_MAX), to_double(q16_add(Q16(30000), Q16(30000))), 0);
+	check("sub min", to_double(Q16_MIN), to_double(q16_sub(Q16(-30000), Q16(30000))), 0);
+	check("mul max", to_double(Q16_MAX), to_double(q16_mul(Q16(300), Q16(300))), 0);
+	check("mul min", to_double(Q16_MIN), to_double(q16_mul(Q16(-300), Q16(300))), 0);
+	check("div max", to_double(Q16_MAX), to_double(q16_div(Q16(30000), Q16(0.5))), 0);
+	check("div 0", to_double(Q16_MIN), to_double(q16_div(Q16(-1), 0)), 0);
+	check("map min", to_double(Q16_MIN), to_double(q16_map(65535, &(struct q16_map)Q16_MAP(-1, 0))), 0);
+	check("ln 0", to_double(Q16_MIN), to_double(q16_ln(0)), 0);
+	check("to_int", 3, q16_to_int(Q16(2.5)), 0);
+	check("to_int", -3, q16_to_int(Q16(-3.4)), 0);
+	check("to_int", 32767, q16_to_int(Q16_MAX), 0);
+
+	char buf[12];
+	const struct {
+		q16_t x;
+		uint8_t decimals;
+		const char *s;
+	} str[] = {
+		{Q16(3.14159), 3, "3.142"},
+		{Q16(-0.5), 1, "-0.5"},
+		{Q16(-12.3456), 4, "-12.3456"},
+		{Q16(99.96), 1, "100.0"},
+		{Q16(42), 0, "42"},
+		{Q16_MIN, 4, "-32768.0000"},
+	};
+	for (size_t i = 0; i < sizeof(str) / sizeof(str[0]); ++i) {
+		q16_to_str(str[i].x, buf, str[i].decimals);
+		if (strcmp(buf, str[i].s) != 0) {
+			printf("q16_to_str: got %s, expected %s\n", buf, str[i].s);
+			exit(1);
+		}
+	}
+}
+
+
+static void test_conversions(void) {
+	for (int32_t raw = 0; raw < 65536; ++raw) {
+		check("water temp", raw * (-150.0 / 3840) + 120, to_double(q16_map(raw, &water_temp)), RESOLUTION);
+	}
+	report("ECU map");
+
+	// The gain is rounded to 24 significant bits like a float, and the result
+	// has 15 fraction bits
+	check("rpm shift", 1, rpm.shift, 0);
+	for (int32_t raw = 0; raw < 65536; ++raw) {
+		check("rpm", raw * 0.9408, q16_map_to_float(q16_map(raw, &rpm), &rpm),
+		      RESOLUTION * 2 + raw * RESOLUTION / 256 + raw * 0.9408 / 16777216);
+	}
+	report("ECU_RPM map");
+
+	for (uint16_t ticks = 0; ticks < 1000; ++ticks) {
+		for (uint32_t duration = 90; duration < 110; ++duration) {
+			check("wheel speed", wheel_speed_float(duration, ticks),
+			      to_double(wheel_speed_fixed(duration, ticks)), 0.005);
+		}
+	}
+	report("wheel speed");
+
+	for (uint16_t adc = 10; adc < 1015; ++adc) {
+		check("thermistor", thermistor_float(adc), to_double(thermistor_fixed(adc)), 0.02);
+	}
+	report("thermistor");
+
+	for (int16_t degrees = 0; degrees <= 180; ++degrees) {
+		for (uint8_t minutes = 0; minutes < 60; ++minutes) {
+			for (uint16_t frac = 0; frac < 10000; frac += 7) {
+				const struct gps_coordinate c = {(degrees & 1) ? 'S' : 'E', degrees, minutes, frac * 6};
+				check("gps dd", gps_dms_to_dd_float(&c), (double)GPS_DMS_TO_DD(&c) / GPS_DD_SCALE,
+				      1.0 / GPS_DD_SCALE);
+			}
+		}
+	}
+	report("gps dd");
+}
+
+
+static uint16_t inputs[N_BENCH];
+static volatile float float_sink;
+static volatile q16_t fixed_sink;
+
+#define BENCH(name, expr_float, expr_fixed) do { \
+	uint64_t cy = READ_CYCLES(); \
+	for (long n = 0; n < N_BENCH; ++n) { const uint16_t x = inputs[n]; float_sink = (expr_float); } \
+	const uint64_t float_cy = READ_CYCLES() - cy; \
+	cy = READ_CYCLES(); \
+	for (long n = 0; n < N_BENCH; ++n) { const uint16_t x = inputs[n]; fixed_sink = (expr_fixed); } \
+	const uint64_t fixed_cy = READ_CYCLES() - cy; \
+	printf("%-14s %8.1f cycles float %8.1f cycles fixed\n", name, \
+	       (double)float_cy / N_BENCH, (double)fixed_cy / N_BENCH); \
+} while (0)
+
+static void bench(void) {
+	for (long n = 0; n < N_BENCH; ++n) inputs[n] = 10 + rand() % 1000;
+
+	BENCH("ECU map", x * (float)(-150.0 / 3840) + 120, q16_map(x, &water_temp));
+	BENCH("wheel speed", wheel_speed_float(100, x), wheel_speed_fixed(100, x));
+	BENCH("thermistor", thermistor_float(x), thermistor_fixed(x));
+	BENCH("gps dd", gps_dms_to_dd_float(&(struct gps_coordinate){'N', 55, x % 60, x * 6}),
+	      GPS_DMS_TO_DD(&((struct gps_coordinate){'N', 55, x % 60, x * 6})));
+}
+
+
+int main(void) {
+	srand(1);
+	test_operations();
+	test_conversions();
+	bench();
+	return 0;
+}
@@ -0,0 +1,28 @@
+/**
+ * Host stand-in for <avr/pgmspace.h> so flash tables can be used by the host
+ * tests and benchmarks. Flash is ordinary memory on the host.
+ */
+
+#ifndef HOST_AVR_PGMSPACE_H
+#define HOST_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s)	(s)
+
+#define pgm_read_byte(p)	(*(const uint8_t *)(p))
+#define pgm_read_word(p)	(*(const uint16_t *)(p))
+#define pgm_read_dword(p)	(*(const uint32_t *)(p))
+#define pgm_read_float(p)	(*(const float *)(p))
+#define pgm_read_ptr(p)	(*(const void * const *)(p))
+#define memcpy_P(d, s, n)	memcpy((d), (s), (n))
+#define strlen_P(s)	strlen(s)
+#define strcmp_P(a, b)	strcmp((a), (b))
+#define puts_P(s)	puts(s)
+#define printf_P(...)	printf(__VA_ARGS__)
+#define sprintf_P(...)	sprintf(__VA_ARGS__)
+#define fputs_P(s, f)	fputs((s), (f))
+
+#endif /* HOST_AVR_PGMSPACE_H */
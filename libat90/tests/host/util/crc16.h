@@ -0,0 +1,18 @@
+/**
+ * Host stand-in for <util/crc16.h>, with the C equivalent avr-libc documents
+ * for its CRC-CCITT update.
+ */
+
+#ifndef HOST_UTIL_CRC16_H
+#define HOST_UTIL_CRC16_H
+
+#include <stdint.h>
+
+static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data) {
+	data ^= (uint8_t)crc;
+	data ^= data << 4;
+	return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4)
+		^ ((uint16_t)data << 3));
+}
+
+#endif /* HOST_UTIL_CRC16_H */
@@ -0,0 +1,11 @@
+/**
+ * Host stand-in for <util/delay.h>. Busy waits are skipped on the host.
+ */
+
+#ifndef HOST_UTIL_DELAY_H
+#define HOST_UTIL_DELAY_H
+
+#define _delay_ms(ms)	((void)(ms))
+#define _delay_us(us)	((void)(us))
+
+#endif /* HOST_UTIL_DELAY_H */
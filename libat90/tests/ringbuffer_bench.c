@@ -0,0 +1,250 @@
+/**
+ * Host benchmark of ringbuffer.h.
+ *
+ * Compares the ringbuffer_t functions as they were before (size_t indices and
+ * the size read back from memory, copied below) with the current ringbuffer_t,
+ * the RB_DEFINE() push and pop, and the RB_DEFINE() bulk write and read. Each
+ * byte is produced the way the USART RX ISR does it and consumed the way
+ * usart*_getc() does it, or in place through the read span. The data read back
+ * is checked against the data written.
+ *
+ * Build and run on the host:
+ *   gcc -std=gnu99 -O2 -I.. ringbuffer_bench.c -o ringbuffer_bench
+ *   ./ringbuffer_bench
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define READ_CYCLES()	__rdtsc()
+#else
+#define READ_CYCLES()	0
+#endif
+
+#include "../ringbuffer.h"
+
+#define BUF_SIZE	64
+#define N_BYTES		(1UL << 24)
+#define BURST		16 // Bytes produced between each drain of the buffer
+
+
+/* ringbuffer_t before it got 8 bit indices */
+typedef struct {
+	uint8_t *buffer;
+	size_t start;
+	size_t end;
+	size_t size;
+} old_ringbuffer_t;
+
+#define OLD_MASK(B)		((B)->size-1)
+#define old_nextStart(B)	(((B)->start+1) & OLD_MASK((B)))
+#define old_nextEnd(B)		(((B)->end+1) & OLD_MASK((B)))
+#define old_isEmpty(B)		((B)->end == (B)->start)
+
+static inline void old_push(volatile old_ringbuffer_t *rb, uint8_t data) {
+	rb->buffer[rb->end] = data;
+	rb->end = old_nextEnd(rb);
+	if (old_isEmpty(rb)) {
+		rb->start = old_nextStart(rb);
+	}
+}
+
+static inline int old_pop(volatile old_ringbuffer_t *rb, uint8_t *data) {
+	if (old_isEmpty(rb)) return -1;
+
+	*data = rb->buffer[rb->start];
+	rb->start = old_nextStart(rb);
+
+	return 0;
+}
+
+
+RB_DEFINE(byte_rb, uint8_t, BUF_SIZE)
+
+static uint8_t old_buf[BUF_SIZE];
+static volatile old_ringbuffer_t old_rb;
+static uint8_t new_buf[BUF_SIZE];
+static volatile ringbuffer_t new_rb;
+static struct byte_rb typed_rb;
+
+static uint32_t checksum;
+
+
+static double now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+static void report(const char *name, double ns, uint64_t cycles) {
+	printf("%-24s %8.2f ns/byte %8.2f cycles/byte\n", name,
+	       ns / N_BYTES, (double)cycles / N_BYTES);
+}
+
+
+static void check(const char *name, uint8_t expect, uint8_t got) {
+	if (expect != got) {
+		printf("%s: read %u, expected %u\n", name, got, expect);
+		exit(1);
+	}
+}
+
+
+static void test_api(void) {
+	struct byte_rb rb;
+	uint8_t src[BUF_SIZE];
+	uint8_t dst[BUF_SIZE];
+	uint8_t v = 0;
+
+	for (int i = 0; i < BUF_SIZE; ++i) src[i] = i;
+
+	byte_rb_init(&rb);
+	for (int i = 0; i < BUF_SIZE - 1; ++i) {
+		if (!byte_rb_push(&rb, i)) check("push", 1, 0);
+	}
+	check("is_full", 1, byte_rb_is_full(&rb));
+	check("push full", 0, byte_rb_push(&rb, 0));
+	check("peek", 10, (byte_rb_peek(&rb, 10, &v), v));
+	check("peek past end", 0, byte_rb_peek(&rb, BUF_SIZE - 1, &v));
+
+	// Wrap the indices so both bulk copies are split in two
+	check("read", 40, byte_rb_read(&rb, dst, 40));
+	check("write", 40, byte_rb_write(&rb, src, 50));
+	check("used", BUF_SIZE - 1, byte_rb_used(&rb));
+	check("read", BUF_SIZE - 1, byte_rb_read(&rb, dst, BUF_SIZE));
+	for (int i = 0; i < BUF_SIZE - 1; ++i) {
+		check("read order", (i < 23) ? 40 + i : i - 23, dst[i]);
+	}
+	check("is_empty", 1, byte_rb_is_empty(&rb));
+	check("pop empty", 0, byte_rb_pop(&rb, &v));
+
+	ringbuffer_t lrb;
+	uint8_t lbuf[16];
+	check("init 512", (uint8_t)-1, rb_init(&lrb, dst, 512));
+	rb_init(&lrb, lbuf, sizeof(lbuf));
+	for (int i = 0; i < 20; ++i) rb_push(&lrb, i);
+	check("bytesUsed", 15, rb_bytesUsed(&lrb));
+	check("left", 0, rb_left(&lrb));
+	check("rb_peek", 7, (rb_peek(&lrb, 2, &v), v));
+	check("rb_peek past end", (uint8_t)-1, rb_peek(&lrb, 15, &v));
+
+	// start is 5 so the unread bytes wrap and come out as two spans
+	uint8_t *p;
+	size_t len;
+	rb_read_span(&lrb, &p, &len);
+	check("read span", 11, len);
+	check("read span data", 5, p[0]);
+	rb_commit(&lrb, len);
+	rb_read_span(&lrb, &p, &len);
+	check("read span wrapped", 4, len);
+	check("read span wrapped data", 16, p[0]);
+	rb_write_span(&lrb, &p, &len);
+	check("write span to start", 11, len);
+	rb_commit(&lrb, 4);
+	check("commit", 1, rb_isEmpty(&lrb));
+	rb_write_span(&lrb, &p, &len);
+	check("write span", 12, len);
+	memcpy(p, src, len);
+	rb_write_commit(&lrb, len);
+	rb_write_span(&lrb, &p, &len);
+	check("write span wrapped", 3, len);
+	check("write commit", 12, rb_bytesUsed(&lrb));
+	check("write commit data", 11, (rb_peek(&lrb, 11, &v), v));
+
+	uint8_t *tp;
+	byte_rb_init(&rb);
+	check("typed write span", BUF_SIZE - 1, byte_rb_write_span(&rb, &tp));
+	byte_rb_write_commit(&rb, BUF_SIZE - 1);
+	check("typed read span", BUF_SIZE - 1, byte_rb_read_span(&rb, &tp));
+	byte_rb_commit(&rb, BUF_SIZE - 2);
+	check("typed write span to end", 1, byte_rb_write_span(&rb, &tp));
+	byte_rb_write_commit(&rb, 1);
+	check("typed write span wrapped", BUF_SIZE - 3, byte_rb_write_span(&rb, &tp));
+	check("typed read span to end", 2, byte_rb_read_span(&rb, &tp));
+}
+
+
+int main(void) {
+	uint8_t in = 0;
+	uint8_t out = 0;
+	uint8_t c = 0;
+
+	test_api();
+
+	old_rb.buffer = old_buf;
+	old_rb.size = BUF_SIZE;
+	double t = now_ns();
+	uint64_t cy = READ_CYCLES();
+	for (unsigned long n = 0; n < N_BYTES; n += BURST) {
+		for (int i = 0; i < BURST; ++i) old_push(&old_rb, in++);
+		while (old_pop(&old_rb, &c) == 0) {
+			check("old", out++, c);
+			checksum += c;
+		}
+	}
+	report("size_t ringbuffer_t", now_ns() - t, READ_CYCLES() - cy);
+
+	rb_init((ringbuffer_t*)&new_rb, new_buf, BUF_SIZE);
+	t = now_ns();
+	cy = READ_CYCLES();
+	for (unsigned long n = 0; n < N_BYTES; n += BURST) {
+		for (int i = 0; i < BURST; ++i) rb_push((ringbuffer_t*)&new_rb, in++);
+		while (rb_pop((ringbuffer_t*)&new_rb, &c) == 0) {
+			check("ringbuffer_t", out++, c);
+			checksum += c;
+		}
+	}
+	report("uint8_t ringbuffer_t", now_ns() - t, READ_CYCLES() - cy);
+
+	byte_rb_init(&typed_rb);
+	t = now_ns();
+	cy = READ_CYCLES();
+	for (unsigned long n = 0; n < N_BYTES; n += BURST) {
+		for (int i = 0; i < BURST; ++i) byte_rb_push(&typed_rb, in++);
+		while (byte_rb_pop(&typed_rb, &c)) {
+			check("RB_DEFINE", out++, c);
+			checksum += c;
+		}
+	}
+	report("RB_DEFINE push/pop", now_ns() - t, READ_CYCLES() - cy);
+
+	uint8_t block[BURST];
+	byte_rb_init(&typed_rb);
+	t = now_ns();
+	cy = READ_CYCLES();
+	for (unsigned long n = 0; n < N_BYTES; n += BURST) {
+		for (int i = 0; i < BURST; ++i) block[i] = in++;
+		byte_rb_write(&typed_rb, block, BURST);
+		const uint8_t len = byte_rb_read(&typed_rb, block, BURST);
+		for (int i = 0; i < len; ++i) {
+			check("RB_DEFINE bulk", out++, block[i]);
+			checksum += block[i];
+		}
+	}
+	report("RB_DEFINE write/read", now_ns() - t, READ_CYCLES() - cy);
+
+	rb_init((ringbuffer_t*)&new_rb, new_buf, BUF_SIZE);
+	t = now_ns();
+	cy = READ_CYCLES();
+	for (unsigned long n = 0; n < N_BYTES; n += BURST) {
+		for (int i = 0; i < BURST; ++i) rb_push((ringbuffer_t*)&new_rb, in++);
+		uint8_t *p;
+		size_t len;
+		while (rb_read_span((ringbuffer_t*)&new_rb, &p, &len), len != 0) {
+			for (size_t i = 0; i < len; ++i) {
+				check("rb_read_span", out++, p[i]);
+				checksum += p[i];
+			}
+			rb_commit((ringbuffer_t*)&new_rb, len);
+		}
+	}
+	report("rb_read_span/rb_commit", now_ns() - t, READ_CYCLES() - cy);
+
+	printf("checksum %u\n", (unsigned)checksum);
+	return 0;
+}
@@ -0,0 +1,74 @@
+/**
+ * Host tests of the message catalog in system_messages.c.
+ *
+ * Build and run on the host:
+ *   gcc -std=gnu99 -O2 -I.. -Ihost system_messages_test.c -o system_messages_test
+ *   ./system_messages_test
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../system_messages.c"
+
+
+int main(void) {
+	// Every id has an entry, including the ones added after the list
+	for (size_t id = 0; id < END_OF_LIST; ++id) {
+		assert(get_msg_length(id) >= 1 && get_msg_length(id) <= 8);
+	}
+	assert(get_msg_length(GEAR_STOP_BUTTON) == 1);
+	assert(get_msg_length(RESET_GEAR_ESTIMATE) == 1);
+	assert(get_msg_length(ECU_FRAME_ENGINE) == 8);
+	assert(get_msg_type(ECU_RPM) == MSG_F32);
+	assert(strcmp(get_msg_name(ECU_RPM), "RPM") == 0);
+	assert(strcmp(get_msg_name(ECU_FRAME_TEMPS), "ECU_FRAME_TEMPS") == 0);
+
+	// CAN identifiers round trip and higher classes win arbitration
+	for (size_t id = 0; id < END_OF_LIST; ++id) {
+		assert(get_msg_id(get_msg_can_id(id)) == id);
+		assert(get_msg_can_id(id) <= 0x7FF);
+		if (get_msg_prio(id) != PRIO_CONTROL) {
+			assert(get_msg_can_id(PADDLE_STATUS) < get_msg_can_id(id));
+		}
+		if (get_msg_prio(id) == PRIO_TELEMETRY) {
+			assert(get_msg_can_id(CURRENT_GEAR) < get_msg_can_id(id));
+		}
+	}
+	assert(get_msg_prio(GEAR_STOP_BUTTON) == PRIO_CONTROL);
+	assert(get_msg_prio(ECU_FRAME_MOTION) == PRIO_TELEMETRY);
+	assert(get_msg_id(ECU_RPM) == END_OF_LIST);
+	assert(get_msg_id(0x7FF) == END_OF_LIST);
+
+	// Transports start out as declared and can be changed both ways
+	assert(get_msg_transport(ECU_RPM) == (XBEE | SD));
+	assert(get_msg_transport(ECU_LOAD) == SD);
+	assert(get_msg_transport(HEARTBEAT) == 0);
+	clear_msg_transport(ECU_RPM, XBEE);
+	assert(get_msg_transport(ECU_RPM) == SD);
+	clear_msg_transport(ECU_RPM, XBEE);
+	assert(get_msg_transport(ECU_RPM) == SD);
+	set_msg_transport(ECU_RPM, XBEE | CAN);
+	assert(get_msg_transport(ECU_RPM) == (CAN | XBEE | SD));
+	set_msg_transport(HEARTBEAT, SD);
+	assert(get_msg_transport(HEARTBEAT) == SD);
+	assert(get_msg_transport(ECU_LOAD) == SD);
+
+	// Subscriptions are independent bits
+	assert(!can_is_subscribed(PADDLE_STATUS));
+	can_subscribe(PADDLE_STATUS);
+	assert(can_is_subscribed(PADDLE_STATUS));
+	assert(!can_is_subscribed(NEUTRAL_ENABLED));
+	can_subscribe_all();
+	for (size_t id = 0; id < END_OF_LIST; ++id) assert(can_is_subscribed(id));
+	can_unsubscribe(SYSTIME);
+	assert(!can_is_subscribed(SYSTIME) && can_is_subscribed(CURRENT_GEAR));
+	can_unsubscribe_all();
+	for (size_t id = 0; id < END_OF_LIST; ++id) assert(!can_is_subscribed(id));
+
+	printf("system_messages_test.c: all tests passed (%u ids, %u bytes of RAM)\n",
+	       (unsigned)END_OF_LIST,
+	       (unsigned)(sizeof(subscribed) + sizeof(transport_flip)));
+	return 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * Prints the message catalog as JSON for host tools that decode CAN, XBee or
+ * log data, so they never need their own copy of "lists/messages.inc" and
+ * "lists/can_frames.inc".
+ *
+ * Build and run on the host:
+ *   gcc -std=gnu99 -O2 -I.. message_schema.c -o message_schema
+ *   ./message_schema > messages.json
+ *
+ * Output:
+ *   {"messages": [{"id": 20, "key": "ECU_RPM", "can_id": 276,
+ *                  "prio": "TELEMETRY", "len": 4, "type": "F32", "scale": 1,
+ *                  "transport": ["XBEE", "SD"], "name": "RPM"},
+ *                 ...],
+ *    "frames": [{"id": 50, "key": "ECU_FRAME_ENGINE", "can_id": 306,
+ *                "prio": "TELEMETRY", "signals": [
+ *                  {"key": "ECU_RPM", "pos": 0, "type": "U16", "scale": 1,
+ *                   "offset": 0}, ...]},
+ *               ...]}
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "../system_messages.h"
+
+
+static void print_string(const char *s) {
+	putchar('"');
+	for (; *s != '\0'; ++s) {
+		if (*s == '"' || *s == '\\') putchar('\\');
+		putchar(*s);
+	}
+	putchar('"');
+}
+
+
+static void print_transport(unsigned t) {
+	static const char *const medium_name[] = {"CAN", "XBEE", "SD"};
+	bool first = true;
+
+	putchar('[');
+	for (unsigned m = 0; m < sizeof(medium_name) / sizeof(medium_name[0]); ++m) {
+		if (t & (1 << m)) {
+			printf("%s\"%s\"", first ? "" : ", ", medium_name[m]);
+			first = false;
+		}
+	}
+	putchar(']');
+}
+
+
+int main(void) {
+	const char *sep = "";
+
+	printf("{\"messages\": [\n");
+	#define MESSAGE(id, prio, len, type, scale, transport, name) \
+		printf("%s  {\"id\": %d, \"key\": \"" #id "\", \"can_id\": %d, " \
+		       "\"prio\": \"" #prio "\", \"len\": %d, \"type\": \"" #type "\", " \
+		       "\"scale\": %.9g, \"transport\": ", \
+		       sep, id, MSG_CAN_ID(PRIO_##prio, id), len, (double)(scale)); \
+		print_transport(transport); \
+		printf(", \"name\": "); \
+		print_string(name); \
+		putchar('}'); \
+		sep = ",\n";
+	#include "../lists/messages.inc"
+	#undef MESSAGE
+	printf("\n],\n\"frames\": [\n");
+
+	sep = "";
+	const char *signal_sep = "";
+	#define CAN_FRAME(frame) \
+		printf("%s  {\"id\": %d, \"key\": \"" #frame "\", \"can_id\": %d, " \
+		       "\"prio\": \"TELEMETRY\", \"signals\": [", \
+		       (*sep == '\0') ? "" : "]},\n", frame, \
+		       MSG_CAN_ID(PRIO_TELEMETRY, frame)); \
+		sep = ",\n"; \
+		signal_sep = "";
+	#define CAN_SIGNAL(frame, signal, pos, type, scale, offset) \
+		printf("%s\n    {\"key\": \"" #signal "\", \"pos\": %d, " \
+		       "\"type\": \"" #type "\", \"scale\": %.9g, " \
+		       "\"offset\": %.9g}", \
+		       signal_sep, pos, (double)(scale), (double)(offset)); \
+		signal_sep = ",";
+	#include "../lists/can_frames.inc"
+	#undef CAN_FRAME
+	#undef CAN_SIGNAL
+	printf("%s\n]}\n", (*sep == '\0') ? "" : "]}");
+
+	return 0;
+}
@@ -35,6 +35,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <avr/interrupt.h>
 #include <avr/io.h>
+#include <util/atomic.h>  // for ATOMIC_BLOCK
 #include <stdbool.h>     // for bool
 #include <stddef.h>      // for size_t
 #include <stdint.h>      // for uint8_t, uint32_t, uint16_t
@@ -56,6 +57,7 @@ enum usart_charSelect_t {
 
 	static volatile ringbuffer_t usart0_rb_in;
 	static volatile ringbuffer_t usart0_rb_out;
+	static usart_rx_handler_t usart0_rx_handler;
 
 	FILE usart0_io = FDEV_SETUP_STREAM(usart0_putc, usart0_getc, _FDEV_SETUP_RW);
 	FILE usart0_byte_output = FDEV_SETUP_STREAM(usart0_putbyte, NULL, _FDEV_SETUP_WRITE);
@@ -64,6 +66,7 @@ enum usart_charSelect_t {
 #ifndef NO_USART1_SUPPORT
 	static volatile ringbuffer_t usart1_rb_in;
 	static volatile ringbuffer_t usart1_rb_out;
+	static usart_rx_handler_t usart1_rx_handler;
 
 	FILE usart1_io = FDEV_SETUP_STREAM(usart1_putc, usart1_getc, _FDEV_SETUP_RW);
 	FILE usart1_byte_output = FDEV_SETUP_STREAM(usart1_putbyte, NULL, _FDEV_SETUP_WRITE);
@@ -179,6 +182,53 @@ size_t usart0_output_buffer_bytes(void) {
 	return rb_bytesUsed(&usart0_rb_out);
 }
 
+/**
+ * Let handler take every received byte straight from the RX ISR, for protocols
+ * that are framed faster there than by polling the input buffer. The input
+ * buffer stays empty while a handler is set. Pass NULL to go back to buffered
+ * input.
+ */
+void usart0_set_rx_handler(usart_rx_handler_t handler) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		usart0_rx_handler = handler;
+	}
+}
+
+/**
+ * Get the oldest received bytes in place in the input buffer.
+ * @param ptr Set to the oldest byte
+ * @param len Set to the number of bytes at ptr. This can be less than
+ * usart0_input_buffer_bytes() when the data wraps around the end of the buffer
+ */
+void usart0_read_span(uint8_t **ptr, size_t *len) {
+	rb_read_span((ringbuffer_t*)&usart0_rb_in, ptr, len);
+}
+
+/**
+ * Drop n bytes from the span returned by usart0_read_span() so the ISR can
+ * reuse their space.
+ */
+void usart0_commit(size_t n) {
+	rb_commit((ringbuffer_t*)&usart0_rb_in, n);
+}
+
+/**
+ * Get free space in the output buffer to write bytes into in place.
+ * @param ptr Set to the first free byte
+ * @param len Set to the number of bytes that can be written at ptr
+ */
+void usart0_write_span(uint8_t **ptr, size_t *len) {
+	rb_write_span((ringbuffer_t*)&usart0_rb_out, ptr, len);
+}
+
+/**
+ * Send n bytes written into the span returned by usart0_write_span().
+ */
+void usart0_write_commit(size_t n) {
+	rb_write_commit((ringbuffer_t*)&usart0_rb_out, n);
+	USART0_ENABLE_UDRE_INTERRUPT();
+}
+
 /**
  * Get a byte from USART. This call is alway blocking. if input buffer is
  * enabled use usart[N]_hasData() to check if data is available.
@@ -218,8 +268,15 @@ int usart0_putc(char c, FILE *stream) {
 
 ISR(USART0_RX_vect){
 	uint8_t data = UDR0;
-	//!< @TODO should we not check if the rb is full here!?
-	rb_push((ringbuffer_t*)&usart0_rb_in, data);
+	if (usart0_rx_handler != NULL) {
+		usart0_rx_handler(data);
+		return;
+	}
+
+	// Drop the byte rather than overwrite one that may be read in place
+	if (!rb_isFull(&usart0_rb_in)) {
+		rb_push((ringbuffer_t*)&usart0_rb_in, data);
+	}
 }
 
 ISR(USART0_UDRE_vect){
@@ -322,6 +379,53 @@ size_t usart1_output_buffer_bytes(void) {
 	return rb_bytesUsed(&usart1_rb_out);
 }
 
+/**
+ * Let handler take every received byte straight from the RX ISR, for protocols
+ * that are framed faster there than by polling the input buffer. The input
+ * buffer stays empty while a handler is set. Pass NULL to go back to buffered
+ * input.
+ */
+void usart1_set_rx_handler(usart_rx_handler_t handler) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		usart1_rx_handler = handler;
+	}
+}
+
+/**
+ * Get the oldest received bytes in place in the input buffer.
+ * @param ptr Set to the oldest byte
+ * @param len Set to the number of bytes at ptr. This can be less than
+ * usart1_input_buffer_bytes() when the data wraps around the end of the buffer
+ */
+void usart1_read_span(uint8_t **ptr, size_t *len) {
+	rb_read_span((ringbuffer_t*)&usart1_rb_in, ptr, len);
+}
+
+/**
+ * Drop n bytes from the span returned by usart1_read_span() so the ISR can
+ * reuse their space.
+ */
+void usart1_commit(size_t n) {
+	rb_commit((ringbuffer_t*)&usart1_rb_in, n);
+}
+
+/**
+ * Get free space in the output buffer to write bytes into in place.
+ * @param ptr Set to the first free byte
+ * @param len Set to the number of bytes that can be written at ptr
+ */
+void usart1_write_span(uint8_t **ptr, size_t *len) {
+	rb_write_span((ringbuffer_t*)&usart1_rb_out, ptr, len);
+}
+
+/**
+ * Send n bytes written into the span returned by usart1_write_span().
+ */
+void usart1_write_commit(size_t n) {
+	rb_write_commit((ringbuffer_t*)&usart1_rb_out, n);
+	USART1_ENABLE_UDRE_INTERRUPT();
+}
+
 /**
  * Get a byte from USART. This call is alway blocking. if input buffer is
  * enabled use usart[N]_hasData() to check if data is available.
@@ -359,7 +463,15 @@ int usart1_putc(char c, FILE *stream) {
 
 ISR(USART1_RX_vect){
 	uint8_t data = UDR1;
-	rb_push((ringbuffer_t*)&usart1_rb_in, data);
+	if (usart1_rx_handler != NULL) {
+		usart1_rx_handler(data);
+		return;
+	}
+
+	// Drop the byte rather than overwrite one that may be read in place
+	if (!rb_isFull(&usart1_rb_in)) {
+		rb_push((ringbuffer_t*)&usart1_rb_in, data);
+	}
 }
 
 ISR(USART1_UDRE_vect){
@@ -52,6 +52,9 @@ enum usart_operationModes_t {
 	USART_MODE_SYNC_MASTER
 };
 
+//!< Called from the RX ISR with every received byte instead of buffering it.
+typedef void (*usart_rx_handler_t)(uint8_t data);
+
 /**
  * @name USART0
  * Functions for sending and receiving on USART0
@@ -96,6 +99,12 @@ enum usart_operationModes_t {
 	int usart0_putbyte(char c, FILE *stream);
 	int usart0_putc(char c, FILE *stream);
 
+	void usart0_set_rx_handler(usart_rx_handler_t handler);
+	void usart0_read_span(uint8_t **ptr, size_t *len);
+	void usart0_commit(size_t n);
+	void usart0_write_span(uint8_t **ptr, size_t *len);
+	void usart0_write_commit(size_t n);
+
 	extern FILE usart0_io;
 	extern FILE usart0_byte_output;
 #endif
@@ -145,6 +154,12 @@ enum usart_operationModes_t {
 	int usart1_putbyte(char b, FILE *stream);
 	int usart1_putc(char c, FILE *stream);
 
+	void usart1_set_rx_handler(usart_rx_handler_t handler);
+	void usart1_read_span(uint8_t **ptr, size_t *len);
+	void usart1_commit(size_t n);
+	void usart1_write_span(uint8_t **ptr, size_t *len);
+	void usart1_write_commit(size_t n);
+
 	extern FILE usart1_io;
 	extern FILE usart1_byte_output;
 #endif
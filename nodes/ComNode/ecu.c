@@ -33,174 +33,194 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  * The structure of the data we receive from the ECU can be found in
  * "ecu_package_layout.inc".
  *
+ * Packets are assembled in the USART RX ISR into one of two packet slots. The
+ * ECU sends each packet back to back, so a silence of ECU_GAP_MS marks the
+ * start of a new packet and a packet cut short by it is thrown away. A
+ * complete packet is handed to the main loop by pointer while the ISR fills
+ * the other slot.
+ *
+ * The request for the next packet is queued by the ISR as soon as a packet is
+ * complete, so the ECU sends while the main loop works on the last one.
  */
 
 #include <stdbool.h>
+#include <string.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
 #include <usart.h>
-#include <string.h>
+#include <sysclock.h>
+#include <util/atomic.h>
 #include <utils.h>
 
 #include "ecu.h"
+#include "ecu_decode.h"
 
 #define ECU_BAUD    	(19200)
-#define ECU_PACKET_LEN	(114)
-
-
-static float clamp(float value);
-
-static const int8_t ecu_packet[][2] PROGMEM = {
-	{ECU_FUEL_PRESSURE 			,2},
-	{ECU_STATUS_LAP_COUNT 		,2},
-	{ECU_STATUS_INJ_SUM 		,2},
-	{ECU_LAST_GEAR_SHIFT 		,2},
-	{ECU_MOTOR_OILTEMP 			,2},
-	{ECU_OIL_PRESSURE 			,2},
-	{ECU_STATUS_TIME 			,4},
-	{ECU_STATUS_LAP_TIME 		,4},
-	{ECU_GEAR_OIL_TEMP 			,2},
-	{ECU_STATUS_TRACTION 		,2},
-	{ECU_STATUS_GAS 			,2},
-	{ECU_STATUS_LAMBDA_V2 		,2},
-	{ECU_STATUS_CAM_TRIG_P1 	,2},
-	{ECU_STATUS_CAM_TRIG_P2 	,2},
-	{ECU_STATUS_CHOKER_ADD 		,2},
-	{ECU_STATUS_LAMBDA_PWM 		,2},
-	{ECU_EMPTY 					,10},
-	{ECU_WATER_TEMP 			,2},
-	{ECU_MANIFOLD_AIR_TEMP 		,2},
-	{ECU_SPEEDER_POTMETER 		,2},
-	{ECU_EMPTY 					,2},
-	{ECU_RPM 					,2},
-	{ECU_TRIGGER_ERR 			,2},
-	{ECU_CAM_ANGLE1 			,2},
-	{ECU_CAM_ANGLE2 			,2},
-	{ECU_ROAD_SPEED 			,2},
-	{ECU_MAP_SENSOR 			,2},
-	{ECU_BATTERY_V 				,2},
-	{ECU_LAMBDA_V 				,2},
-	{ECU_EMPTY 					,4},
-	{ECU_LOAD 					,2},
-	{ECU_EMPTY 					,2},
-	{ECU_INJECTOR_TIME 			,2},
-	{ECU_EMPTY 					,2},
-	{ECU_IGNITION_TIME 			,2},
-	{ECU_DWELL_TIME 			,2},
-	{ECU_EMPTY 					,10},
-	{ECU_GX 					,2},
-	{ECU_GY 					,2},
-	{ECU_GZ 					,2},
-	{ECU_EMPTY 					,8},
-	{ECU_MOTOR_FLAGS 			,1},
-	{ECU_EMPTY 					,1},
-	{ECU_OUT_BITS 				,1},
-	{ECU_TIME 					,1},
-
-	/* End state, not an actual part of the data recieved */
-	{ECU_EMPTY 					,0},
-};
+#define ECU_GAP_MS	(3) //!< Silence between packets. A byte takes 0.52 ms
 
 
-static FILE *ecu = &usart0_io;
+static const uint8_t heart_beat[] PROGMEM = {
+	0x12, 0x34, 0x56, 0x78, 0x17, 0x08, 0, 0, 0, 0
+};
 
-static uint8_t buf_in[256];
+static uint8_t buf_in[2]; // Unused, the bytes go to receive_byte()
 static uint8_t buf_out[16];
 
+static uint8_t slot[2][ECU_PACKET_LEN];
+static uint8_t fill_slot;  //!< Slot the ISR fills
+static uint8_t fill_len;
+static uint32_t last_byte_tick;
+static volatile int8_t ready_slot; //!< Slot owned by the main loop, or -1
+
+static volatile uint16_t packets;
+static volatile uint16_t resyncs;
+static volatile uint16_t dropped;
+static volatile uint16_t requests;
+
+static float values[ECU_NB_VALUES]; //!< The packet ecu_read_data() reads
+static int8_t next_value; //!< Next of values ecu_read_data() returns, or -1
+
+
+/**
+ * Queues the request for the next packet without waiting for room, so it can
+ * be called from the RX ISR. Must be called with interrupts disabled.
+ * @return false if the output buffer is still busy with the last request.
+ */
+static bool queue_request(void) {
+	if (ARR_LEN(buf_out) - 1 - usart0_output_buffer_bytes() < sizeof(heart_beat)) {
+		return false;
+	}
+
+	size_t queued = 0;
+	while (queued < sizeof(heart_beat)) {
+		uint8_t *p;
+		size_t len;
+		usart0_write_span(&p, &len);
+		if (len > sizeof(heart_beat) - queued) {
+			len = sizeof(heart_beat) - queued;
+		}
+		memcpy_P(p, &heart_beat[queued], len);
+		usart0_write_commit(len);
+		queued += len;
+	}
+	++requests;
+	return true;
+}
+
+
+/**
+ * Called from the USART0 RX ISR with every byte from the ECU.
+ */
+static void receive_byte(uint8_t data) {
+	const uint32_t now = get_tick();
+	if (fill_len != 0 && (now - last_byte_tick) >= ECU_GAP_MS) {
+		// The packet was cut short, so this byte starts the next one
+		++resyncs;
+		fill_len = 0;
+	}
+	last_byte_tick = now;
+
+	slot[fill_slot][fill_len++] = data;
+	if (fill_len == ECU_PACKET_LEN) {
+		fill_len = 0;
+		queue_request();
+		if (ready_slot != -1) {
+			// The main loop still has the other slot, so refill this one
+			++dropped;
+		} else {
+			ready_slot = fill_slot;
+			fill_slot ^= 1;
+			++packets;
+		}
+	}
+}
+
 
 void ecu_init(void) {
 	usart0_init(ECU_BAUD, buf_in, ARR_LEN(buf_in), buf_out, ARR_LEN(buf_out));  // ECU
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		fill_slot = 0;
+		fill_len = 0;
+		ready_slot = -1;
+		next_value = -1;
+		usart0_set_rx_handler(receive_byte);
+	}
 }
 
 
+/**
+ * Requests a packet from the ECU. Only needed to start the stream, the RX ISR
+ * requests the next packet when one is complete.
+ */
 void ecu_send_request(void) {
-	const uint8_t heart_beat[] = {0x12, 0x34, 0x56, 0x78, 0x17, 0x08, 0, 0, 0, 0};
-	for (size_t i = 0; i < ARR_LEN(heart_beat); ++i) {
-		fputc(heart_beat[i], ecu);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		queue_request();
 	}
 }
 
 
 bool ecu_has_packet(void) {
-	// Every full data responce we get following a request is 114 bytes long.
-	return usart0_input_buffer_bytes() == ECU_PACKET_LEN;
+	return ready_slot != -1;
 }
 
 
-static float clamp(float value) {
-	uint32_t u32;
-	memcpy(&u32, &value, sizeof(value));
-	u32 = (u32 > (1 << 15)) ? -(0xFFFF - u32) : u32;
-	memcpy(&value, &u32, sizeof(value));
-	return value;
+/**
+ * Gets the oldest complete packet. It stays valid until ecu_release_packet().
+ * @return Pointer to the ECU_PACKET_LEN bytes of the packet or NULL if no
+ * packet has been received.
+ */
+const uint8_t* ecu_get_packet(void) {
+	const int8_t s = ready_slot;
+	return (s != -1) ? slot[s] : NULL;
 }
 
 
-bool ecu_read_data(struct sensor *data) {
-	static uint8_t data_count = 0;
-	float raw_value = 0;
-
-	data->id = pgm_read_byte(&(ecu_packet[data_count][0]));
-	uint8_t len = pgm_read_byte(&(ecu_packet[data_count][1]));
+/**
+ * Hands the packet from ecu_get_packet() back to the receiver.
+ */
+void ecu_release_packet(void) {
+	ready_slot = -1;
+}
 
-	if (!len) {
-		data_count = 0;
-		return false;
-	}
 
-	if (data->id == ECU_EMPTY) {
-		for (uint8_t i = 0; i < len; ++i) {
-			fgetc(ecu);
+uint16_t ecu_get_counter(enum ecu_counters counter) {
+	uint16_t value = 0;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		switch (counter) {
+			case ECU_PACKETS: value = packets; break;
+			case ECU_RESYNCS: value = resyncs; break;
+			case ECU_DROPPED: value = dropped; break;
+			case ECU_REQUESTS: value = requests; break;
 		}
-		++data_count;
-		data->id = pgm_read_byte(&(ecu_packet[data_count][0]));
-		len = pgm_read_byte(&(ecu_packet[data_count][1]));
 	}
+	return value;
+}
 
-	while (len--) {
-		raw_value += fgetc(ecu) << (8 * len);
-	}
 
-	switch (data->id ) {
-	case ECU_STATUS_LAMBDA_V2:
-		raw_value = (70 - clamp(raw_value) / 64.0);
-		break;
-	case ECU_WATER_TEMP:
-	case ECU_MANIFOLD_AIR_TEMP:
-		raw_value = (raw_value * (-150.0 / 3840) + 120);
-		break;
-	case ECU_SPEEDER_POTMETER:
-		raw_value = ((raw_value - 336) / 26.9);
-		break;
-	case ECU_RPM:
-		raw_value = (raw_value * 0.9408);
-		break;
-	case ECU_MAP_SENSOR:
-		raw_value = (raw_value * 0.75);
-		break;
-	case ECU_BATTERY_V:
-		raw_value = (raw_value * (1.0 / 210) + 0);
-		break;
-	case ECU_LAMBDA_V:
-		raw_value = ((70 - clamp(raw_value) / 64.0) / 100);
-		break;
-	case ECU_INJECTOR_TIME:
-	case ECU_IGNITION_TIME:
-		raw_value = (-0.75 * raw_value + 120);
-		break;
-	case ECU_GX:
-	case ECU_GY:
-	case ECU_GZ:
-		raw_value = (clamp(raw_value) * (1.0 / 16384));
-		break;
-
-	default:
-		// No conversion
-		break;
+/**
+ * Reads the next value of the packet from ecu_get_packet(). The whole packet is
+ * decoded by the first call and released right away, so the receiver has both
+ * slots while the values are read.
+ * @return false when there are no more values in the packet, or no packet.
+ */
+bool ecu_read_data(struct sensor *data) {
+	if (next_value == -1) {
+		const uint8_t *packet = ecu_get_packet();
+		if (packet == NULL) {
+			return false;
+		}
+		ecu_decode(packet, values);
+		ecu_release_packet();
+		next_value = 0;
 	}
 
-	data->value = raw_value;
+	if (next_value == ECU_NB_VALUES) {
+		next_value = -1;
+		return false;
+	}
 
-	++data_count;
+	data->id = ecu_value_id(next_value);
+	data->value = values[next_value];
+	++next_value;
 	return true;
 }
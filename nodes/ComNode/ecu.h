@@ -44,46 +44,12 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <system_messages.h>
 
 
-#define ECU_ID_NAME(ecu_id) ((char const* const[]) { \
-	[ECU_EMPTY] = "", \
-	[ECU_FUEL_PRESSURE] = "Fuel Press(bar).", \
-	[ECU_STATUS_LAP_COUNT] = "Status Lap Counter", \
-	[ECU_STATUS_INJ_SUM] = "Status Injection Sum", \
-	[ECU_LAST_GEAR_SHIFT] = "Last Gear Shift", \
-	[ECU_MOTOR_OILTEMP] = "Motor Oil Temp(cel)", \
-	[ECU_OIL_PRESSURE] = "Oil Pressure(on/off)", \
-	[ECU_STATUS_TIME] = "Status Time", \
-	[ECU_STATUS_LAP_TIME] = "Status Lap Time", \
-	[ECU_GEAR_OIL_TEMP] = "Gear Oil Temp", \
-	[ECU_STATUS_TRACTION] = "Status Traction", \
-	[ECU_STATUS_GAS]  = "Status Gas", \
-	[ECU_STATUS_LAMBDA_V2] = "Status LambdaV2", \
-	[ECU_STATUS_CAM_TRIG_P1] = "Status Cam shaft Trig P1", \
-	[ECU_STATUS_CAM_TRIG_P2] = "Status Cam shaft Trig P2", \
-	[ECU_STATUS_CHOKER_ADD] = "Status Choker Add (open/closed air intake)", \
-	[ECU_STATUS_LAMBDA_PWM] = "Status Lambda PWM", \
-	[ECU_WATER_TEMP] = "WaterMotor temp", \
-	[ECU_MANIFOLD_AIR_TEMP] = "ManifoldAir temp", \
-	[ECU_SPEEDER_POTMETER] = "Speeder Potmeter (0-100%)", \
-	[ECU_RPM] = "RPM", \
-	[ECU_TRIGGER_ERR] = "Trigger Err", \
-	[ECU_CAM_ANGLE1] = "Cam Angle1", \
-	[ECU_CAM_ANGLE2] = "Cam Angle2", \
-	[ECU_ROAD_SPEED] = "RoadSpeed (km/h)", \
-	[ECU_MAP_SENSOR] = "Manifold press. (mBar)", \
-	[ECU_BATTERY_V] = "Batt. volt", \
-	[ECU_LAMBDA_V] = "Lambda (fuel mix) (<1 => Rich)", \
-	[ECU_LOAD] = "Load (motor resistance procentage)", \
-	[ECU_INJECTOR_TIME] = "Injector Time", \
-	[ECU_IGNITION_TIME] = "Ignition Time", \
-	[ECU_DWELL_TIME] = "Dwell Time", \
-	[ECU_GX] = "GX", \
-	[ECU_GY] = "GY", \
-	[ECU_GZ] = "GZ", \
-	[ECU_MOTOR_FLAGS] = "Motor Flags", \
-	[ECU_OUT_BITS] = "Out Bits", \
-	[ECU_TIME] = "Time", \
-}[ecu_id])
+enum ecu_counters {
+	ECU_PACKETS, //!< Complete packets handed to the main loop
+	ECU_RESYNCS, //!< Packets cut short by a gap in the stream
+	ECU_DROPPED, //!< Complete packets lost because both slots were full
+	ECU_REQUESTS, //!< Requests sent to the ECU
+};
 
 
 struct sensor {
@@ -94,6 +60,9 @@ struct sensor {
 void ecu_init(void);
 void ecu_send_request(void);
 bool ecu_has_packet(void);
+const uint8_t* ecu_get_packet(void);
+void ecu_release_packet(void);
+uint16_t ecu_get_counter(enum ecu_counters counter);
 bool ecu_read_data(struct sensor *data);
 
 #endif /* ECU_H */
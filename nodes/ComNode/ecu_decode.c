@@ -0,0 +1,137 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 UnicornRaceEngineering
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file ecu_decode.c
+ * Decodes a complete packet from the ECU in one pass.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+
+#include "ecu_decode.h"
+
+#define CONCAT_(a, b)	a ## b
+#define CONCAT(a, b)	CONCAT_(a, b)
+
+#define WIDTH_U8	1
+#define WIDTH_U16	2
+#define WIDTH_I16	2
+#define WIDTH_U32	4
+
+/**
+ * The packet as it arrives. Only used to compute the offset of every field.
+ */
+struct ecu_layout {
+	#define ECU_FIELD(id, type, scale, offset) uint8_t id[WIDTH_##type];
+	#define ECU_SKIP(len) uint8_t CONCAT(skip_, __LINE__)[len];
+	#include "ecu_package_layout.inc"
+	#undef ECU_FIELD
+	#undef ECU_SKIP
+};
+
+typedef char ecu_layout_must_match_packet_len[
+	(sizeof(struct ecu_layout) == ECU_PACKET_LEN) ? 1 : -1];
+
+struct ecu_field {
+	uint8_t id;
+	uint8_t pos;
+	uint8_t width;
+	uint8_t type; //!< enum msg_type
+	bool scaled;
+	float scale;
+	float offset;
+};
+
+static const struct ecu_field ecu_fields[ECU_NB_VALUES] PROGMEM = {
+	#define ECU_FIELD(id, type, scale, offset) \
+		{id, offsetof(struct ecu_layout, id), WIDTH_##type, MSG_##type, \
+		 (scale) != 1.0 || (offset) != 0, scale, offset},
+	#define ECU_SKIP(len)
+	#include "ecu_package_layout.inc"
+	#undef ECU_FIELD
+	#undef ECU_SKIP
+};
+
+
+/**
+ * Decodes all the fields of a packet into physical values.
+ * @param packet The ECU_PACKET_LEN bytes of a complete packet.
+ * @param values Filled with the value of every field, indexed by enum ecu_value.
+ * Only the scaled fields cost a float multiply and add. Receivers that should
+ * not get floats at all are sent the raw counts, see ecu_value_raw().
+ */
+void ecu_decode(const uint8_t *packet, float values[ECU_NB_VALUES]) {
+	for (uint8_t i = 0; i < ECU_NB_VALUES; ++i) {
+		struct ecu_field f;
+		memcpy_P(&f, &ecu_fields[i], sizeof(f));
+
+		const uint8_t *p = packet + f.pos;
+		float raw = 0;
+		switch (f.type) {
+			case MSG_U8:  raw = p[0]; break;
+			case MSG_U16: raw = (uint16_t)(p[0] << 8 | p[1]); break;
+			case MSG_I16: raw = (int16_t)(p[0] << 8 | p[1]); break;
+			case MSG_U32:
+				raw = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+				      (uint16_t)(p[2] << 8 | p[3]);
+				break;
+		}
+		values[i] = f.scaled ? raw * f.scale + f.offset : raw;
+	}
+}
+
+
+enum message_id ecu_value_id(enum ecu_value value) {
+	return pgm_read_byte(&ecu_fields[value].id);
+}
+
+
+/**
+ * Copies the raw count of a field without any conversion. The bytes are
+ * swapped to little endian, like every other value ComNode sends.
+ * @param raw Room for 4 bytes.
+ * @return The width of the field in bytes.
+ */
+uint8_t ecu_value_raw(const uint8_t *packet, enum ecu_value value, uint8_t *raw) {
+	const uint8_t *p = packet + pgm_read_byte(&ecu_fields[value].pos);
+	const uint8_t width = pgm_read_byte(&ecu_fields[value].width);
+	for (uint8_t i = 0; i < width; ++i) {
+		raw[i] = p[width - 1 - i];
+	}
+	return width;
+}
+
+
+/**
+ * Gets what a receiver of raw counts needs to know about a field: the physical
+ * value is raw * scale + offset, with raw encoded as type.
+ */
+void ecu_value_info(enum ecu_value value, struct ecu_value_info *info) {
+	info->id = pgm_read_byte(&ecu_fields[value].id);
+	info->type = pgm_read_byte(&ecu_fields[value].type);
+	info->scale = pgm_read_float(&ecu_fields[value].scale);
+	info->offset = pgm_read_float(&ecu_fields[value].offset);
+}
@@ -0,0 +1,69 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 UnicornRaceEngineering
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file ecu_decode.h
+ * Decodes a complete packet from the ECU in one pass.
+ *
+ * The fields are described once in "ecu_package_layout.inc". From it a table
+ * in flash holds the offset, encoding and linear coefficients of every field,
+ * so the regions we do not use are never touched.
+ *
+ * The raw counts of the fields can also be read as they are, for receivers
+ * that do the conversion themselves from ecu_value_info().
+ */
+
+#ifndef ECU_DECODE_H
+#define ECU_DECODE_H
+
+#include <stdint.h>
+#include <system_messages.h>
+
+#define ECU_PACKET_LEN	(114)
+
+/**
+ * Index of every field in the decoded values, e.g. ECU_VALUE_ECU_RPM.
+ */
+enum ecu_value {
+	#define ECU_FIELD(id, type, scale, offset) ECU_VALUE_##id,
+	#define ECU_SKIP(len)
+	#include "ecu_package_layout.inc"
+	#undef ECU_FIELD
+	#undef ECU_SKIP
+
+	ECU_NB_VALUES
+};
+
+struct ecu_value_info {
+	uint8_t id;   //!< enum message_id
+	uint8_t type; //!< enum msg_type of the raw count
+	float scale;
+	float offset;
+};
+
+void ecu_decode(const uint8_t *packet, float values[ECU_NB_VALUES]);
+enum message_id ecu_value_id(enum ecu_value value);
+uint8_t ecu_value_raw(const uint8_t *packet, enum ecu_value value, uint8_t *raw);
+void ecu_value_info(enum ecu_value value, struct ecu_value_info *info);
+
+#endif /* ECU_DECODE_H */
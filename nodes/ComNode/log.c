@@ -21,57 +21,552 @@ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
 CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+/**
+ * @file log.c
+ * Logging to the SD card.
+ *
+ * log_append() fills one of two sector buffers while the other waits to be
+ * written by log_service() from the main loop, so logging never waits for the
+ * card. The FAT and directory entry are only updated by f_sync() as often as
+ * the sync policy says, not for every sector. If both buffers are full the
+ * data is dropped and counted as an overrun.
+ *
+ * A new log gets LOG_RESERVE_STEP bytes of contiguous clusters when it is
+ * created, if the card has them, and log_service() reserves the next step
+ * while the card is idle once less than half a step is left, up to
+ * LOG_RESERVE_SIZE. Its sectors are streamed straight to the card with
+ * sd_stream_write(), so FatFs does not have to allocate a cluster or walk the
+ * FAT for every sector. The directory entry is set to the size logged so far
+ * when the log is synced, and the clusters not used are freed when it is
+ * closed. Once the next cluster is not contiguous, or LOG_RESERVE_SIZE is
+ * reached, the log goes on with f_write() when the reserved clusters are used
+ * up.
+ *
+ * Log format, version LOG_VERSION. The log is made of 512 byte blocks that each
+ * can be checked and decoded on their own, so the blocks that made it to the
+ * card can be found again even if the file is torn or was never synced:
+ *   block   = sync:u16 log:u16 seq:u32 tick:u32 len:u16 crc:u16 data[len] pad
+ *   data    = header record*     in the block with seq 0
+ *           | record*            in the others
+ *   header  = magic:"ULOG" version:u8 meta:BSON
+ *   record  = id:varint value
+ * sync is LOG_BLOCK_SYNC, log is the number of the log and seq the number of
+ * the block in it. crc is the CRC-CCITT (_crc_ccitt_update() from 0xFFFF) of
+ * the block up to crc followed by data. pad is zeros. Records never cross a
+ * block.
+ * meta is a BSON document with
+ *   "tick"    int32   ms per tick of the time records
+ *   "time"    int32   id of the time records
+ *   "log"     int32   number of the log
+ *   "ready"   int32   ticks from boot until the log was created
+ *   "fields"  binary  n * (id:u8 type:u8 scale:f32 offset:f32)
+ * The value of a time record is the ticks since the last time record as a
+ * varint. The last time record before a block is the tick in its header, 0 for
+ * the first block. Every other record has a value of the width of its type in
+ * "fields", little endian, and the physical value is value * scale + offset. A
+ * varint is unsigned LEB128: 7 bits per byte, least significant first, with
+ * the high bit set on all but the last byte.
+ *
+ * The number of the next log is kept in the EEPROM, so log_init() creates it
+ * with one lookup in the directory instead of trying every name from LOG0.DAT
+ * up. Each time it is written to the next of LOG_NUMBER_SLOTS slots with a
+ * sequence number and a crc, which spreads the wear over the slots and leaves
+ * the slot before valid if the power is cut during the write. If no slot is
+ * valid or the card already has that log, the directory is read once for the
+ * highest log number on the card instead.
+ *
+ * Every log is added to the catalog of log_catalog.c when it is created, and
+ * its entry there is updated with the size and records synced every
+ * LOG_CATALOG_INTERVAL and when it is closed.
+ */
+
 #include <avr/pgmspace.h>
 #include <fatfs/ff.h>  // for f_mount, f_open, f_sync, f_write, ::FR_EXIST, etc
 #include <stddef.h>    // for size_t
 #include <stdint.h>    // for uint8_t
 #include <string.h>    // for memcpy, memset
-#include <util/delay.h>
 #include <stdio.h>
 #include <utils.h>
 #include <stdbool.h>
+#include <util/crc16.h>
+#include <sysclock.h>
+#include <mmc_sdcard.h>
+#include <bson.h>
+#include <eeprom.h>
+#include <system_messages.h>
 
 #include "log.h"
+#include "log_catalog.h"
 
 #define FMT_LOG_NAME PSTR("LOG%u.DAT")
 
-#define BUF_SIZE	512
+#define SECTOR_SIZE	512
+
+typedef char blocks_must_be_sectors[(LOG_BLOCK_LEN == SECTOR_SIZE) ? 1 : -1];
+
+
+static uint8_t sectors[2][SECTOR_SIZE];
+static uint8_t fill;           //!< Sector log_append() fills
+static uint16_t fill_len;
+static int8_t pending = -1;    //!< Full sector log_service() writes, or -1
+static uint16_t block_records[2]; //!< Records in each sector
+static uint32_t records;       //!< Records in the blocks written
+
+static uint16_t sync_interval = LOG_SYNC_INTERVAL;
+static uint32_t sync_bytes = LOG_SYNC_BYTES;
+static uint32_t last_sync_tick;
+static uint32_t last_catalog_tick;
+static uint32_t unsynced_bytes;
 
+static uint16_t counters[N_LOG_COUNTERS];
 
-static struct payload {
-	uint8_t buf[BUF_SIZE];
-	size_t i;
-} p;
+static struct {
+	bool active;      //!< Sectors are streamed to the reserved clusters
+	bool growing;     //!< More contiguous clusters can be reserved
+	DWORD first;      //!< First sector of the reserved clusters
+	uint32_t sectors; //!< Sectors reserved
+	uint32_t written; //!< Sectors streamed
+} reserved;
 
+static uint16_t log_number;
+static uint32_t block_seq;     //!< seq of the block being filled
+static uint32_t last_time;
+static uint32_t ready_tick;    //!< Tick when log_init() was done
 
-static void log_sync(void);
-static bool flush_to_sd(void);
+struct number_slot {
+	uint32_t seq;    //!< Highest in the slot written last
+	uint16_t number; //!< Number of the next log
+	uint16_t crc;    //!< CRC-CCITT of the slot up to here
+};
 
+static struct {
+	uint8_t index;           //!< Slot written last
+	struct number_slot slot; //!< Slot written last or being written
+	uint8_t left;            //!< Bytes of it log_service() has to write
+} eeprom_number;
 
 static FIL logfile;
 static FATFS fs;
 
 
+static bool mount_card(void);
+static FRESULT sync_log(void);
+static void write_log_number(void);
+static uint32_t grow_file(FIL *f, uint32_t size);
+static void reserve_log(FIL *f);
+static bool grow_reservation(void);
+static void end_stream(void);
+static void start_log(void);
+static void start_block(void);
+static bool swap_sectors(void);
+
+
 void log_init(void) {
-	_delay_ms(1000); /* Wait for SD card to be ready */
-	if (f_mount(&fs, "", 1) != FR_OK) {
+	if (mount_card()) {
+		catalog_open();
+		create_file(&logfile);
+		reserve_log(&logfile);
+	}
+	start_log();
+	ready_tick = get_tick();
+}
+
+
+/**
+ * Mounts the card as soon as it answers, instead of waiting for as long as it
+ * may take to power up. Needs the sysclock to be running.
+ */
+static bool mount_card(void) {
+	const uint32_t start = get_tick();
+	do {
+		if (f_mount(&fs, "", 1) == FR_OK) {
+			return true;
+		}
+	} while (get_tick() - start < LOG_MOUNT_TIMEOUT);
+	return false;
+}
+
+
+/**
+ * Starts the first block of a new log.
+ */
+static void start_log(void) {
+	pending = -1;
+	block_seq = 0;
+	last_time = 0;
+	records = 0;
+	start_block();
+}
+
+
+/**
+ * Seeks past the end of f one cluster at a time, which allocates them, until
+ * size bytes are allocated or a cluster is not contiguous with the one before.
+ * That cluster is freed again.
+ * @return Bytes allocated
+ */
+static uint32_t grow_file(FIL *f, uint32_t size) {
+	const uint32_t cluster_size = (uint32_t)f->fs->csize * SECTOR_SIZE;
+	const uint32_t start = f->fptr;
+	DWORD clust = (start == 0) ? 0 : f->clust;
+	uint32_t ofs = start;
+	while (ofs - start < size) {
+		// Seeking past the end of a file open for writing allocates a cluster
+		const uint32_t next = ofs + cluster_size;
+		if (f_lseek(f, next) != FR_OK || f->fptr != next) break;
+		if (clust != 0 && f->clust != clust + 1) break;
+		clust = f->clust;
+		ofs = next;
+	}
+
+	if (f->fptr != ofs) {
+		f_lseek(f, ofs);
+		f_truncate(f);
+	}
+	return ofs - start;
+}
+
+
+/**
+ * Reserves the first LOG_RESERVE_STEP bytes of clusters of the new file f and
+ * starts a stream to them. If not even one cluster can be reserved the log is
+ * written with f_write().
+ */
+static void reserve_log(FIL *f) {
+	if (f->fs == NULL) {
+		return; // No file was created
+	}
+
+	const uint32_t size = grow_file(f, LOG_RESERVE_STEP);
+	if (size == 0) {
+		f_sync(f);
+		return;
+	}
+
+	reserved.first = f->fs->database + (f->sclust - 2) * f->fs->csize;
+	reserved.sectors = size / SECTOR_SIZE;
+	reserved.written = 0;
+	reserved.growing = (size >= LOG_RESERVE_STEP);
+	reserved.active = (sd_stream_begin(reserved.first, reserved.sectors) == 0);
+	sync_log(); // Writes the FAT and an empty directory entry
+}
+
+
+/**
+ * Reserves the next LOG_RESERVE_STEP bytes of clusters of the log once less
+ * than half a step of the reserved ones is left. Only called when no sector
+ * waits to be written.
+ * @return true if clusters were reserved
+ */
+static bool grow_reservation(void) {
+	if (!reserved.active || !reserved.growing
+		|| (reserved.sectors - reserved.written) * SECTOR_SIZE >= LOG_RESERVE_STEP / 2) {
+		return false;
+	}
+
+	const uint32_t size = grow_file(&logfile, LOG_RESERVE_STEP);
+	reserved.sectors += size / SECTOR_SIZE;
+	reserved.growing = (size >= LOG_RESERVE_STEP)
+		&& (reserved.sectors * SECTOR_SIZE < LOG_RESERVE_SIZE);
+
+	// Reading the FAT ended the stream, it goes on with the new length
+	if (sd_stream_begin(reserved.first + reserved.written,
+	                    reserved.sectors - reserved.written) != 0) {
+		end_stream();
+	}
+	return true;
+}
+
+
+/**
+ * Ends the stream to the reserved clusters. The log goes on with f_write()
+ * after the sectors streamed, and the clusters not used are freed.
+ */
+static void end_stream(void) {
+	sd_stream_end();
+	reserved.active = false;
+	f_lseek(&logfile, reserved.written * SECTOR_SIZE);
+	f_truncate(&logfile);
+}
+
+
+/**
+ * Bytes written to the log. While it is streamed that is not the file size,
+ * which is the size reserved.
+ */
+static uint32_t logged_size(void) {
+	return reserved.active ? reserved.written * SECTOR_SIZE : f_size(&logfile);
+}
+
+
+/**
+ * Syncs the log. While it is streamed the directory entry gets the size logged
+ * so far and not the size reserved.
+ */
+static FRESULT sync_log(void) {
+	if (!reserved.active) {
+		return f_sync(&logfile);
+	}
+
+	// f_sync() writes fsize to the directory entry
+	const DWORD fsize = logfile.fsize;
+	logfile.fsize = logged_size();
+	logfile.flag |= FA__WRITTEN;
+	const FRESULT rc = f_sync(&logfile);
+	logfile.fsize = fsize;
+	return rc;
+}
+
+
+static uint8_t put_varint(uint8_t *buf, uint32_t v) {
+	uint8_t n = 0;
+	while (v >= 0x80) {
+		buf[n++] = (uint8_t)v | 0x80;
+		v >>= 7;
+	}
+	buf[n++] = v;
+	return n;
+}
+
+
+/**
+ * Writes the header of the log. It must come before anything else is logged.
+ * @param n_fields Number of fields, at most LOG_MAX_FIELDS
+ * @param get_field Fills in field i of the header
+ * @return false if something was already logged
+ */
+bool log_begin(uint8_t n_fields, void (*get_field)(uint8_t i, struct log_field *f)) {
+	if (block_seq != 0 || fill_len != LOG_BLOCK_HEADER_LEN || pending != -1) {
+		return false;
+	}
+	if (n_fields > LOG_MAX_FIELDS) {
+		n_fields = LOG_MAX_FIELDS;
+	}
+
+	// The fields are put together in the sector that is not filled yet
+	uint8_t *fields = sectors[fill ^ 1];
+	for (uint8_t i = 0; i < n_fields; ++i) {
+		struct log_field f;
+		get_field(i, &f);
+		uint8_t *entry = &fields[i * LOG_FIELD_LEN];
+		entry[0] = f.id;
+		entry[1] = f.type;
+		memcpy(&entry[2], &f.scale, sizeof(f.scale));
+		memcpy(&entry[6], &f.offset, sizeof(f.offset));
+	}
+
+	struct bson_element meta[] = {
+		{.e_id = ID_32_INTEGER, .key = "tick", .int32 = 1},
+		{.e_id = ID_32_INTEGER, .key = "time", .int32 = LOG_TIME_ID},
+		{.e_id = ID_32_INTEGER, .key = "log", .int32 = log_number},
+		{.e_id = ID_32_INTEGER, .key = "ready", .int32 = ready_tick},
+		{.e_id = ID_BINARY, .key = "fields", .binary = {
+			.subtype = SUB_GENERIC,
+			.data = fields,
+			.len = n_fields * LOG_FIELD_LEN,
+		}},
+	};
+	uint8_t *header = &sectors[fill][fill_len];
+	memcpy(header, LOG_MAGIC, sizeof(LOG_MAGIC) - 1);
+	header[sizeof(LOG_MAGIC) - 1] = LOG_VERSION;
+	const int32_t len = serialize(&header[sizeof(LOG_MAGIC)], meta, ARR_LEN(meta),
+		LOG_BLOCK_DATA_LEN - sizeof(LOG_MAGIC));
+	if (len < 0) {
+		++counters[LOG_ERRORS];
+		return false;
+	}
+	fill_len += sizeof(LOG_MAGIC) + len;
+	return true;
+}
+
+
+/**
+ * Logs a time record. The next one is relative to it only if it made it into
+ * the log, so a dropped record does not shift the time of those after it.
+ * @param tick ms since boot
+ */
+void log_time(uint32_t tick) {
+	uint8_t record[2 * 5];
+	uint8_t len = put_varint(record, LOG_TIME_ID);
+	len += put_varint(&record[len], tick - last_time);
+	if (log_append(record, len)) {
+		last_time = tick;
 	}
+}
 
-	_delay_ms(100);
-	create_file(&logfile);
+
+/**
+ * Logs a record.
+ * @param id Id of the record
+ * @param value Value of the width of the type given for id in the header
+ * @param len Width of the value, at most 8
+ */
+void log_record(uint16_t id, const void *value, uint8_t len) {
+	uint8_t record[3 + 8];
+	const uint8_t id_len = put_varint(record, id);
+	memcpy(&record[id_len], value, len);
+	log_append(record, id_len + len);
 }
 
 
+/**
+ * Writes a sector to the log.
+ */
+static bool write_sector(const uint8_t *buf) {
+	if (reserved.active && reserved.written == reserved.sectors) {
+		end_stream();
+	}
+
+	if (reserved.active) {
+		if (sd_stream_write(buf) != 0) {
+			return false;
+		}
+		++reserved.written;
+		return true;
+	}
+
+	unsigned bw;
+	const FRESULT rc = f_write(&logfile, buf, SECTOR_SIZE, &bw);
+	return (rc == FR_OK) && (bw == SECTOR_SIZE);
+}
+
+
+/**
+ * Writes the data still buffered and closes the log. Reserved clusters that
+ * were not used are freed.
+ */
+void log_close(void) {
+	if (pending != -1) {
+		log_service();
+	}
+	if (fill_len != LOG_BLOCK_HEADER_LEN) {
+		swap_sectors();
+		log_service();
+	}
+
+	if (reserved.active) {
+		end_stream();
+	}
+	catalog_update(logged_size(), records);
+	f_close(&logfile);
+}
+
+
+static uint16_t slot_crc(const struct number_slot *s) {
+	const uint8_t *b = (const uint8_t *)s;
+	uint16_t crc = 0xFFFF;
+	for (uint8_t i = 0; i < offsetof(struct number_slot, crc); ++i) {
+		crc = _crc_ccitt_update(crc, b[i]);
+	}
+	return crc;
+}
+
+
+/**
+ * Reads the number of the next log from the valid slot with the highest seq.
+ * @return false if no slot is valid
+ */
+static bool load_log_number(uint16_t *number) {
+	bool found = false;
+	for (uint8_t i = 0; i < LOG_NUMBER_SLOTS; ++i) {
+		struct number_slot s;
+		EEPROM_read_buf(LOG_NUMBER_EEPROM + i * sizeof(s), &s, sizeof(s));
+		if (s.crc != slot_crc(&s) || (found && s.seq <= eeprom_number.slot.seq)) {
+			continue;
+		}
+		eeprom_number.slot = s;
+		eeprom_number.index = i;
+		found = true;
+	}
+
+	*number = eeprom_number.slot.number;
+	return found;
+}
+
+
+/**
+ * Has log_service() write number to the slot after the last one.
+ */
+static void store_log_number(uint16_t number) {
+	eeprom_number.index = (eeprom_number.index + 1) % LOG_NUMBER_SLOTS;
+	++eeprom_number.slot.seq;
+	eeprom_number.slot.number = number;
+	eeprom_number.slot.crc = slot_crc(&eeprom_number.slot);
+	eeprom_number.left = sizeof(eeprom_number.slot);
+}
+
+
+/**
+ * Writes the next byte of a stored log number if the EEPROM is ready for it.
+ * A byte takes 8.5 ms to write, too long to wait for at boot.
+ */
+static void write_log_number(void) {
+	if (eeprom_number.left == 0 || !EEPROM_ready()) {
+		return;
+	}
+	const uint8_t i = sizeof(eeprom_number.slot) - eeprom_number.left--;
+	EEPROM_write(LOG_NUMBER_EEPROM + eeprom_number.index * sizeof(struct number_slot) + i,
+	             ((const uint8_t *)&eeprom_number.slot)[i]);
+}
+
+
+/**
+ * Parses the number of a log from its file name.
+ */
+bool parse_log_name(const char *name, uint16_t *number) {
+	if (memcmp(name, "LOG", 3) != 0) {
+		return false;
+	}
+	const char *c = &name[3];
+	uint32_t n = 0;
+	while (*c >= '0' && *c <= '9') {
+		n = n * 10 + (*c++ - '0');
+		if (n > UINT16_MAX) {
+			return false;
+		}
+	}
+	*number = n;
+	return (c != &name[3]) && (strcmp(c, ".DAT") == 0);
+}
+
+
+/**
+ * Reads the directory once for the number after the highest log on the card.
+ */
+static uint16_t scan_log_numbers(void) {
+	uint16_t next = 0;
+	DIR dir;
+	if (f_opendir(&dir, "") != FR_OK) {
+		return next;
+	}
+
+	FILINFO info;
+	while (f_readdir(&dir, &info) == FR_OK && info.fname[0] != '\0') {
+		uint16_t n;
+		if (parse_log_name(info.fname, &n) && n >= next) {
+			next = n + 1;
+		}
+	}
+	f_closedir(&dir);
+	return next;
+}
+
+
+/**
+ * Creates the next log. It gets the number kept in the EEPROM if the card does
+ * not have that log already, else the number after the highest log on the card.
+ */
 void create_file(FIL *f) {
-	// increment filename until we have a new file that does not already exists.
-	char file_name[32] = {'\0'};
-	unsigned i = 0;
-	do {
-		sprintf_P(file_name, FMT_LOG_NAME, i++);
-		if (i > 1000) {
+	uint16_t n;
+	if (!load_log_number(&n) || !open_file(f, n, FA_CREATE_NEW|FA_WRITE)) {
+		n = scan_log_numbers();
+		if (!open_file(f, n, FA_CREATE_NEW|FA_WRITE)) {
 			return;
 		}
-	} while (f_open(f, file_name, FA_CREATE_NEW|FA_WRITE) != FR_OK); //== FR_EXIST);
+	}
+	log_number = n;
+	store_log_number(n + 1);
+	catalog_add(n);
 }
 
 
@@ -111,36 +606,141 @@ bool file_seek(FIL *f, size_t offset) {
 }
 
 
-static bool flush_to_sd(void) {
-	unsigned bw;
-	const FRESULT rc = f_write(&logfile, p.buf, p.i, &bw);
-	if((rc != FR_OK) || (bw != p.i)) {
+/**
+ * Starts a block in the sector being filled. Its len and crc are filled in
+ * when it is full.
+ */
+static void start_block(void) {
+	uint8_t *b = sectors[fill];
+	const uint16_t sync = LOG_BLOCK_SYNC;
+	memcpy(&b[LOG_BLOCK_SYNC_POS], &sync, sizeof(sync));
+	memcpy(&b[LOG_BLOCK_LOG_POS], &log_number, sizeof(log_number));
+	memcpy(&b[LOG_BLOCK_SEQ_POS], &block_seq, sizeof(block_seq));
+	memcpy(&b[LOG_BLOCK_TICK_POS], &last_time, sizeof(last_time));
+	fill_len = LOG_BLOCK_HEADER_LEN;
+	block_records[fill] = 0;
+}
+
+
+/**
+ * Hands the block being filled to log_service() and starts the next one in the
+ * other sector.
+ * @return false if the other one is not written yet.
+ */
+static bool swap_sectors(void) {
+	if (pending != -1) {
 		return false;
 	}
-	p.i = 0;
+	const uint16_t len = fill_len - LOG_BLOCK_HEADER_LEN;
+	memcpy(&sectors[fill][LOG_BLOCK_LEN_POS], &len, sizeof(len));
+	pending = fill;
+	fill ^= 1;
+	++block_seq;
+	start_block();
+	return true;
+}
+
+
+/**
+ * Pads the block and fills in its crc.
+ */
+static void seal_block(uint8_t *b) {
+	uint16_t len;
+	memcpy(&len, &b[LOG_BLOCK_LEN_POS], sizeof(len));
+	memset(&b[LOG_BLOCK_HEADER_LEN + len], 0, LOG_BLOCK_DATA_LEN - len);
+
+	uint16_t crc = 0xFFFF;
+	for (uint16_t i = 0; i < LOG_BLOCK_CRC_POS; ++i) {
+		crc = _crc_ccitt_update(crc, b[i]);
+	}
+	for (uint16_t i = LOG_BLOCK_HEADER_LEN; i < LOG_BLOCK_HEADER_LEN + len; ++i) {
+		crc = _crc_ccitt_update(crc, b[i]);
+	}
+	memcpy(&b[LOG_BLOCK_CRC_POS], &crc, sizeof(crc));
+}
+
 
+/**
+ * Appends data to the log. The data is kept in one block, so a record is
+ * never split, and must be at most LOG_BLOCK_DATA_LEN bytes. If it does not fit
+ * and the block can not be handed to log_service() yet, it is dropped.
+ * @return false if the data was dropped.
+ */
+bool log_append(const void *data, size_t n) {
+	if (n > (size_t)(SECTOR_SIZE - fill_len)) {
+		if (n > LOG_BLOCK_DATA_LEN || !swap_sectors()) {
+			++counters[LOG_OVERRUNS];
+			return false;
+		}
+	}
+
+	memcpy(&sectors[fill][fill_len], data, n);
+	fill_len += n;
+	++block_records[fill];
 	return true;
 }
 
 
-void log_append(void *data, size_t n) {
-	if (p.i + n > BUF_SIZE) {
-		const size_t reminder = n - ((p.i + n) - BUF_SIZE);
-		memcpy(&p.buf[p.i], data, reminder);
-		p.i += reminder;
-		n -= reminder;
-		data += reminder;
-		log_sync();
+/**
+ * Writes the sector filled by log_append(), if any, and syncs the file when
+ * the sync policy says so. Call it from the main loop outside the code that
+ * logs, so a slow card does not hold that up. It also writes the number of the
+ * next log to the EEPROM a byte at a time.
+ */
+void log_service(void) {
+	write_log_number();
+
+	// A full block is handed over here rather than by log_append(), so the
+	// next one starts after log_time() has settled the tick it starts from
+	if (pending == -1 && fill_len == SECTOR_SIZE) {
+		swap_sectors();
 	}
 
-	memcpy(&p.buf[p.i], data, n);
-	p.i += n;
+	if (pending != -1) {
+		seal_block(sectors[pending]);
+		if (!write_sector(sectors[pending])) {
+			++counters[LOG_ERRORS];
+		} else {
+			++counters[LOG_SECTORS];
+			records += block_records[pending];
+		}
+		pending = -1;
+		unsynced_bytes += SECTOR_SIZE;
+	} else if (grow_reservation()) {
+		return; // The sync can wait for the next call
+	}
+
+	const uint32_t now = get_tick();
+	if (unsynced_bytes != 0 &&
+	    ((sync_bytes != 0 && unsynced_bytes >= sync_bytes) ||
+	     (sync_interval != 0 && now - last_sync_tick >= sync_interval))) {
+		sync_log();
+		++counters[LOG_SYNCS];
+		unsynced_bytes = 0;
+		last_sync_tick = now;
+
+		if (now - last_catalog_tick >= LOG_CATALOG_INTERVAL) {
+			catalog_update(logged_size(), records);
+			last_catalog_tick = now;
+		}
+	}
 }
 
 
-static void log_sync(void) {
-	f_sync(&logfile);
-	flush_to_sd();
+/**
+ * Sets how often log_service() updates the FAT and directory entry of the log.
+ * Data written since the last sync is lost if the power is cut.
+ * @param interval ms between syncs, or 0 to not sync by time
+ * @param bytes Bytes written between syncs, or 0 to not sync by size
+ */
+void log_set_sync_policy(uint16_t interval, uint32_t bytes) {
+	sync_interval = interval;
+	sync_bytes = bytes;
+}
+
+
+uint16_t log_get_counter(enum log_counters counter) {
+	return counters[counter];
 }
 
 
@@ -153,17 +753,3 @@ bool file_write(FIL *f, uint8_t *buf, size_t len) {
 
 	return true;
 }
-
-
-unsigned int log_get_num_logs(void) {
-	char file_name[32] = {'\0'};
-
-	unsigned int i = 0;
-	while (1) {
-		sprintf_P(file_name, FMT_LOG_NAME, i++);
-
-		FILINFO info;
-		if (f_stat(file_name, &info) == FR_NO_FILE) break;
-	}
-	return i-1; // -1 because we incremented i before we checked the string
-}
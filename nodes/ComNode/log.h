@@ -26,17 +26,78 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <fatfs/ff.h>
+#include <system_messages.h>
+
+#define LOG_SYNC_INTERVAL	(1000) //!< Default ms between syncs of the log
+#define LOG_SYNC_BYTES		(16384) //!< Default bytes between syncs of the log
+#define LOG_RESERVE_SIZE	(16UL*1024*1024) //!< Most contiguous bytes reserved for a log
+#define LOG_RESERVE_STEP	(128UL*1024) //!< Contiguous bytes reserved at a time
+#define LOG_MOUNT_TIMEOUT	(2000) //!< ms to wait for the card at power up
+#define LOG_CATALOG_INTERVAL	(10000) //!< ms between updates of the catalog
+
+#define LOG_NUMBER_EEPROM	(0)  //!< EEPROM address of the next log number
+#define LOG_NUMBER_SLOTS	(16) //!< Slots the writes of it are spread over
+
+#define LOG_MAGIC		"ULOG"
+#define LOG_VERSION		(2)
+#define LOG_TIME_ID		(SYSTIME) //!< Id of the time records
+#define LOG_FIELD_LEN	(10) //!< Bytes of a field in the header
+#define LOG_MAX_FIELDS	(40)
+
+#define LOG_BLOCK_LEN			(512)
+#define LOG_BLOCK_SYNC			(0xB10C)
+#define LOG_BLOCK_HEADER_LEN	(16)
+#define LOG_BLOCK_DATA_LEN		(LOG_BLOCK_LEN - LOG_BLOCK_HEADER_LEN)
+
+//!< Position of the fields of a block header, see log.c
+enum log_block_pos {
+	LOG_BLOCK_SYNC_POS	= 0,  //!< u16 LOG_BLOCK_SYNC
+	LOG_BLOCK_LOG_POS	= 2,  //!< u16 number of the log
+	LOG_BLOCK_SEQ_POS	= 4,  //!< u32 number of the block in the log
+	LOG_BLOCK_TICK_POS	= 8,  //!< u32 tick of the last time record before it
+	LOG_BLOCK_LEN_POS	= 12, //!< u16 bytes of data
+	LOG_BLOCK_CRC_POS	= 14, //!< u16 CRC-CCITT of the header up to here and data
+};
+
+
+/**
+ * A field of the log as described in its header.
+ */
+struct log_field {
+	uint8_t id;   //!< enum message_id of the records
+	uint8_t type; //!< enum msg_type of the value
+	float scale;  //!< The physical value is value * scale + offset
+	float offset;
+};
+
+
+enum log_counters {
+	LOG_SECTORS,  //!< Sectors written to the card
+	LOG_SYNCS,    //!< Syncs of the FAT and directory entry
+	LOG_OVERRUNS, //!< Appends dropped because both sectors were full
+	LOG_ERRORS,   //!< Sectors that failed to be written
+
+	N_LOG_COUNTERS,
+};
 
 
 void log_init(void);
-void log_append(void *data, size_t n);
+void log_close(void);
+bool log_append(const void *data, size_t n);
+bool log_begin(uint8_t n_fields, void (*get_field)(uint8_t i, struct log_field *f));
+void log_time(uint32_t tick);
+void log_record(uint16_t id, const void *value, uint8_t len);
+void log_service(void);
+void log_set_sync_policy(uint16_t interval, uint32_t bytes);
+uint16_t log_get_counter(enum log_counters counter);
 uint32_t size_of_file(FIL *file);
 void create_file(FIL *file);
 bool open_file(FIL *f, uint16_t lognr, uint8_t mode);
 bool read_file(FIL *f, uint8_t *buf, size_t len);
 bool file_seek(FIL *f, size_t offset);
 bool file_write(FIL *f, uint8_t *buf, size_t len);
-unsigned log_get_num_logs(void);
+bool parse_log_name(const char *name, uint16_t *number);
 
 #endif /* LOG_H */
@@ -0,0 +1,250 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 UnicornRaceEngineering
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file log_catalog.c
+ * Catalog of the logs on the SD card, so they can be listed without walking
+ * the directory, with what only ComNode knows about them.
+ *
+ * CATALOG_NAME has an entry of CATALOG_ENTRY_LEN bytes for every log, at
+ * number * CATALOG_ENTRY_LEN:
+ *   entry = number:u16 size:u32 start:u32 records:u32 crc:u16
+ * crc is the CRC-CCITT (_crc_ccitt_update() from 0xFFFF) of the entry up to
+ * crc. An entry with a wrong crc or number is not a log, as the file is not
+ * zeroed when it is extended past its end. The entry of a new log is added when
+ * it is created and updated by log.c with its size and records as it is
+ * logged. If the file is not on the card it is built from the directory, with
+ * the time each log was last written as start and CATALOG_RECORDS_UNKNOWN
+ * records. Only ComNode keeps the catalog up to date, so it must be deleted
+ * with the logs if the card is cleared by other means.
+ */
+
+#include <fatfs/ff.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <util/crc16.h>
+
+#include "log.h"
+#include "log_catalog.h"
+
+
+static FIL catalog;
+static bool is_open;
+static uint16_t n_logs;
+static struct log_entry current; //!< Entry of the log being written
+static bool has_current;
+
+
+static uint16_t entry_crc(const uint8_t *b) {
+	uint16_t crc = 0xFFFF;
+	for (uint8_t i = 0; i < CATALOG_CRC_POS; ++i) {
+		crc = _crc_ccitt_update(crc, b[i]);
+	}
+	return crc;
+}
+
+
+static bool unpack(const uint8_t *b, uint16_t number, struct log_entry *e) {
+	uint16_t crc;
+	memcpy(&crc, &b[CATALOG_CRC_POS], sizeof(crc));
+	memcpy(&e->number, &b[CATALOG_NUMBER_POS], sizeof(e->number));
+	if (crc != entry_crc(b) || e->number != number) {
+		return false;
+	}
+	memcpy(&e->size, &b[CATALOG_SIZE_POS], sizeof(e->size));
+	memcpy(&e->start, &b[CATALOG_START_POS], sizeof(e->start));
+	memcpy(&e->records, &b[CATALOG_RECORDS_POS], sizeof(e->records));
+	return true;
+}
+
+
+/**
+ * Reads the entry of log number, if the catalog has it.
+ */
+static bool read_entry(uint16_t number, struct log_entry *e) {
+	const uint32_t ofs = (uint32_t)number * CATALOG_ENTRY_LEN;
+	// Seeking past the end of a file open for writing extends it
+	if (ofs >= f_size(&catalog) || f_lseek(&catalog, ofs) != FR_OK) {
+		return false;
+	}
+
+	uint8_t b[CATALOG_ENTRY_LEN];
+	unsigned br;
+	if (f_read(&catalog, b, sizeof(b), &br) != FR_OK || br != sizeof(b)) {
+		return false;
+	}
+	return unpack(b, number, e);
+}
+
+
+static bool write_entry(const struct log_entry *e) {
+	uint8_t b[CATALOG_ENTRY_LEN];
+	memcpy(&b[CATALOG_NUMBER_POS], &e->number, sizeof(e->number));
+	memcpy(&b[CATALOG_SIZE_POS], &e->size, sizeof(e->size));
+	memcpy(&b[CATALOG_START_POS], &e->start, sizeof(e->start));
+	memcpy(&b[CATALOG_RECORDS_POS], &e->records, sizeof(e->records));
+	const uint16_t crc = entry_crc(b);
+	memcpy(&b[CATALOG_CRC_POS], &crc, sizeof(crc));
+
+	unsigned bw;
+	return f_lseek(&catalog, (uint32_t)e->number * CATALOG_ENTRY_LEN) == FR_OK
+		&& f_write(&catalog, b, sizeof(b), &bw) == FR_OK && bw == sizeof(b);
+}
+
+
+/**
+ * Builds the catalog from the directory, for the logs made before it.
+ */
+static void build_catalog(void) {
+	DIR dir;
+	if (f_opendir(&dir, "") != FR_OK) {
+		return;
+	}
+
+	FILINFO info;
+	while (f_readdir(&dir, &info) == FR_OK && info.fname[0] != '\0') {
+		// Not straight into the entry, a packed member may be unaligned
+		uint16_t number;
+		if (parse_log_name(info.fname, &number)) {
+			const struct log_entry e = {
+				.number = number,
+				.size = info.fsize,
+				.start = ((uint32_t)info.fdate << 16) | info.ftime,
+				.records = CATALOG_RECORDS_UNKNOWN,
+			};
+			write_entry(&e);
+		}
+	}
+	f_closedir(&dir);
+	f_sync(&catalog);
+}
+
+
+/**
+ * Opens the catalog, or builds it if the card does not have it, and counts
+ * the logs in it. Call it when the card is mounted.
+ */
+void catalog_open(void) {
+	is_open = false;
+	has_current = false;
+	n_logs = 0;
+
+	FRESULT rc = f_open(&catalog, CATALOG_NAME, FA_READ|FA_WRITE|FA_OPEN_EXISTING);
+	if (rc == FR_NO_FILE) {
+		rc = f_open(&catalog, CATALOG_NAME, FA_READ|FA_WRITE|FA_CREATE_NEW);
+		if (rc == FR_OK) {
+			build_catalog();
+		}
+	}
+	if (rc != FR_OK) {
+		return;
+	}
+	is_open = true;
+
+	// One pass through the file, which is read a sector at a time
+	f_lseek(&catalog, 0);
+	uint8_t b[CATALOG_ENTRY_LEN];
+	unsigned br;
+	for (uint16_t number = 0;
+	     f_read(&catalog, b, sizeof(b), &br) == FR_OK && br == sizeof(b);
+	     ++number) {
+		struct log_entry e;
+		if (unpack(b, number, &e)) {
+			++n_logs;
+		}
+	}
+}
+
+
+/**
+ * Adds a new log to the catalog. It is the log catalog_update() updates.
+ */
+void catalog_add(uint16_t number) {
+	if (!is_open) {
+		return;
+	}
+
+	struct log_entry e;
+	if (!read_entry(number, &e)) {
+		++n_logs;
+	}
+	current = (struct log_entry){
+		.number = number,
+		.start = get_fattime(),
+	};
+	has_current = true;
+	write_entry(&current);
+	f_sync(&catalog);
+}
+
+
+/**
+ * Updates the entry of the log added last.
+ */
+void catalog_update(uint32_t size, uint32_t records) {
+	if (!is_open || !has_current) {
+		return;
+	}
+
+	current.size = size;
+	current.records = records;
+	write_entry(&current);
+	f_sync(&catalog);
+}
+
+
+uint16_t catalog_count(void) {
+	return n_logs;
+}
+
+
+/**
+ * Finds the first log in the catalog from number and up.
+ * @return false if there is none
+ */
+bool catalog_read(uint16_t number, struct log_entry *e) {
+	if (!is_open) {
+		return false;
+	}
+
+	const uint32_t ofs = (uint32_t)number * CATALOG_ENTRY_LEN;
+	if (ofs >= f_size(&catalog) || f_lseek(&catalog, ofs) != FR_OK) {
+		return false;
+	}
+
+	uint8_t b[CATALOG_ENTRY_LEN];
+	unsigned br;
+	while (f_read(&catalog, b, sizeof(b), &br) == FR_OK && br == sizeof(b)) {
+		if (unpack(b, number, e)) {
+			if (has_current && number == current.number) {
+				*e = current; // Logged since the catalog was updated
+			}
+			return true;
+		}
+		if (++number == 0) {
+			break;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,60 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 UnicornRaceEngineering
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef LOG_CATALOG_H
+#define LOG_CATALOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CATALOG_NAME		"LOGS.CAT"
+#define CATALOG_ENTRY_LEN	(16)
+#define CATALOG_RECORDS_UNKNOWN	(0xFFFFFFFF) //!< Log from before the catalog
+
+//!< Position of the fields of an entry in the catalog file, see log_catalog.c
+enum catalog_pos {
+	CATALOG_NUMBER_POS	= 0,  //!< u16 number of the log
+	CATALOG_SIZE_POS	= 2,  //!< u32 bytes
+	CATALOG_START_POS	= 6,  //!< u32 RTC time it was created, as get_fattime()
+	CATALOG_RECORDS_POS	= 10, //!< u32 records
+	CATALOG_CRC_POS		= 14, //!< u16 CRC-CCITT of the entry up to here
+};
+
+
+struct log_entry {
+	uint16_t number;  //!< Number of the log, LOG%u.DAT
+	uint32_t size;    //!< Bytes when it was last synced
+	uint32_t start;   //!< RTC time it was created, as get_fattime()
+	uint32_t records; //!< Records when it was last synced
+};
+
+
+void catalog_open(void);
+void catalog_add(uint16_t number);
+void catalog_update(uint32_t size, uint32_t records);
+uint16_t catalog_count(void);
+bool catalog_read(uint16_t number, struct log_entry *e);
+
+
+#endif /* LOG_CATALOG_H */
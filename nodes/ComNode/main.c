@@ -35,18 +35,14 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "protocol.h"
 
 
-static void set_msg_transport_rules(void);
-
-
 static void init(void) {
 	rtc_init();
 	sysclock_init();
 	ecu_init();
 	xbee_init();
-	log_init();
-	set_msg_transport_rules();
 
-	sei();
+	sei(); // log_init() polls the card with the sysclock
+	log_init();
 }
 
 int main(void) {
@@ -56,25 +52,3 @@ int main(void) {
 	return 0;
 }
 
-
-static void set_msg_transport_rules(void) {
-	set_msg_transport(ECU_MOTOR_OILTEMP    , XBEE + SD);
-	set_msg_transport(ECU_OIL_PRESSURE     , XBEE + SD);
-	set_msg_transport(ECU_STATUS_CHOKER_ADD, XBEE + SD);
-	set_msg_transport(ECU_WATER_TEMP       , XBEE + SD);
-	set_msg_transport(ECU_MANIFOLD_AIR_TEMP,        SD);
-	set_msg_transport(ECU_SPEEDER_POTMETER , XBEE + SD);
-	set_msg_transport(ECU_RPM              , XBEE + SD);
-	set_msg_transport(ECU_TRIGGER_ERR      ,        SD);
-	set_msg_transport(ECU_CAM_ANGLE1       ,        SD);
-	set_msg_transport(ECU_CAM_ANGLE2       ,        SD);
-	set_msg_transport(ECU_MAP_SENSOR       ,        SD);
-	set_msg_transport(ECU_BATTERY_V        , XBEE + SD);
-	set_msg_transport(ECU_LAMBDA_V         , XBEE + SD);
-	set_msg_transport(ECU_LOAD             ,        SD);
-	set_msg_transport(ECU_INJECTOR_TIME    ,        SD);
-	set_msg_transport(ECU_IGNITION_TIME    ,        SD);
-	set_msg_transport(ECU_GX               ,        SD);
-	set_msg_transport(ECU_GY               ,        SD);
-	set_msg_transport(ECU_GZ               ,        SD);
-}
@@ -33,11 +33,39 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "protocol.h"
 #include "xbee.h"
 #include "ecu.h"
+#include "ecu_decode.h"
 #include "log.h"
 #include "send_file.h"
+#include "send_catalog.h"
+
+/**
+ * With ECU_RAW_COUNTS the ECU fields are sent as the raw counts the ECU
+ * delivers, at their native width, instead of as converted floats:
+ *   record  = id:u8 raw:(u8|u16|i16|u32, little endian)
+ * ECU_PACKET_RATE records are sent every ECU_RATE_INTERVAL with the type of the
+ * message catalog. The width and the conversion of every ECU field is
+ * described once to the ground station after the handshake by schema records:
+ *   schema  = ECU_SCHEMA_ID:u8 n:u8 n * (id:u8 type:u8 scale:f32 offset:f32)
+ * where type is an enum msg_type and the physical value is
+ * raw * scale + offset. The log gets the same values as log_record()s, each
+ * packet after a log_time() of the tick, and the same schema in its header.
+ */
+#define ECU_RAW_COUNTS	(1) //!< 0 sends and logs every ECU value as a float
+#define ECU_SCHEMA_ID	(0xFF)
+#define ECU_SCHEMA_ENTRY_LEN	(10)
+#define ECU_SCHEMA_ENTRIES	((XBEE_PAYLOAD_LEN - 2) / ECU_SCHEMA_ENTRY_LEN)
+
+#define ECU_RATE_INTERVAL	(1000) //!< ms between reports of ECU_PACKET_RATE
+
+typedef char message_ids_must_fit_a_byte[(END_OF_LIST < ECU_SCHEMA_ID) ? 1 : -1];
 
 
 static bool livestream(void);
+static void stream_values(struct xbee_packet *p);
+static void stream_raw_counts(struct xbee_packet *p);
+static void send_ecu_schema(void);
+static void get_log_field(uint8_t i, struct log_field *f);
+static void report_packet_rate(void);
 static bool handle_packet(void);
 static void respond_to_handshake(void);
 static bool respond_to_request(struct xbee_packet *p);
@@ -51,22 +79,33 @@ static uint32_t tick;
 static uint32_t ecu_timeout;
 static uint32_t xbee_timeout;
 static uint32_t timeout_inc = 100;
+static uint32_t rate_tick;
+static uint16_t rate_packets;
 
 
 void event_loop(void) {
 	streaming = false;
 	set_ongoing_request(NONE);
 
+	log_begin(ECU_NB_VALUES + 1, get_log_field);
 	ecu_send_request();
 
 	ecu_timeout = get_tick() + 300;
+	rate_tick = get_tick();
+	rate_packets = ecu_get_counter(ECU_PACKETS);
 
 	/* Main work loop */
 	while(1){
 		tick = get_tick();
 		livestream();
+		report_packet_rate();
+		log_service();
 		handle_packet();
 
+		if (ongoing_request == NUM_LOG && continue_send_catalog()) {
+			reset_xbee_timeout();
+		}
+
 		if (ongoing_request != NONE) {
 			if (tick > xbee_timeout) {
 				if (timeout_inc == 600) {
@@ -128,6 +167,9 @@ static bool handle_packet(void) {
 static void respond_to_handshake(void) {
 	xbee_send_ACK();
 	streaming = true;
+	if (ECU_RAW_COUNTS) {
+		send_ecu_schema();
+	}
 }
 
 
@@ -138,7 +180,8 @@ static void handle_ack(const bool ack) {
 			eval_send_file_status();
 			break;
 		case NUM_LOG:
-			/* TODO */
+			eval_send_catalog_status();
+			break;
 		case NONE:
 			/* Do nothing. */
 			break;
@@ -149,7 +192,8 @@ static void handle_ack(const bool ack) {
 			resend_send_file();
 			break;
 		case NUM_LOG:
-			/* TODO */
+			resend_send_catalog();
+			break;
 		case NONE:
 			/* Do nothing. */
 			break;
@@ -170,8 +214,7 @@ static bool respond_to_request(struct xbee_packet *p) {
 	case REQUEST_FILE:
 		return initiate_send_file(p);
 	case NUM_LOG:
-		/* TODO */
-		return false;
+		return initiate_send_catalog(p);
 	default:
 		xbee_send_NACK();
 		return false;
@@ -179,35 +222,146 @@ static bool respond_to_request(struct xbee_packet *p) {
 }
 
 
-static bool livestream(void) {
-	if (ecu_has_packet()) {
-		ecu_send_request();
+/**
+ * Appends a record to the live stream packet and the log as transport says.
+ * The live stream gets the id as a u8 with ECU_RAW_COUNTS, else as a u16.
+ */
+static void emit(struct xbee_packet *p, const uint8_t transport, uint8_t id,
+                 void *value, uint8_t len) {
+	if (transport & XBEE) {
+		if (ECU_RAW_COUNTS) {
+			xbee_packet_append(p, &id, sizeof(id));
+		} else {
+			uint16_t tx_id = id;
+			xbee_packet_append(p, (uint8_t*)&tx_id, sizeof(tx_id));
+		}
+		xbee_packet_append(p, value, len);
+	}
+	if (transport & SD) {
+		log_record(id, value, len);
+	}
+}
+
+
+/**
+ * Fields of the log header: every ECU value and ECU_PACKET_RATE.
+ */
+static void get_log_field(uint8_t i, struct log_field *f) {
+	if (i < ECU_NB_VALUES) {
+		struct ecu_value_info info;
+		ecu_value_info(i, &info);
+		f->id = info.id;
+		f->type = ECU_RAW_COUNTS ? info.type : MSG_F32;
+		f->scale = ECU_RAW_COUNTS ? info.scale : 1.0;
+		f->offset = ECU_RAW_COUNTS ? info.offset : 0.0;
+	} else {
+		f->id = ECU_PACKET_RATE;
+		f->type = ECU_RAW_COUNTS ? get_msg_type(ECU_PACKET_RATE) : MSG_F32;
+		f->scale = 1.0;
+		f->offset = 0.0;
+	}
+}
 
-		uint16_t id = 52; // Old systime ID
-		log_append(&id, sizeof(id));
-		log_append(&tick, sizeof(tick));
 
+static void send_ecu_schema(void) {
+	enum ecu_value v = 0;
+	while (v < ECU_NB_VALUES) {
 		struct xbee_packet p = xbee_create_packet(LIVE_STREAM);
-		while (1) {
-			struct sensor data;
-			if (!ecu_read_data(&data)) {
-				break;
-			}
+		uint8_t header[2] = {ECU_SCHEMA_ID, ECU_NB_VALUES - v};
+		if (header[1] > ECU_SCHEMA_ENTRIES) {
+			header[1] = ECU_SCHEMA_ENTRIES;
+		}
+		xbee_packet_append(&p, header, sizeof(header));
 
-			uint16_t tx_id = data.id;
-			const uint8_t transport = get_msg_transport(tx_id);
+		for (uint8_t n = header[1]; n != 0; --n, ++v) {
+			struct ecu_value_info info;
+			ecu_value_info(v, &info);
 
-			if (transport & XBEE) {
-				/* WARNING: If lacking space in the packet, there is a chance
-				that the tx_id will be appended, but not it's associated data point */
-				xbee_packet_append(&p, (uint8_t*)&tx_id, sizeof(tx_id));
-				xbee_packet_append(&p, (uint8_t*)&data.value, sizeof(data.value));
-			}
+			uint8_t entry[ECU_SCHEMA_ENTRY_LEN] = {info.id, info.type};
+			memcpy(&entry[2], &info.scale, sizeof(info.scale));
+			memcpy(&entry[6], &info.offset, sizeof(info.offset));
+			xbee_packet_append(&p, entry, sizeof(entry));
+		}
 
-			if (transport & SD) {
-				log_append(&tx_id, sizeof(tx_id));
-				log_append(&data.value, sizeof(data.value));
-			}
+		xbee_send_packet(&p);
+	}
+}
+
+
+static void stream_values(struct xbee_packet *p) {
+	log_time(tick);
+
+	while (1) {
+		struct sensor data;
+		if (!ecu_read_data(&data)) {
+			break;
+		}
+
+		/* WARNING: If lacking space in the packet, there is a chance
+		that the tx_id will be appended, but not it's associated data point */
+		emit(p, get_msg_transport(data.id), data.id, &data.value,
+		     sizeof(data.value));
+	}
+}
+
+
+static void stream_raw_counts(struct xbee_packet *p) {
+	const uint8_t *packet = ecu_get_packet();
+
+	log_time(tick);
+	for (enum ecu_value v = 0; v < ECU_NB_VALUES; ++v) {
+		const uint8_t id = ecu_value_id(v);
+		const uint8_t transport = get_msg_transport(id) & (XBEE | SD);
+		if (transport) {
+			uint8_t raw[4];
+			const uint8_t len = ecu_value_raw(packet, v, raw);
+			emit(p, transport, id, raw, len);
+		}
+	}
+	ecu_release_packet();
+}
+
+
+/**
+ * Sends and logs the packets received from the ECU per minute, measured over
+ * the last ECU_RATE_INTERVAL.
+ */
+static void report_packet_rate(void) {
+	const uint32_t elapsed = tick - rate_tick;
+	if (elapsed < ECU_RATE_INTERVAL) {
+		return;
+	}
+
+	const uint16_t packets = ecu_get_counter(ECU_PACKETS);
+	const uint16_t rate = (uint16_t)(packets - rate_packets) * 60000UL / elapsed;
+	rate_tick = tick;
+	rate_packets = packets;
+
+	const uint8_t transport = get_msg_transport(ECU_PACKET_RATE) & (XBEE | SD);
+	struct xbee_packet p = xbee_create_packet(LIVE_STREAM);
+	if (ECU_RAW_COUNTS) {
+		emit(&p, transport, ECU_PACKET_RATE, (void*)&rate, sizeof(rate));
+	} else {
+		float value = rate;
+		emit(&p, transport, ECU_PACKET_RATE, &value, sizeof(value));
+	}
+	if (streaming && (transport & XBEE)) {
+		xbee_send_packet(&p);
+	}
+}
+
+
+/**
+ * Sends and logs the last packet from the ECU. The ECU is already sending the
+ * next one, it was requested as soon as this one was received.
+ */
+static bool livestream(void) {
+	if (ecu_has_packet()) {
+		struct xbee_packet p = xbee_create_packet(LIVE_STREAM);
+		if (ECU_RAW_COUNTS) {
+			stream_raw_counts(&p);
+		} else {
+			stream_values(&p);
 		}
 		if (streaming) {
 			xbee_send_packet(&p);
@@ -30,7 +30,7 @@ enum request_type {
 	/* Requests a file from the SD card. */
 	REQUEST_FILE,
 
-	/* Number of logs assuming all numbers from 0 to that exists. */
+	/* Lists the logs in the catalog, see send_catalog.c */
 	NUM_LOG,
 
 	/*  */
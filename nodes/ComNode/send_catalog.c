@@ -0,0 +1,146 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 UnicornRaceEngineering
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file send_catalog.c
+ * Lists the logs of the catalog over XBee in answer to a NUM_LOG request:
+ *   request = NUM_LOG:u8 [first:u16 [pages:u16]]
+ *   page    = count:u16 page:u16 n * (number:u16 size:u32 start:u32 records:u32)
+ * The logs are listed from number first, 0 if it is left out, in pages of at
+ * most CATALOG_PAGE_ENTRIES logs sent as RESPONCE packets. count is the number
+ * of logs in the catalog and page the index of the page from 0. The list ends
+ * with a page of fewer than CATALOG_PAGE_ENTRIES logs, or with page pages - 1.
+ * See log_catalog.h for the fields of a log.
+ *
+ * The pages are sent back to back, as fast as the XBee takes them, and only
+ * the last one is acked. A NACK or a timeout sends the last page again. ACK
+ * packets carry no page, so a page that was lost or broken is asked for again
+ * with first and pages: a missing page starts right after the last log of the
+ * page before it. Listing a catalog is then one round trip, plus one for every
+ * run of pages lost, instead of one for every page.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "send_catalog.h"
+#include "log_catalog.h"
+#include "xbee.h"
+#include "protocol.h"
+
+
+static bool send_page(void);
+
+
+static uint16_t page_first; //!< Number the page being sent starts from
+static uint16_t page;       //!< Index of the page being sent
+static uint16_t pages_left; //!< Pages still asked for, the current one too
+static bool done;           //!< The last page is sent and waits for an ACK
+
+
+bool initiate_send_catalog(struct xbee_packet *p) {
+	page_first = 0;
+	pages_left = UINT16_MAX;
+	if (p->len >= 3) {
+		memcpy(&page_first, &p->buf[1], sizeof(page_first));
+	}
+	if (p->len >= 5) {
+		memcpy(&pages_left, &p->buf[3], sizeof(pages_left));
+	}
+	page = 0;
+	done = (pages_left == 0);
+
+	set_ongoing_request(done ? NONE : NUM_LOG);
+	return !done;
+}
+
+
+/**
+ * Sends the page from page_first and moves on to the next one, unless it is
+ * the last page.
+ * @return false if the page was the last
+ */
+static bool send_page(void) {
+	struct xbee_packet p = xbee_create_packet(RESPONCE);
+	const uint16_t count = catalog_count();
+	xbee_packet_append(&p, (uint8_t*)&count, sizeof(count));
+	xbee_packet_append(&p, (uint8_t*)&page, sizeof(page));
+
+	uint16_t number = page_first;
+	uint8_t n = 0;
+	struct log_entry e;
+	while (n < CATALOG_PAGE_ENTRIES && catalog_read(number, &e)) {
+		uint8_t entry[CATALOG_PAGE_ENTRY_LEN];
+		memcpy(&entry[0], &e.number, sizeof(e.number));
+		memcpy(&entry[2], &e.size, sizeof(e.size));
+		memcpy(&entry[6], &e.start, sizeof(e.start));
+		memcpy(&entry[10], &e.records, sizeof(e.records));
+		xbee_packet_append(&p, entry, sizeof(entry));
+		++n;
+
+		number = e.number + 1;
+		if (number == 0) {
+			break;
+		}
+	}
+	xbee_send_packet(&p);
+
+	if (n < CATALOG_PAGE_ENTRIES || number == 0 || pages_left == 1) {
+		return false;
+	}
+	page_first = number;
+	++page;
+	--pages_left;
+	return true;
+}
+
+
+/**
+ * Sends the next page of the list if the XBee has room for it, from the main
+ * loop while NUM_LOG is ongoing.
+ * @return true if a page was sent
+ */
+bool continue_send_catalog(void) {
+	if (done || !xbee_can_send(CATALOG_PAGE_LEN)) {
+		return false;
+	}
+
+	done = !send_page();
+	return true;
+}
+
+
+void eval_send_catalog_status(void) {
+	// Only the last page is acked
+	if (done) {
+		set_ongoing_request(NONE);
+	}
+}
+
+
+void resend_send_catalog(void) {
+	if (done) {
+		send_page();
+	}
+}
@@ -0,0 +1,43 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 UnicornRaceEngineering
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef SEND_CATALOG_H
+#define SEND_CATALOG_H
+
+
+#include "xbee.h"
+
+#define CATALOG_PAGE_HEADER_LEN	(4)
+#define CATALOG_PAGE_ENTRY_LEN	(14)
+#define CATALOG_PAGE_ENTRIES	((XBEE_PAYLOAD_LEN - CATALOG_PAGE_HEADER_LEN) / CATALOG_PAGE_ENTRY_LEN)
+#define CATALOG_PAGE_LEN	(CATALOG_PAGE_HEADER_LEN + CATALOG_PAGE_ENTRIES * CATALOG_PAGE_ENTRY_LEN)
+
+
+bool initiate_send_catalog(struct xbee_packet *p);
+bool continue_send_catalog(void);
+void eval_send_catalog_status(void);
+void resend_send_catalog(void);
+
+
+#endif /* SEND_CATALOG_H */
@@ -0,0 +1,361 @@
+/**
+ * Host benchmark of ecu_decode.c.
+ *
+ * Compares ecu_read_data() as it was before the batch decoder (one field per
+ * call, the conversion picked by a switch, copied below) with ecu_decode().
+ * Both decode the same random packets. The 16 and 8 bit unsigned fields must
+ * agree to within the float resolution. The signed fields are checked
+ * against the two's complement value, which the old clamp() did not produce,
+ * and the 32 bit fields against the unsigned value, which the old path lost by
+ * shifting an int left by 24.
+ *
+ * Every field is also decoded over the whole raw range of its type, every
+ * value of the 8 and 16 bit fields and 65536 spread over the 32 bit ones, and
+ * checked against raw * scale + offset in double. The bound is the rounding of
+ * the raw count, the coefficients, the product and the sum to float.
+ *
+ * The raw counts, as ComNode streams and logs them, are checked to give the
+ * decoded values back when scaled with ecu_value_info(). Their cycles and the
+ * bytes logged per packet, as records of the log format in log.c, are compared
+ * with the floats as they were logged before.
+ *
+ * Build and run on the host:
+ *   gcc -std=gnu99 -O2 -I.. -I../../../libat90 -I../../../libat90/tests/host \
+ *       ecu_decode_bench.c ../ecu_decode.c ../../../libat90/system_messages.c \
+ *       -lm -o ecu_decode_bench
+ *   ./ecu_decode_bench
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define READ_CYCLES()	__rdtsc()
+#else
+#define READ_CYCLES()	0
+#endif
+
+#include "ecu_decode.h"
+
+#define N_PACKETS	(1UL << 16)
+#define N_RUNS		16
+
+
+/* ecu_read_data() before the batch decoder */
+static const int8_t ecu_packet[][2] = {
+	#define ECU_FIELD(id, type, scale, offset) {id, WIDTH_##type},
+	#define ECU_SKIP(len) {ECU_EMPTY, len},
+	#define WIDTH_U8	1
+	#define WIDTH_U16	2
+	#define WIDTH_I16	2
+	#define WIDTH_U32	4
+	#include "ecu_package_layout.inc"
+	#undef ECU_FIELD
+	#undef ECU_SKIP
+
+	/* End state, not an actual part of the data recieved */
+	{ECU_EMPTY, 0},
+};
+
+struct sensor {
+	enum message_id id;
+	float value;
+};
+
+static const uint8_t *old_packet;
+static uint8_t read_pos;
+static uint8_t data_count;
+
+static float clamp(float value) {
+	uint32_t u32;
+	memcpy(&u32, &value, sizeof(value));
+	u32 = (u32 > (1 << 15)) ? -(0xFFFF - u32) : u32;
+	memcpy(&value, &u32, sizeof(value));
+	return value;
+}
+
+static bool old_read_data(struct sensor *data) {
+	float raw_value = 0;
+	const uint8_t *packet = old_packet;
+
+	data->id = ecu_packet[data_count][0];
+	uint8_t len = ecu_packet[data_count][1];
+
+	if (!len) {
+		read_pos = 0;
+		data_count = 0;
+		return false;
+	}
+
+	if (data->id == ECU_EMPTY) {
+		read_pos += len;
+		++data_count;
+		data->id = ecu_packet[data_count][0];
+		len = ecu_packet[data_count][1];
+	}
+
+	while (len--) {
+		raw_value += packet[read_pos++] << (8 * len);
+	}
+
+	switch (data->id ) {
+	case ECU_STATUS_LAMBDA_V2:
+		raw_value = (70 - clamp(raw_value) / 64.0);
+		break;
+	case ECU_WATER_TEMP:
+	case ECU_MANIFOLD_AIR_TEMP:
+		raw_value = (raw_value * (-150.0 / 3840) + 120);
+		break;
+	case ECU_SPEEDER_POTMETER:
+		raw_value = ((raw_value - 336) / 26.9);
+		break;
+	case ECU_RPM:
+		raw_value = (raw_value * 0.9408);
+		break;
+	case ECU_MAP_SENSOR:
+		raw_value = (raw_value * 0.75);
+		break;
+	case ECU_BATTERY_V:
+		raw_value = (raw_value * (1.0 / 210) + 0);
+		break;
+	case ECU_LAMBDA_V:
+		raw_value = ((70 - clamp(raw_value) / 64.0) / 100);
+		break;
+	case ECU_INJECTOR_TIME:
+	case ECU_IGNITION_TIME:
+		raw_value = (-0.75 * raw_value + 120);
+		break;
+	case ECU_GX:
+	case ECU_GY:
+	case ECU_GZ:
+		raw_value = (clamp(raw_value) * (1.0 / 16384));
+		break;
+
+	default:
+		// No conversion
+		break;
+	}
+
+	data->value = raw_value;
+
+	++data_count;
+	return true;
+}
+
+
+static uint8_t packets[N_PACKETS][ECU_PACKET_LEN];
+static float sink;
+
+
+static bool was_wrong(enum message_id id) {
+	return id == ECU_STATUS_LAMBDA_V2 || id == ECU_LAMBDA_V ||
+	       id == ECU_GX || id == ECU_GY || id == ECU_GZ ||
+	       id == ECU_STATUS_TIME || id == ECU_STATUS_LAP_TIME;
+}
+
+
+static void check(const char *what, enum message_id id, float expect, float got) {
+	if (fabsf(expect - got) > 1e-3f + 1e-5f * fabsf(expect)) {
+		printf("%s: value of id %d is %f, expected %f\n", what, id, got, expect);
+		exit(1);
+	}
+}
+
+
+static void test_decode(void) {
+	float values[ECU_NB_VALUES];
+	struct sensor data;
+
+	for (unsigned long n = 0; n < 1024; ++n) {
+		old_packet = packets[n];
+		ecu_decode(packets[n], values);
+
+		uint8_t i = 0;
+		while (old_read_data(&data)) {
+			if (ecu_value_id(i) != data.id) {
+				printf("field %u is id %d, expected %d\n", i, ecu_value_id(i), data.id);
+				exit(1);
+			}
+			if (!was_wrong(data.id)) {
+				check("old path", data.id, data.value, values[i]);
+			}
+			++i;
+		}
+		if (i != ECU_NB_VALUES) {
+			printf("%u fields, expected %u\n", i, ECU_NB_VALUES);
+			exit(1);
+		}
+
+		const uint8_t *p = packets[n];
+		const int16_t gx = (int16_t)(p[96] << 8 | p[97]);
+		check("signed", ECU_GX, gx / 16384.0f, values[ECU_VALUE_ECU_GX]);
+		const int16_t lambda = (int16_t)(p[68] << 8 | p[69]);
+		check("signed", ECU_LAMBDA_V, (70 - lambda / 64.0f) / 100,
+		      values[ECU_VALUE_ECU_LAMBDA_V]);
+		const uint32_t time = (uint32_t)p[12] << 24 | (uint32_t)p[13] << 16 |
+		                      p[14] << 8 | p[15];
+		check("unsigned", ECU_STATUS_TIME, time, values[ECU_VALUE_ECU_STATUS_TIME]);
+	}
+}
+
+
+/**
+ * @return Offset of field i in the packet, from the layout before the decoder
+ */
+static uint8_t field_pos(uint8_t i) {
+	uint8_t pos = 0;
+	for (uint8_t n = 0; ecu_packet[n][1] != 0; ++n) {
+		if (ecu_packet[n][0] != ECU_EMPTY) {
+			if (i-- == 0) break;
+		}
+		pos += ecu_packet[n][1];
+	}
+	return pos;
+}
+
+
+static void test_ranges(void) {
+	uint8_t packet[ECU_PACKET_LEN];
+	float values[ECU_NB_VALUES];
+	double worst = 0;
+	float rpm_max = 0;
+
+	memcpy(packet, packets[0], sizeof(packet));
+	for (uint8_t i = 0; i < ECU_NB_VALUES; ++i) {
+		struct ecu_value_info info;
+		ecu_value_info(i, &info);
+		const uint8_t pos = field_pos(i);
+		const uint8_t width = (info.type == MSG_U8) ? 1 : (info.type == MSG_U32) ? 4 : 2;
+		const bool scaled = info.scale != 1.0f || info.offset != 0;
+
+		const uint32_t steps = (width == 1) ? 256 : 65536;
+		for (uint32_t k = 0; k < steps; ++k) {
+			const uint32_t u = (width == 4) ? k * 65537 : k;
+			for (uint8_t b = 0; b < width; ++b) {
+				packet[pos + b] = u >> (8 * (width - 1 - b));
+			}
+			ecu_decode(packet, values);
+
+			const double count = (info.type == MSG_I16) ? (double)(int16_t)u : (double)u;
+			const double expect = count * info.scale + info.offset;
+			// The count and the coefficients rounded to float, then the product
+			// and the sum
+			const double product = fabs(count * info.scale);
+			const double bound = !scaled ? fabs(expect) * ldexp(1, -24) :
+				3 * product * ldexp(1, -24) + fabs(info.offset) * ldexp(1, -24)
+				+ (product + fabs(info.offset)) * ldexp(1, -24);
+			const double err = fabs(values[i] - expect);
+			if (err > bound) {
+				printf("field %u (id %u) of raw %.0f is %f, expected %f\n", i,
+				       info.id, count, values[i], expect);
+				exit(1);
+			}
+			if (scaled && err / bound > worst) worst = err / bound;
+			if (info.id == ECU_RPM && values[i] > rpm_max) rpm_max = values[i];
+		}
+		memcpy(&packet[pos], &packets[0][pos], width);
+	}
+	printf("whole raw range of %u fields: scaled ones within %.0f%% of the "
+	       "bound, ECU_RPM up to %.1f\n", ECU_NB_VALUES, worst * 100, rpm_max);
+}
+
+
+static void test_raw(void) {
+	float values[ECU_NB_VALUES];
+
+	for (unsigned long n = 0; n < 1024; ++n) {
+		ecu_decode(packets[n], values);
+		for (uint8_t i = 0; i < ECU_NB_VALUES; ++i) {
+			struct ecu_value_info info;
+			uint8_t raw[4];
+			const uint8_t width = ecu_value_raw(packets[n], i, raw);
+			ecu_value_info(i, &info);
+
+			uint32_t u = 0;
+			for (uint8_t b = width; b-- > 0;) u = u << 8 | raw[b];
+			const uint8_t type_width = (info.type == MSG_U8) ? 1 :
+			                           (info.type == MSG_U32) ? 4 : 2;
+			if (width != type_width) {
+				printf("field %u is %u bytes, its type %u bytes\n", i, width, type_width);
+				exit(1);
+			}
+			const double count = (info.type == MSG_I16) ? (double)(int16_t)u : (double)u;
+			const double value = count * info.scale + info.offset;
+			check("raw counts", info.id, value, values[i]);
+		}
+	}
+}
+
+
+int main(void) {
+	srand(1);
+	for (unsigned long n = 0; n < N_PACKETS; ++n) {
+		for (int i = 0; i < ECU_PACKET_LEN; ++i) packets[n][i] = rand();
+	}
+
+	test_decode();
+	test_ranges();
+	test_raw();
+
+	uint64_t old_best = UINT64_MAX;
+	uint64_t new_best = UINT64_MAX;
+	uint64_t raw_best = UINT64_MAX;
+	for (int run = 0; run < N_RUNS; ++run) {
+		uint64_t cy = READ_CYCLES();
+		for (unsigned long n = 0; n < N_PACKETS; ++n) {
+			struct sensor data;
+			old_packet = packets[n];
+			while (old_read_data(&data)) sink += data.value;
+		}
+		cy = READ_CYCLES() - cy;
+		if (cy < old_best) old_best = cy;
+
+		cy = READ_CYCLES();
+		for (unsigned long n = 0; n < N_PACKETS; ++n) {
+			float values[ECU_NB_VALUES];
+			ecu_decode(packets[n], values);
+			for (int i = 0; i < ECU_NB_VALUES; ++i) sink += values[i];
+		}
+		cy = READ_CYCLES() - cy;
+		if (cy < new_best) new_best = cy;
+
+		cy = READ_CYCLES();
+		for (unsigned long n = 0; n < N_PACKETS; ++n) {
+			uint8_t raw[4];
+			for (int i = 0; i < ECU_NB_VALUES; ++i) {
+				if (get_msg_transport(ecu_value_id(i)) & SD) {
+					sink += ecu_value_raw(packets[n], i, raw) + raw[0];
+				}
+			}
+		}
+		cy = READ_CYCLES() - cy;
+		if (cy < raw_best) raw_best = cy;
+	}
+
+	// Bytes logged per packet: the tick and every field with the SD transport.
+	// In the log format the tick is a time record of the 65 ms since the last
+	// packet, a one byte id and a one byte varint.
+	unsigned float_bytes = sizeof(uint16_t) + sizeof(uint32_t);
+	unsigned raw_bytes = 1 + 1;
+	for (int i = 0; i < ECU_NB_VALUES; ++i) {
+		if (get_msg_transport(ecu_value_id(i)) & SD) {
+			uint8_t raw[4];
+			float_bytes += sizeof(uint16_t) + sizeof(float);
+			raw_bytes += sizeof(uint8_t) + ecu_value_raw(packets[0], i, raw);
+		}
+	}
+
+	printf("%-24s %8.1f cycles/packet\n", "ecu_read_data() per field",
+	       (double)old_best / N_PACKETS);
+	printf("%-24s %8.1f cycles/packet\n", "ecu_decode()",
+	       (double)new_best / N_PACKETS);
+	printf("%-24s %8.1f cycles/packet\n", "ecu_value_raw() SD fields",
+	       (double)raw_best / N_PACKETS);
+	printf("log bytes/packet: %u as floats, %u as log records\n", float_bytes, raw_bytes);
+	printf("%u fields, sink %g\n", ECU_NB_VALUES, sink);
+	return 0;
+}
@@ -0,0 +1,952 @@
+/**
+ * Host benchmark of log.c on a FAT16 disk image in a file.
+ *
+ * Logs the same stream of ECU packets three ways, each to its own file: with
+ * the logger as it was before (one sector buffer, f_sync() and f_write() from
+ * inside log_append(), copied below), with log.c writing through f_write(),
+ * and with log.c streaming to the clusters it reserves step by step. The time
+ * the main loop spends per packet and the commands sent to the card are
+ * measured, and the files are read back and checked against the stream. The
+ * image is synced to the disk on every f_sync(), like the card is, but the
+ * time the host spends in fdatasync() says nothing about the card and is left
+ * out. The most commands any one call sends to the card are given as well,
+ * which is what the worst case on the node depends on. The commands
+ * log_init() takes are compared with reserving LOG_RESERVE_SIZE at once, and a
+ * log whose next cluster is taken by another file is checked to go on with
+ * f_write().
+ *
+ * Then records are logged with log_time() and log_record() and the file is
+ * checked byte for byte against the log format. A copy of it can be written to
+ * the host to try ../tools/log_decode.c on. Records are also logged faster than
+ * log_service() writes them, and every time record that was not dropped must
+ * decode to its tick from the start of its block, as log_decode.c does it.
+ *
+ * Then the card is filled with logs and the commands it takes to create the
+ * next one are counted: probing every name like create_file() did before, and
+ * with the number kept in the EEPROM, which is stood in for by an array.
+ * Last the catalog of log_catalog.c is checked, the commands it takes to
+ * build, open and count it are compared with counting the logs with f_stat()
+ * as before, and it is listed in pages by send_catalog.c like for a NUM_LOG
+ * request, with a page that is lost and asked for again.
+ *
+ * Build and run on the host:
+ *   gcc -std=gnu99 -O2 -I.. -I../../../libat90 -I../../../libat90/tests/host \
+ *       -I../../../drivers -I../../../third_party/include log_bench.c \
+ *       ../../../third_party/src/fatfs/ff.c ../../../libat90/bson.c -o log_bench
+ *   ./log_bench [image [copy of the formatted log]]
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fatfs/diskio.h>
+#include <bson.h>
+#include <util/crc16.h>
+
+/* The EEPROM of the node, in place of eeprom.h */
+#define EEPROM_H
+static uint8_t eeprom[4096];
+static unsigned eeprom_writes[sizeof(eeprom)];
+
+static inline bool EEPROM_ready(void) {
+	return true;
+}
+
+static inline void EEPROM_write(uintptr_t address, uint8_t data) {
+	eeprom[address] = data;
+	++eeprom_writes[address];
+}
+
+static void EEPROM_read_buf(uintptr_t address, void *buf, size_t len) {
+	memcpy(buf, &eeprom[address], len);
+}
+
+#include "../log.c"
+#include "../log_catalog.c"
+
+
+#include "../xbee.h"
+#include "../protocol.h"
+
+
+/* XBee and protocol.c for send_catalog.c */
+
+#define SENT_LOG	(256)
+
+static struct xbee_packet sent[SENT_LOG]; //!< Packets in the order they were sent
+static unsigned packets_sent;
+static enum request_type ongoing;
+
+struct xbee_packet xbee_create_packet(enum xbee_packet_type type) {
+	return (struct xbee_packet){ .len = 0, .type = type, };
+}
+
+bool xbee_packet_append(struct xbee_packet *p, uint8_t *buf, size_t len) {
+	if (p->len + len > XBEE_PAYLOAD_LEN) return false;
+	memcpy(p->buf + p->len, buf, len);
+	p->len += len;
+	return true;
+}
+
+void xbee_send_packet(struct xbee_packet *p) {
+	if (packets_sent == SENT_LOG) {
+		printf("more than %u packets sent\n", SENT_LOG);
+		exit(1);
+	}
+	sent[packets_sent++] = *p;
+}
+
+bool xbee_can_send(uint8_t len) {
+	return true;
+}
+
+void set_ongoing_request(enum request_type type) {
+	ongoing = type;
+}
+
+#include "../send_catalog.c"
+
+#define IMG_SECTORS	(131072) // 64 MB
+#define PACKET_LEN	(62)     // Raw counts logged per ECU packet
+#define PACKET_MS	(65)     // ECU packet interval
+#define N_PACKETS	(20000)
+#define PACKETS_PER_BLOCK	(LOG_BLOCK_DATA_LEN / PACKET_LEN)
+
+
+static double now_us(void);
+
+static int img = -1;
+static uint32_t sim_tick;
+static unsigned disk_syncs;
+static double disk_sync_us; // Spent in fdatasync()
+static unsigned card_cmds; // Commands a card would get, not counting CMD55
+
+static struct {
+	uint32_t next;
+	uint32_t left;
+	bool open;
+} stream;
+
+
+/* Disk image glue for FatFs, in place of the SD card */
+
+DWORD get_fattime(void) {
+	return ((DWORD)(2015 - 1980) << 25) | ((DWORD)1 << 21) | ((DWORD)1 << 16);
+}
+
+DSTATUS disk_initialize(BYTE pdrv) {
+	return (pdrv == 0 && img >= 0) ? 0 : STA_NOINIT;
+}
+
+DSTATUS disk_status(BYTE pdrv) {
+	return disk_initialize(pdrv);
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count) {
+	stream.open = false;
+	++card_cmds;
+	const ssize_t len = (ssize_t)count * 512;
+	return (pread(img, buff, len, (off_t)sector * 512) == len) ? RES_OK : RES_ERROR;
+}
+
+DRESULT disk_write(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count) {
+	stream.open = false;
+	++card_cmds;
+	const ssize_t len = (ssize_t)count * 512;
+	return (pwrite(img, buff, len, (off_t)sector * 512) == len) ? RES_OK : RES_ERROR;
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
+	if (cmd == CTRL_SYNC) {
+		++disk_syncs;
+		const double t = now_us();
+		const int rc = fdatasync(img);
+		disk_sync_us += now_us() - t;
+		return (rc == 0) ? RES_OK : RES_ERROR;
+	}
+	return RES_PARERR;
+}
+
+uint32_t get_tick(void) {
+	return sim_tick;
+}
+
+
+/* Streams like mmc_sdcard.c, to the image */
+
+int8_t sd_stream_begin(uint32_t sector, uint32_t n) {
+	stream.next = sector;
+	stream.left = n;
+	stream.open = false;
+	return 0;
+}
+
+int8_t sd_stream_write(const uint8_t buf[SD_BLOCKSIZE]) {
+	if (stream.left == 0) return -1;
+	if (!stream.open) {
+		card_cmds += 2; // SET_WR_BLK_ERASE_COUNT and WRITE_MULTIPLE_BLOCK
+		stream.open = true;
+	}
+	if (pwrite(img, buf, SD_BLOCKSIZE, (off_t)stream.next * 512) != SD_BLOCKSIZE) return -1;
+	++stream.next;
+	--stream.left;
+	return 0;
+}
+
+int8_t sd_stream_end(void) {
+	stream.left = 0;
+	stream.open = false;
+	return 0;
+}
+
+
+static void put16(uint8_t *p, uint16_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+	put16(p, v);
+	put16(p + 2, v >> 16);
+}
+
+/**
+ * Formats the image as FAT16 with 2 kB clusters.
+ */
+static void format_image(void) {
+	const uint16_t fat_sectors = 128;
+	uint8_t bs[512] = {0xEB, 0x3C, 0x90, 'M', 'S', 'W', 'I', 'N', '4', '.', '1'};
+
+	put16(&bs[11], 512);         // Bytes per sector
+	bs[13] = 4;                  // Sectors per cluster
+	put16(&bs[14], 1);           // Reserved sectors
+	bs[16] = 2;                  // FATs
+	put16(&bs[17], 512);         // Root directory entries
+	bs[21] = 0xF8;               // Fixed disk
+	put16(&bs[22], fat_sectors);
+	put32(&bs[32], IMG_SECTORS);
+	bs[36] = 0x80;
+	bs[38] = 0x29;
+	memcpy(&bs[43], "NO NAME    FAT16   ", 19);
+	bs[510] = 0x55;
+	bs[511] = 0xAA;
+
+	if (ftruncate(img, 0) != 0 || ftruncate(img, (off_t)IMG_SECTORS * 512) != 0) {
+		perror("image");
+		exit(1);
+	}
+	pwrite(img, bs, sizeof(bs), 0);
+	const uint8_t fat[4] = {0xF8, 0xFF, 0xFF, 0xFF};
+	pwrite(img, fat, sizeof(fat), 512);
+	pwrite(img, fat, sizeof(fat), (1 + fat_sectors) * 512);
+}
+
+
+/* log_append() before the double buffering */
+
+static struct payload {
+	uint8_t buf[512];
+	size_t i;
+} old_p;
+
+static FIL old_file;
+
+static bool old_flush_to_sd(void) {
+	unsigned bw;
+	const FRESULT rc = f_write(&old_file, old_p.buf, old_p.i, &bw);
+	if((rc != FR_OK) || (bw != old_p.i)) {
+		return false;
+	}
+	old_p.i = 0;
+
+	return true;
+}
+
+static void old_log_sync(void) {
+	f_sync(&old_file);
+	old_flush_to_sd();
+}
+
+static void old_log_append(void *data, size_t n) {
+	if (old_p.i + n > 512) {
+		const size_t reminder = n - ((old_p.i + n) - 512);
+		memcpy(&old_p.buf[old_p.i], data, reminder);
+		old_p.i += reminder;
+		n -= reminder;
+		data += reminder;
+		old_log_sync();
+	}
+
+	memcpy(&old_p.buf[old_p.i], data, n);
+	old_p.i += n;
+}
+
+
+static double now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void make_packet(uint32_t n, uint8_t *packet) {
+	for (int i = 0; i < PACKET_LEN; ++i) packet[i] = (uint8_t)(n * 7 + i);
+}
+
+static uint16_t block_crc(const uint8_t *b) {
+	uint16_t len;
+	memcpy(&len, &b[LOG_BLOCK_LEN_POS], sizeof(len));
+	uint16_t crc = 0xFFFF;
+	for (int i = 0; i < LOG_BLOCK_CRC_POS; ++i) crc = _crc_ccitt_update(crc, b[i]);
+	for (int i = 0; i < len; ++i) crc = _crc_ccitt_update(crc, b[LOG_BLOCK_HEADER_LEN + i]);
+	return crc;
+}
+
+/**
+ * Reads a file back. With log >= 0 every sector must be a block of that log,
+ * in order and with the right crc, and only their data is returned.
+ */
+static size_t read_back(const char *name, int log, uint8_t *data, size_t max) {
+	FIL f;
+	if (f_open(&f, name, FA_READ) != FR_OK) {
+		printf("%s: can not open\n", name);
+		exit(1);
+	}
+
+	size_t len = 0;
+	uint8_t sector[512];
+	unsigned br;
+	for (uint32_t seq = 0; f_read(&f, sector, sizeof(sector), &br) == FR_OK && br != 0; ++seq) {
+		const uint8_t *d = sector;
+		uint16_t n = br;
+		if (log >= 0) {
+			uint16_t sync, block_log, crc;
+			uint32_t block_seq;
+			memcpy(&sync, &sector[LOG_BLOCK_SYNC_POS], sizeof(sync));
+			memcpy(&block_log, &sector[LOG_BLOCK_LOG_POS], sizeof(block_log));
+			memcpy(&block_seq, &sector[LOG_BLOCK_SEQ_POS], sizeof(block_seq));
+			memcpy(&n, &sector[LOG_BLOCK_LEN_POS], sizeof(n));
+			memcpy(&crc, &sector[LOG_BLOCK_CRC_POS], sizeof(crc));
+			if (br != 512 || sync != LOG_BLOCK_SYNC || block_log != log
+				|| block_seq != seq || n > LOG_BLOCK_DATA_LEN
+				|| crc != block_crc(sector)) {
+				printf("%s: block %u is not valid\n", name, seq);
+				exit(1);
+			}
+			d = &sector[LOG_BLOCK_HEADER_LEN];
+		}
+		if (len + n > max) {
+			printf("%s: more than %zu bytes\n", name, max);
+			exit(1);
+		}
+		memcpy(&data[len], d, n);
+		len += n;
+	}
+	f_close(&f);
+	return len;
+}
+
+/**
+ * Reads the file back and checks it against the packet stream.
+ */
+static void verify(const char *name, int log, uint32_t expect_len) {
+	static uint8_t data[N_PACKETS * PACKET_LEN];
+	const size_t len = read_back(name, log, data, sizeof(data));
+	if (len != expect_len) {
+		printf("%s: %zu bytes, expected %u\n", name, len, (unsigned)expect_len);
+		exit(1);
+	}
+
+	uint8_t packet[PACKET_LEN];
+	for (size_t i = 0; i < len; ++i) {
+		if (i % PACKET_LEN == 0) make_packet(i / PACKET_LEN, packet);
+		if (data[i] != packet[i % PACKET_LEN]) {
+			printf("%s: byte %zu differs\n", name, i);
+			exit(1);
+		}
+	}
+}
+
+static void report(const char *name, double total, double worst, unsigned most_cmds) {
+	printf("%-18s %5.2f us/packet mean %6.1f us worst %3u commands most %5u syncs "
+	       "%5u commands\n", name, total / N_PACKETS, worst, most_cmds,
+	       disk_syncs, card_cmds);
+	disk_syncs = card_cmds = 0;
+}
+
+/**
+ * Times a call of the main loop, without the time spent in fdatasync(), and
+ * counts the commands it sends to the card.
+ */
+#define TIME_CALL(call, total, worst, most_cmds) do { \
+	const double sync_us = disk_sync_us; \
+	const unsigned cmds = card_cmds; \
+	const double t = now_us(); \
+	call; \
+	const double dt = now_us() - t - (disk_sync_us - sync_us); \
+	total += dt; \
+	if (dt > worst) worst = dt; \
+	if (card_cmds - cmds > most_cmds) most_cmds = card_cmds - cmds; \
+} while (0)
+
+/**
+ * Logs the packets with log.c to the log that is open.
+ */
+static void run_log(const char *name) {
+	uint8_t packet[PACKET_LEN];
+	double total = 0, worst = 0;
+	unsigned most_cmds = 0;
+
+	memset(counters, 0, sizeof(counters));
+	disk_syncs = card_cmds = 0;
+	sim_tick = last_sync_tick = 0;
+	for (uint32_t n = 0; n < N_PACKETS; ++n) {
+		make_packet(n, packet);
+		sim_tick += PACKET_MS;
+		TIME_CALL((log_append(packet, sizeof(packet)), log_service()),
+		          total, worst, most_cmds);
+	}
+	report(name, total, worst, most_cmds);
+	if (log_get_counter(LOG_OVERRUNS) != 0 || log_get_counter(LOG_ERRORS) != 0
+		|| log_get_counter(LOG_SECTORS) != N_PACKETS / PACKETS_PER_BLOCK) {
+		printf("%u sectors, %u overruns, %u errors\n",
+		       log_get_counter(LOG_SECTORS), log_get_counter(LOG_OVERRUNS),
+		       log_get_counter(LOG_ERRORS));
+		exit(1);
+	}
+	log_close();
+}
+
+
+/**
+ * Logs to a new log while another file has taken the cluster after its first
+ * step, or after fewer clusters if the card had no more contiguous ones, so
+ * the log goes on with f_write() once those are used up.
+ */
+static void test_gap(void) {
+	log_init();
+	FIL gap;
+	unsigned bw;
+	if (f_open(&gap, "GAP.DAT", FA_CREATE_NEW | FA_WRITE) != FR_OK
+		|| f_write(&gap, "", 1, &bw) != FR_OK || f_close(&gap) != FR_OK) {
+		printf("can not create GAP.DAT\n");
+		exit(1);
+	}
+
+	const uint16_t number = log_number;
+	run_log("next cluster taken");
+	if (reserved.active || reserved.growing || reserved.sectors * 512 > LOG_RESERVE_STEP) {
+		printf("reserved %lu sectors past GAP.DAT\n", (unsigned long)reserved.sectors);
+		exit(1);
+	}
+	char name[16];
+	sprintf(name, "LOG%u.DAT", number);
+	verify(name, number, N_PACKETS * PACKET_LEN);
+}
+
+
+static const struct log_field format_fields[] = {
+	{ECU_RPM,        MSG_U16, 1.0,   0.0},
+	{ECU_WATER_TEMP, MSG_U8,  1.0,   -40.0},
+	{ECU_LAMBDA_V,   MSG_I16, 0.001, 0.0},
+	{ECU_TIME,       MSG_U32, 1.0,   0.0},
+};
+
+static void get_format_field(uint8_t i, struct log_field *f) {
+	*f = format_fields[i];
+}
+
+static size_t put_le(uint8_t *p, uint32_t v, size_t len) {
+	for (size_t i = 0; i < len; ++i) p[i] = v >> (8 * i);
+	return len;
+}
+
+/**
+ * Logs records in the log format to a new log and checks the file.
+ */
+static void test_format(const char *copy) {
+	enum { N = 1000 };
+	static uint8_t expect[N * 32];
+	size_t n_expect = 0;
+
+	sim_tick = 0;
+	log_init();
+	if (!log_begin(ARR_LEN(format_fields), get_format_field)) {
+		printf("log_begin failed\n");
+		exit(1);
+	}
+	if (log_begin(ARR_LEN(format_fields), get_format_field)) {
+		printf("log_begin after the header\n");
+		exit(1);
+	}
+
+	uint32_t t = 0;
+	for (uint32_t n = 0; n < N; ++n) {
+		const uint32_t dt = 65 + (n % 3) * 100; // One and two byte varints
+		t += dt;
+		log_time(t);
+		expect[n_expect++] = LOG_TIME_ID;
+		if (dt < 0x80) {
+			expect[n_expect++] = dt;
+		} else {
+			expect[n_expect++] = (dt & 0x7F) | 0x80;
+			expect[n_expect++] = dt >> 7;
+		}
+
+		const uint16_t rpm = n * 7;
+		const uint8_t temp = n;
+		const int16_t lambda = -(int16_t)n;
+		const uint32_t time = n * 100000;
+		log_record(ECU_RPM, &rpm, sizeof(rpm));
+		log_record(ECU_WATER_TEMP, &temp, sizeof(temp));
+		log_record(ECU_LAMBDA_V, &lambda, sizeof(lambda));
+		log_record(ECU_TIME, &time, sizeof(time));
+		expect[n_expect++] = ECU_RPM;
+		n_expect += put_le(&expect[n_expect], rpm, sizeof(rpm));
+		expect[n_expect++] = ECU_WATER_TEMP;
+		n_expect += put_le(&expect[n_expect], temp, sizeof(temp));
+		expect[n_expect++] = ECU_LAMBDA_V;
+		n_expect += put_le(&expect[n_expect], (uint16_t)lambda, sizeof(lambda));
+		expect[n_expect++] = ECU_TIME;
+		n_expect += put_le(&expect[n_expect], time, sizeof(time));
+		log_service();
+	}
+	log_close();
+
+	static uint8_t buf[sizeof(expect) + 512];
+	const size_t br = read_back("LOG2.DAT", 2, buf, sizeof(buf));
+
+	if (memcmp(buf, LOG_MAGIC, 4) != 0 || buf[4] != LOG_VERSION) {
+		printf("LOG2.DAT: no magic and version\n");
+		exit(1);
+	}
+	int32_t meta_len;
+	memcpy(&meta_len, &buf[5], sizeof(meta_len));
+	uint8_t fields[512];
+	struct bson_element e = {.key = "fields", .binary.data = fields};
+	if (find_key(&e, &buf[5], meta_len) < 0
+		|| e.binary.len != ARR_LEN(format_fields) * LOG_FIELD_LEN
+		|| fields[LOG_FIELD_LEN] != ECU_WATER_TEMP
+		|| fields[LOG_FIELD_LEN + 1] != MSG_U8) {
+		printf("LOG2.DAT: fields are wrong\n");
+		exit(1);
+	}
+	const size_t header = 5 + meta_len;
+	if (br != header + n_expect || memcmp(&buf[header], expect, n_expect) != 0) {
+		printf("LOG2.DAT: records are wrong\n");
+		exit(1);
+	}
+	printf("log format: %zu byte header, %.1f bytes/packet of 4 fields\n",
+	       header, (double)n_expect / N);
+
+	if (copy != NULL) {
+		FIL f;
+		FILE *out = fopen(copy, "wb");
+		uint8_t sector[512];
+		unsigned n;
+		if (out == NULL || f_open(&f, "LOG2.DAT", FA_READ) != FR_OK) {
+			perror(copy);
+			exit(1);
+		}
+		while (f_read(&f, sector, sizeof(sector), &n) == FR_OK && n != 0) {
+			fwrite(sector, 1, n, out);
+		}
+		f_close(&f);
+		fclose(out);
+	}
+}
+
+
+/**
+ * Logs time records among enough other records that the buffers overrun, and
+ * decodes the time of every block like log_decode.c.
+ */
+static void test_dropped_time(void) {
+	enum { N = 2000, SERVICE_EVERY = 8 };
+	static uint32_t kept[N];
+	unsigned n_kept = 0;
+
+	log_init();
+	const uint16_t number = log_number;
+	log_begin(ARR_LEN(format_fields), get_format_field);
+
+	const uint16_t overruns = log_get_counter(LOG_OVERRUNS);
+	uint32_t t = 0;
+	for (uint32_t n = 0; n < N; ++n) {
+		t += 65 + (n % 3) * 100;
+		const uint16_t before = log_get_counter(LOG_OVERRUNS);
+		log_time(t);
+		if (log_get_counter(LOG_OVERRUNS) == before) {
+			kept[n_kept++] = t;
+		}
+		// Varied so time records end blocks as well
+		for (uint16_t rpm = 0; rpm < 30 + n % 13; ++rpm) {
+			log_record(ECU_RPM, &rpm, sizeof(rpm));
+		}
+		if (n % SERVICE_EVERY == 0) {
+			log_service();
+		}
+	}
+	log_close();
+
+	char name[16];
+	sprintf(name, "LOG%u.DAT", number);
+	FIL f;
+	uint8_t b[512];
+	unsigned br;
+	unsigned k = 0;
+	if (f_open(&f, name, FA_READ) != FR_OK) {
+		printf("%s: can not open\n", name);
+		exit(1);
+	}
+	for (uint32_t seq = 0; f_read(&f, b, sizeof(b), &br) == FR_OK && br != 0; ++seq) {
+		uint32_t time;
+		uint16_t len;
+		memcpy(&time, &b[LOG_BLOCK_TICK_POS], sizeof(time));
+		memcpy(&len, &b[LOG_BLOCK_LEN_POS], sizeof(len));
+		size_t pos = LOG_BLOCK_HEADER_LEN;
+		if (seq == 0) {
+			int32_t meta_len;
+			memcpy(&meta_len, &b[pos + 5], sizeof(meta_len));
+			pos += 5 + meta_len;
+		}
+		while (pos < (size_t)LOG_BLOCK_HEADER_LEN + len) {
+			const uint8_t id = b[pos++];
+			if (id != LOG_TIME_ID) {
+				pos += sizeof(uint16_t);
+				continue;
+			}
+			uint32_t dt = 0;
+			for (uint8_t shift = 0; ; shift += 7) {
+				dt |= (uint32_t)(b[pos] & 0x7F) << shift;
+				if (!(b[pos++] & 0x80)) break;
+			}
+			time += dt;
+			if (k == n_kept || time != kept[k]) {
+				printf("%s: time record %u of block %u decodes to %u, expected %u\n",
+				       name, k, seq, (unsigned)time, (k < n_kept) ? (unsigned)kept[k] : 0);
+				exit(1);
+			}
+			++k;
+		}
+	}
+	f_close(&f);
+	if (k != n_kept || n_kept == N) {
+		printf("%s: %u time records of %u kept, %u read back\n", name, n_kept, N, k);
+		exit(1);
+	}
+	printf("dropped time records: %u of %u, %u overruns, the rest decode to their tick\n",
+	       N - n_kept, N, log_get_counter(LOG_OVERRUNS) - overruns);
+}
+
+
+/* create_file() before the log number was kept in the EEPROM */
+
+static void old_create_file(FIL *f) {
+	// increment filename until we have a new file that does not already exists.
+	char file_name[32] = {'\0'};
+	unsigned i = 0;
+	do {
+		sprintf_P(file_name, FMT_LOG_NAME, i++);
+		if (i > 1000) {
+			return;
+		}
+	} while (f_open(f, file_name, FA_CREATE_NEW|FA_WRITE) != FR_OK); //== FR_EXIST);
+}
+
+
+/**
+ * Reboots and creates the next log, which must get number expect.
+ * @param bytes Bytes of the stored log number written before the power is cut
+ * @return Commands sent to the card
+ */
+static unsigned boot_create(uint16_t expect, uint8_t bytes) {
+	FIL f;
+	memset(&eeprom_number, 0, sizeof(eeprom_number));
+	card_cmds = 0;
+	create_file(&f);
+	const unsigned cmds = card_cmds;
+	f_close(&f);
+	if (log_number != expect) {
+		printf("created log %u, expected %u\n", log_number, expect);
+		exit(1);
+	}
+	while (eeprom_number.left > sizeof(eeprom_number.slot) - bytes) {
+		write_log_number();
+	}
+	return cmds;
+}
+
+static void test_boot(void) {
+	enum { N_LOGS = 300 };
+	FIL f;
+
+	// Logs made without the EEPROM: it still says 3
+	for (unsigned n = 3; n < N_LOGS - 1; ++n) {
+		old_create_file(&f);
+		f_close(&f);
+	}
+	card_cmds = 0;
+	old_create_file(&f);
+	const unsigned probe_cmds = card_cmds;
+	f_close(&f);
+
+	const unsigned scan_cmds = boot_create(N_LOGS, sizeof(struct number_slot));
+	const unsigned eeprom_cmds = boot_create(N_LOGS + 1, sizeof(struct number_slot));
+
+	// Power cut while the number is written: the slot before says N_LOGS + 2,
+	// which is on the card, so the directory is read
+	boot_create(N_LOGS + 2, sizeof(struct number_slot) / 2);
+	boot_create(N_LOGS + 3, sizeof(struct number_slot));
+
+	memset(eeprom_writes, 0, sizeof(eeprom_writes));
+	for (unsigned n = 0; n < 4 * LOG_NUMBER_SLOTS; ++n) {
+		boot_create(N_LOGS + 4 + n, sizeof(struct number_slot));
+	}
+	for (unsigned i = 0; i < LOG_NUMBER_SLOTS * sizeof(struct number_slot); ++i) {
+		if (eeprom_writes[LOG_NUMBER_EEPROM + i] != 4) {
+			printf("EEPROM byte %u written %u times\n", i,
+			       eeprom_writes[LOG_NUMBER_EEPROM + i]);
+			exit(1);
+		}
+	}
+
+	printf("next of %u logs: %u commands probing names, %u reading the "
+	       "directory, %u from the EEPROM\n", N_LOGS, probe_cmds, scan_cmds,
+	       eeprom_cmds);
+}
+
+
+/* log_get_num_logs() before the catalog */
+
+static unsigned int old_get_num_logs(void) {
+	char file_name[32] = {'\0'};
+
+	unsigned int i = 0;
+	while (1) {
+		sprintf_P(file_name, FMT_LOG_NAME, i++);
+
+		FILINFO info;
+		if (f_stat(file_name, &info) == FR_NO_FILE) break;
+	}
+	return i-1; // -1 because we incremented i before we checked the string
+}
+
+
+/**
+ * Checks a page of the catalog sent by send_catalog.c. It must be page index
+ * and its logs must be numbered from next up.
+ * @return Logs in it
+ */
+static unsigned check_page(const struct xbee_packet *p, uint16_t count,
+                           uint16_t index, uint16_t *next) {
+	uint16_t page_count, page_index;
+	memcpy(&page_count, &p->buf[0], sizeof(page_count));
+	memcpy(&page_index, &p->buf[2], sizeof(page_index));
+	const unsigned n = (p->len - CATALOG_PAGE_HEADER_LEN) / CATALOG_PAGE_ENTRY_LEN;
+	if (p->type != RESPONCE || page_count != count || page_index != index
+		|| (p->len - CATALOG_PAGE_HEADER_LEN) % CATALOG_PAGE_ENTRY_LEN != 0) {
+		printf("page %u of the catalog is not valid\n", index);
+		exit(1);
+	}
+	for (unsigned i = 0; i < n; ++i) {
+		uint16_t number;
+		memcpy(&number, &p->buf[CATALOG_PAGE_HEADER_LEN + i * CATALOG_PAGE_ENTRY_LEN],
+		       sizeof(number));
+		if (number != (*next)++) {
+			printf("page has log %u, expected %u\n", number, *next - 1);
+			exit(1);
+		}
+	}
+	return n;
+}
+
+/**
+ * Serves a NUM_LOG request like the main loop does, the pages back to back.
+ * The last page times out once and is then acked.
+ * @return Pages sent, the last one twice
+ */
+static unsigned list_catalog(uint16_t first, uint16_t pages) {
+	struct xbee_packet req = { .len = 5, .type = REQUEST, .buf = {NUM_LOG} };
+	memcpy(&req.buf[1], &first, sizeof(first));
+	memcpy(&req.buf[3], &pages, sizeof(pages));
+	packets_sent = 0;
+	initiate_send_catalog(&req);
+	while (ongoing == NUM_LOG && continue_send_catalog());
+	resend_send_catalog();
+	eval_send_catalog_status();
+	if (ongoing != NONE || packets_sent < 2
+		|| memcmp(&sent[packets_sent - 1], &sent[packets_sent - 2],
+		          sizeof(sent[0])) != 0) {
+		printf("NUM_LOG did not end with its last page\n");
+		exit(1);
+	}
+	return packets_sent;
+}
+
+static void test_catalog(void) {
+	// LOG2.DAT of test_format()
+	struct log_entry e;
+	if (!catalog_read(2, &e) || e.number != 2 || e.records != 5 * 1000
+		|| e.size != 32 * 512) {
+		printf("catalog entry of LOG2.DAT is wrong\n");
+		exit(1);
+	}
+
+	// The logs test_boot() made the old way are only in a new catalog
+	const uint16_t n_logs = log_number + 1;
+	f_close(&catalog);
+	f_unlink(CATALOG_NAME);
+	card_cmds = 0;
+	catalog_open();
+	const unsigned build_cmds = card_cmds;
+	card_cmds = 0;
+	catalog_open();
+	const unsigned open_cmds = card_cmds;
+	card_cmds = 0;
+	const unsigned old_count = old_get_num_logs();
+	const unsigned old_cmds = card_cmds;
+	if (catalog_count() != n_logs || old_count != n_logs) {
+		printf("catalog has %u logs, f_stat() finds %u, expected %u\n",
+		       catalog_count(), old_count, n_logs);
+		exit(1);
+	}
+	FILINFO info;
+	if (!catalog_read(2, &e) || f_stat("LOG2.DAT", &info) != FR_OK
+		|| e.size != info.fsize || e.records != CATALOG_RECORDS_UNKNOWN
+		|| e.start != (((uint32_t)info.fdate << 16) | info.ftime)) {
+		printf("rebuilt entry of LOG2.DAT is wrong\n");
+		exit(1);
+	}
+
+	// NUM_LOG from log 0, where page LOST_PAGE does not arrive
+	enum { LOST_PAGE = 10 };
+	card_cmds = 0;
+	const unsigned pages = list_catalog(0, UINT16_MAX) - 1;
+	const unsigned page_cmds = card_cmds;
+	uint16_t next = 0;
+	uint16_t lost_first = 0;
+	for (unsigned i = 0; i < pages; ++i) {
+		if (i == LOST_PAGE) {
+			lost_first = next;
+			next += CATALOG_PAGE_ENTRIES;
+			continue;
+		}
+		check_page(&sent[i], n_logs, i, &next);
+	}
+	if (next != n_logs || pages != n_logs / CATALOG_PAGE_ENTRIES + 1) {
+		printf("NUM_LOG listed %u logs in %u pages, expected %u\n", next,
+		       pages, n_logs);
+		exit(1);
+	}
+
+	// The lost page asked for again, it starts after the last log before it
+	next = lost_first;
+	if (list_catalog(lost_first, 1) != 2
+		|| check_page(&sent[0], n_logs, 0, &next) != CATALOG_PAGE_ENTRIES) {
+		printf("lost page of NUM_LOG is wrong\n");
+		exit(1);
+	}
+
+	// From the last log
+	next = n_logs - 1;
+	if (list_catalog(n_logs - 1, UINT16_MAX) != 2
+		|| check_page(&sent[0], n_logs, 0, &next) != 1) {
+		printf("NUM_LOG from the last log is wrong\n");
+		exit(1);
+	}
+
+	printf("catalog of %u logs: %u commands to build, %u to open, %u to count "
+	       "with f_stat(), %u pages in 1 round trip with %u commands to list\n",
+	       n_logs, build_cmds, open_cmds, old_cmds, pages, page_cmds);
+}
+
+
+int main(int argc, char *argv[]) {
+	const char *path = (argc > 1) ? argv[1] : "log_bench.img";
+	img = open(path, O_RDWR | O_CREAT, 0644);
+	if (img < 0) {
+		perror(path);
+		return 1;
+	}
+	format_image();
+	memset(eeprom, 0xFF, sizeof(eeprom));
+
+	if (f_mount(&fs, "", 1) != FR_OK ||
+	    f_open(&old_file, "OLD.DAT", FA_CREATE_NEW | FA_WRITE) != FR_OK) {
+		printf("can not create OLD.DAT\n");
+		return 1;
+	}
+
+	uint8_t packet[PACKET_LEN];
+	double total = 0, worst = 0;
+	unsigned most_cmds = 0;
+	disk_syncs = card_cmds = 0;
+	for (uint32_t n = 0; n < N_PACKETS; ++n) {
+		make_packet(n, packet);
+		TIME_CALL(old_log_append(packet, sizeof(packet)), total, worst, most_cmds);
+	}
+	report("single buffer", total, worst, most_cmds);
+	f_close(&old_file);
+
+	// log.c without the reserved clusters
+	create_file(&logfile);
+	start_log();
+	run_log("f_write");
+
+	card_cmds = 0;
+	log_init();
+	const unsigned init_cmds = card_cmds;
+	if (!reserved.active || reserved.sectors * 512 != LOG_RESERVE_STEP) {
+		printf("no clusters reserved\n");
+		return 1;
+	}
+	run_log("streamed");
+
+	verify("OLD.DAT", -1, N_PACKETS * PACKET_LEN / 512 * 512);
+	verify("LOG0.DAT", 0, N_PACKETS * PACKET_LEN);
+	verify("LOG1.DAT", 1, N_PACKETS * PACKET_LEN);
+
+	// The clusters not used are free again
+	FATFS *vol;
+	DWORD free_clusters;
+	f_getfree("", &free_clusters, &vol);
+	const uint32_t cluster = vol->csize * 512;
+	const uint32_t log_size = N_PACKETS / PACKETS_PER_BLOCK * 512;
+	const uint32_t used = (N_PACKETS * PACKET_LEN / 512 * 512 + cluster - 1) / cluster
+		+ 2 * ((log_size + cluster - 1) / cluster) + 1; // and LOGS.CAT
+	if (free_clusters + used != vol->n_fatent - 2) {
+		printf("%lu clusters free, expected %lu\n", (unsigned long)free_clusters,
+		       (unsigned long)(vol->n_fatent - 2 - used));
+		return 1;
+	}
+
+	// Reserving all of LOG_RESERVE_SIZE at once, like log_init() did before
+	FIL f;
+	f_open(&f, "RESERVE.DAT", FA_CREATE_NEW | FA_WRITE);
+	card_cmds = 0;
+	const uint32_t all = grow_file(&f, LOG_RESERVE_SIZE);
+	f_sync(&f);
+	const unsigned all_cmds = card_cmds;
+	f_close(&f);
+	f_unlink("RESERVE.DAT");
+	if (all != LOG_RESERVE_SIZE) {
+		printf("%lu bytes reserved, expected %lu\n", (unsigned long)all,
+		       (unsigned long)LOG_RESERVE_SIZE);
+		return 1;
+	}
+	printf("log_init(): %u commands reserving %lu kB, %u reserving %lu kB at once\n",
+	       init_cmds, LOG_RESERVE_STEP / 1024, all_cmds, LOG_RESERVE_SIZE / 1024);
+
+	test_format((argc > 2) ? argv[2] : NULL);
+	test_boot();
+	test_catalog();
+	test_gap();
+	test_dropped_time();
+
+	close(img);
+	unlink(path);
+	return 0;
+}
@@ -0,0 +1,368 @@
+/**
+ * Decodes logs written by ComNode to CSV, and recovers what is left of torn
+ * ones. The input is a log file, LOG%u.DAT, or an image of the whole card. It
+ * is mapped into memory and every 512 byte block in it with the sync word and a
+ * valid crc is used, wherever it is, so blocks that were written to the card
+ * but never made it into the file are found too. See log.c for the format.
+ * Each block is decoded on its own with the header of its log, so a lost or
+ * torn block only loses its own records. Blocks missing from a log are
+ * reported on stderr, with the time from boot until the log was ready and until
+ * its first record.
+ *
+ * Blocks are searched for at every 512 bytes from the start of the input, as
+ * files and clusters are aligned to sectors on the card.
+ *
+ * Build and run on the host:
+ *   gcc -std=gnu99 -O2 -I../../../libat90 -I../../../libat90/tests/host \
+ *       -I../../../third_party/include log_decode.c ../../../libat90/bson.c \
+ *       -o log_decode
+ *   ./log_decode LOG0.DAT > LOG0.csv
+ *   ./log_decode -l 3 card.img > LOG3.csv
+ *
+ * Output, one line per record:
+ *   log,time_ms,id,value
+ */
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <util/crc16.h>
+
+#include <bson.h>
+
+#include "../log.h"
+
+#define MAX_IDS	256
+
+
+static struct field {
+	bool known;
+	uint8_t type;
+	float scale;
+	float offset;
+} fields[MAX_IDS];
+
+static struct block {
+	uint16_t log;
+	uint32_t seq;
+	uint32_t tick;
+	uint16_t len;
+	const uint8_t *data;
+} *blocks;
+
+static size_t n_blocks;
+
+
+static uint16_t rd16(const uint8_t *p) {
+	return p[0] | (p[1] << 8);
+}
+
+
+static uint32_t rd32(const uint8_t *p) {
+	return rd16(p) | ((uint32_t)rd16(&p[2]) << 16);
+}
+
+
+static uint8_t type_width(uint8_t type) {
+	switch (type) {
+		case MSG_U8:	return 1;
+		case MSG_U16:	// Fall through
+		case MSG_I16:	return 2;
+		case MSG_F32:	// Fall through
+		case MSG_U32:	return 4;
+		default:		return 0;
+	}
+}
+
+
+static double read_value(const uint8_t *p, uint8_t type) {
+	switch (type) {
+		case MSG_U8:	return p[0];
+		case MSG_U16:	return rd16(p);
+		case MSG_U32:	return rd32(p);
+		case MSG_I16:	return (int16_t)rd16(p);
+		case MSG_F32:	{ uint32_t u = rd32(p); float f; memcpy(&f, &u, sizeof(f)); return f; }
+		default:		return 0;
+	}
+}
+
+
+/**
+ * Reads a varint at *pos.
+ * @return false if it runs past the end
+ */
+static bool read_varint(const uint8_t *buf, size_t len, size_t *pos, uint32_t *v) {
+	*v = 0;
+	for (unsigned shift = 0; *pos < len && shift < 35; shift += 7) {
+		const uint8_t b = buf[(*pos)++];
+		*v |= (uint32_t)(b & 0x7F) << shift;
+		if (!(b & 0x80)) return true;
+	}
+	return false;
+}
+
+
+/**
+ * Checks that there is a valid block at b.
+ */
+static bool is_block(const uint8_t *b) {
+	if (rd16(&b[LOG_BLOCK_SYNC_POS]) != LOG_BLOCK_SYNC) return false;
+
+	const uint16_t len = rd16(&b[LOG_BLOCK_LEN_POS]);
+	if (len > LOG_BLOCK_DATA_LEN) return false;
+
+	uint16_t crc = 0xFFFF;
+	for (int i = 0; i < LOG_BLOCK_CRC_POS; ++i) crc = _crc_ccitt_update(crc, b[i]);
+	for (int i = 0; i < len; ++i) crc = _crc_ccitt_update(crc, b[LOG_BLOCK_HEADER_LEN + i]);
+	return crc == rd16(&b[LOG_BLOCK_CRC_POS]);
+}
+
+
+static void find_blocks(const uint8_t *buf, size_t len) {
+	size_t cap = 0;
+	for (size_t pos = 0; pos + LOG_BLOCK_LEN <= len; pos += LOG_BLOCK_LEN) {
+		const uint8_t *b = &buf[pos];
+		if (!is_block(b)) continue;
+
+		if (n_blocks == cap) {
+			cap = cap ? 2 * cap : 1024;
+			blocks = realloc(blocks, cap * sizeof(*blocks));
+			if (blocks == NULL) {
+				perror("realloc");
+				exit(1);
+			}
+		}
+		blocks[n_blocks++] = (struct block){
+			.log = rd16(&b[LOG_BLOCK_LOG_POS]),
+			.seq = rd32(&b[LOG_BLOCK_SEQ_POS]),
+			.tick = rd32(&b[LOG_BLOCK_TICK_POS]),
+			.len = rd16(&b[LOG_BLOCK_LEN_POS]),
+			.data = &b[LOG_BLOCK_HEADER_LEN],
+		};
+	}
+}
+
+
+static int compare_blocks(const void *a, const void *b) {
+	const struct block *x = a;
+	const struct block *y = b;
+	if (x->log != y->log) return (x->log < y->log) ? -1 : 1;
+	if (x->seq != y->seq) return (x->seq < y->seq) ? -1 : 1;
+	return (x->data < y->data) ? -1 : (x->data > y->data);
+}
+
+
+/**
+ * Reads the header of a log from the data of its first block.
+ * @return Length of the header, or 0 if it is not valid
+ */
+static size_t read_header(const struct block *b, int32_t *tick, int32_t *time_id,
+                          int32_t *ready) {
+	const size_t magic_len = sizeof(LOG_MAGIC) - 1;
+	if (b->len < magic_len + 1 + 5 || memcmp(b->data, LOG_MAGIC, magic_len) != 0) {
+		fprintf(stderr, "log %u: no header\n", b->log);
+		return 0;
+	}
+	if (b->data[magic_len] != LOG_VERSION) {
+		fprintf(stderr, "log %u: version %u, expected %u\n", b->log,
+		        b->data[magic_len], LOG_VERSION);
+		return 0;
+	}
+
+	uint8_t meta[LOG_BLOCK_DATA_LEN];
+	const int32_t meta_len = rd32(&b->data[magic_len + 1]);
+	if (meta_len < 5 || (size_t)meta_len > b->len - magic_len - 1) {
+		fprintf(stderr, "log %u: header is cut short\n", b->log);
+		return 0;
+	}
+	memcpy(meta, &b->data[magic_len + 1], meta_len);
+
+	uint8_t field_buf[LOG_BLOCK_DATA_LEN];
+	struct bson_element e_tick = {.key = "tick"};
+	struct bson_element e_time = {.key = "time"};
+	struct bson_element e_fields = {.key = "fields", .binary.data = field_buf};
+	if (find_key(&e_tick, meta, meta_len) < 0 || find_key(&e_time, meta, meta_len) < 0
+		|| find_key(&e_fields, meta, meta_len) < 0) {
+		fprintf(stderr, "log %u: header is missing tick, time or fields\n", b->log);
+		return 0;
+	}
+
+	memset(fields, 0, sizeof(fields));
+	for (int32_t i = 0; i + LOG_FIELD_LEN <= e_fields.binary.len; i += LOG_FIELD_LEN) {
+		struct field *f = &fields[field_buf[i]];
+		f->known = true;
+		f->type = field_buf[i + 1];
+		memcpy(&f->scale, &field_buf[i + 2], sizeof(f->scale));
+		memcpy(&f->offset, &field_buf[i + 6], sizeof(f->offset));
+	}
+
+	struct bson_element e_ready = {.key = "ready"};
+	if (find_key(&e_ready, meta, meta_len) >= 0) {
+		*ready = e_ready.int32;
+	}
+
+	*tick = e_tick.int32;
+	*time_id = e_time.int32;
+	return magic_len + 1 + meta_len;
+}
+
+
+/**
+ * Prints the records of a block.
+ * @return Time of the first record, or UINT64_MAX if there is none
+ */
+static uint64_t decode_block(const struct block *b, size_t pos, int32_t tick,
+                             int32_t time_id) {
+	uint64_t first = UINT64_MAX;
+	uint64_t time = b->tick;
+	while (pos < b->len) {
+		uint32_t id;
+		uint32_t dt;
+		if (!read_varint(b->data, b->len, &pos, &id)) break;
+
+		if (id == (uint32_t)time_id) {
+			if (!read_varint(b->data, b->len, &pos, &dt)) break;
+			time += dt;
+			continue;
+		}
+
+		const uint8_t width = (id < MAX_IDS && fields[id].known) ?
+			type_width(fields[id].type) : 0;
+		if (width == 0 || pos + width > b->len) {
+			fprintf(stderr, "log %u: unknown id %u in block %u\n", b->log, id, b->seq);
+			return first;
+		}
+		if (first == UINT64_MAX) {
+			first = time * tick;
+		}
+		const struct field *f = &fields[id];
+		printf("%u,%llu,%u,%.9g\n", b->log, (unsigned long long)time * tick, id,
+		       read_value(&b->data[pos], f->type) * f->scale + f->offset);
+		pos += width;
+	}
+	if (pos != b->len) {
+		fprintf(stderr, "log %u: block %u is cut short\n", b->log, b->seq);
+	}
+	return first;
+}
+
+
+/**
+ * Decodes the blocks of one log, first to last.
+ */
+static void decode_log(const struct block *b, size_t n) {
+	size_t missing = 0;
+	size_t conflicts = 0;
+	const uint32_t last = b[n - 1].seq;
+
+	int32_t tick = 1;
+	int32_t time_id = -1;
+	int32_t ready = -1;
+	uint64_t first = UINT64_MAX;
+	size_t header_len = 0;
+	if (b[0].seq == 0) {
+		header_len = read_header(&b[0], &tick, &time_id, &ready);
+	} else {
+		fprintf(stderr, "log %u: first block lost\n", b[0].log);
+	}
+	if (header_len == 0) {
+		fprintf(stderr, "log %u: %zu blocks can not be decoded\n", b[0].log, n);
+		return;
+	}
+
+	uint32_t next = 0;
+	for (size_t i = 0; i < n; ++i) {
+		if (i > 0 && b[i].seq == b[i - 1].seq) {
+			// An old copy, from a file that was deleted or a reused log number
+			if (b[i].len != b[i - 1].len
+				|| memcmp(b[i].data, b[i - 1].data, b[i].len) != 0) ++conflicts;
+			continue;
+		}
+		if (b[i].seq != next) {
+			fprintf(stderr, "log %u: blocks %u to %u missing\n", b[i].log, next,
+			        b[i].seq - 1);
+			missing += b[i].seq - next;
+		}
+		const uint64_t t = decode_block(&b[i], (b[i].seq == 0) ? header_len : 0,
+		                                tick, time_id);
+		if (first == UINT64_MAX) {
+			first = t;
+		}
+		next = b[i].seq + 1;
+	}
+
+	fprintf(stderr, "log %u: %u blocks, %zu missing", b[0].log, last + 1, missing);
+	if (conflicts != 0) {
+		fprintf(stderr, ", %zu conflicting copies ignored", conflicts);
+	}
+	if (ready >= 0) {
+		fprintf(stderr, ", ready %lld ms", (long long)ready * tick);
+	}
+	if (first != UINT64_MAX) {
+		fprintf(stderr, ", first record %llu ms after boot", (unsigned long long)first);
+	}
+	fputc('\n', stderr);
+}
+
+
+int main(int argc, char *argv[]) {
+	long only_log = -1;
+	int opt;
+	while ((opt = getopt(argc, argv, "l:")) != -1) {
+		if (opt == 'l') {
+			only_log = strtol(optarg, NULL, 0);
+		} else {
+			break;
+		}
+	}
+	if (optind != argc - 1) {
+		fprintf(stderr, "usage: %s [-l log] LOG.DAT|card.img\n", argv[0]);
+		return 1;
+	}
+
+	const char *path = argv[optind];
+	const int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		perror(path);
+		return 1;
+	}
+	if (st.st_size == 0) {
+		fprintf(stderr, "%s is empty\n", path);
+		return 1;
+	}
+	const uint8_t *buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (buf == MAP_FAILED) {
+		perror(path);
+		return 1;
+	}
+	madvise((void*)buf, st.st_size, MADV_SEQUENTIAL);
+
+	find_blocks(buf, st.st_size);
+	if (n_blocks == 0) {
+		fprintf(stderr, "%s: no blocks found\n", path);
+		return 1;
+	}
+	qsort(blocks, n_blocks, sizeof(*blocks), compare_blocks);
+
+	printf("log,time_ms,id,value\n");
+	for (size_t i = 0; i < n_blocks;) {
+		size_t n = 1;
+		while (i + n < n_blocks && blocks[i + n].log == blocks[i].log) ++n;
+		if (only_log < 0 || only_log == blocks[i].log) {
+			decode_log(&blocks[i], n);
+		}
+		i += n;
+	}
+
+	munmap((void*)buf, st.st_size);
+	close(fd);
+	free(blocks);
+	return 0;
+}
@@ -100,6 +100,16 @@ void xbee_send_packet(struct xbee_packet *p) {
 }
 
 
+/**
+ * @return true if a packet with len bytes of payload fits in the output buffer,
+ * so xbee_send_packet() does not wait for the usart to send it
+ */
+bool xbee_can_send(uint8_t len) {
+	/* Start sequence, header and checksum around the payload */
+	return ARR_LEN(buf_out) - 1 - usart1_output_buffer_bytes() >= (size_t)len + 3;
+}
+
+
 bool xbee_read_packet(struct xbee_packet *p) {
 	/* Return false if nothing has been recieved */
 	/* Note that we don't wait for the complete packet to arrive */
@@ -61,6 +61,7 @@ void xbee_send_ACK(void);
 void xbee_send_NACK(void);
 void xbee_send_RESEND(void);
 void xbee_send_packet(struct xbee_packet *p);
+bool xbee_can_send(uint8_t len);
 bool xbee_read_packet(struct xbee_packet *p);
 void xbee_set_flag_callback(void(*func)(enum xbee_flags));
 bool xbee_packet_append(struct xbee_packet *p, uint8_t *buf, size_t len);
@@ -30,18 +30,17 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "gps.h"      // for gps_fix, gps_coordinate
 
-#include <math.h>     // for round
 #include <stdbool.h>  // for bool, false, true
 #include <stddef.h>   // for size_t
 #include <stdint.h>   // for uint16_t, int16_t
 #include <stdio.h>    // for NULL, fgetc, FILE
-#include <stdlib.h>   // for strtod, strtoul
+#include <stdlib.h>   // for strtoul
 #include <string.h>   // for strlen, strncmp
 
 
 #define MAX_SENTENCE_LEN		(128)
 #define STARTS_WITH(pre, str)	(strncmp(pre, str, strlen(pre)) == 0)
-#define KNOTS_TO_KM(d) 			((d)*1.852)
+#define KNOTS_TO_KM(d) 			(((d) * 1852UL + 50000) / 100000) //!< d in 1/100 knots
 
 
 struct sentence {
@@ -85,6 +84,31 @@ static uint16_t str2uint(const char *s, size_t n) {
 }
 
 
+/**
+ * Convert a decimal string like "12.34" to hundredths, ignoring any further
+ * decimals.
+ * @param  s The string, ending at the first character that is not a digit.
+ * @return   The value in hundredths.
+ */
+static uint32_t str2hundredths(const char *s) {
+	uint32_t rc = 0;
+	while (*s >= '0' && *s <= '9') {
+		rc = rc * 10 + (*s++ - '0');
+	}
+	uint8_t decimals = 0;
+	if (*s == '.') {
+		++s;
+		for (; decimals < 2 && *s >= '0' && *s <= '9'; ++decimals) {
+			rc = rc * 10 + (*s++ - '0');
+		}
+	}
+	for (; decimals < 2; ++decimals) {
+		rc *= 10;
+	}
+	return rc;
+}
+
+
 /**
  * @brief
  * Parses a nmea_0183 RMC (Recommended Minimum Navigation Information) sentence
@@ -133,7 +157,8 @@ static int from_rmc(struct sentence *s, struct gps_fix *fix) {
 	fix->latitude.degrees = str2uint(&(s->str[lat_pos]), 2);
 	fix->latitude.minutes = str2uint(&(s->str[lat_pos+2]), 2);
 	if (s->str[lat_pos+4] != '.') return 1;
-	fix->latitude.seconds = (str2uint(&(s->str[lat_pos+5]), 4) / 10000.0) * 60.0;
+	// 1/10000 of a minute is 6 ms
+	fix->latitude.milliseconds = str2uint(&(s->str[lat_pos+5]), 4) * 6;
 	if (s->str[lat_pos+9] != ',') return 1;
 	fix->latitude.direction = s->str[lat_pos+10];
 
@@ -141,13 +166,12 @@ static int from_rmc(struct sentence *s, struct gps_fix *fix) {
 	fix->longitude.degrees = str2uint(&(s->str[lon_pos]), 3);
 	fix->longitude.minutes = str2uint(&(s->str[lon_pos+3]), 2);
 	if (s->str[lon_pos+5] != '.') return 1;
-	fix->longitude.seconds = (str2uint(&(s->str[lon_pos+6]), 4) / 10000.0) * 60.0;
+	fix->longitude.milliseconds = str2uint(&(s->str[lon_pos+6]), 4) * 6;
 	if (s->str[lon_pos+10] != ',') return 1;
 	fix->longitude.direction = s->str[lon_pos+11];
 
 	const int speed_pos = 45;
-	fix->speed = (int16_t)round(
-		KNOTS_TO_KM(strtod(&(s->str[speed_pos]), NULL)));
+	fix->speed = (int16_t)KNOTS_TO_KM(str2hundredths(&(s->str[speed_pos])));
 
 	return 0;
 }
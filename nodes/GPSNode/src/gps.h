@@ -38,14 +38,18 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define GPS_BAUDRATE	(4800)
 
 
+#define GPS_DD_SCALE	(10000000L) //!< DD are in 1e-7 degrees, about 1 cm
+
 /**
  * Converts a DMS (Degrees, Minutes Seconds) coordinate to a DD (Decimal Degree)
+ * in integer arithmetic. A millisecond of arc is 1e7 / 3600000 = 25 / 9 units,
+ * so the result is exact to within one unit.
  * @param  dms A pointer to a geographic coordinate in DMS format.
- * @return The converted DD value
+ * @return The converted DD value as an int32_t in 1 / GPS_DD_SCALE degrees
  */
-#define GPS_DMS_TO_DD(dms)	((double)((dms)->degrees + \
-									 ((dms)->minutes / 60.0) + \
-									 ((dms)->seconds / 3600.0)) * \
+#define GPS_DMS_TO_DD(dms)	((int32_t)((dms)->degrees * GPS_DD_SCALE + \
+									  ((dms)->minutes * 60000UL + \
+									   (dms)->milliseconds) * 25 / 9) * \
 										(((dms)->direction == 'N' || \
 										  (dms)->direction == 'E') \
 											? 1 : -1))
@@ -56,7 +60,7 @@ struct gps_coordinate {
 	char direction; //!< 'N'/'S' or 'E'/'W'
 	int16_t degrees;
 	uint8_t minutes;
-	double seconds;
+	uint16_t milliseconds; //!< The seconds, in ms
 };
 
 struct gps_fix {
@@ -57,8 +57,8 @@ int main(void) {
 	while(1){
 		if (gps_get_fix(&fix) == 0 ) {
 #if 0
-			float dd = GPS_DMS_TO_DD(&(fix.latitude));
-			uint8_t *dd_ptr = (uint8_t*)&dd; // We need a pointer to the float
+			int32_t dd = GPS_DMS_TO_DD(&(fix.latitude));
+			uint8_t *dd_ptr = (uint8_t*)&dd; // We need a pointer to the value
 											 // to split it up into 4 bytes
 
 			uint8_t data[13];
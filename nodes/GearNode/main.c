@@ -51,14 +51,37 @@ enum gear_dir {
 	DOWN = 2,
 };
 
+/**
+ * A shift moves the actuator until the gear stop button reports the end
+ * position, then back until the button is released again.
+ */
+enum shift_state {
+	IDLE,
+	NEUTRAL,      //!< The paddles only nudge the actuator
+	UP_TO_END,    //!< Shifting up, waiting for the end position
+	UP_RELEASE,   //!< Returning from an up shift, waiting for release
+	DOWN_TO_END,  //!< Shifting down, waiting for the end position
+	DOWN_RELEASE, //!< Returning from a down shift, waiting for release
+};
+
+#define CAN_BUDGET	( 4 ) //!< Frames handled per pass of the main loop
+
 static void gear(enum gear_dir dir);
 
 static void gear_up(void);
 static void gear_down(void);
+static void shift_timeout(void);
+
+static void on_paddle(const struct can_message *msg);
+static void on_neutral(const struct can_message *msg);
+static void on_gear_stop_button(const struct can_message *msg);
 
 static uint8_t buf_in[64];
 static uint8_t buf_out[64];
 
+static enum shift_state state = IDLE;
+static uint32_t deadline;
+
 static void init(void) {
 	usart1_init(115200, buf_in, ARR_LEN(buf_in), buf_out, ARR_LEN(buf_out));
 	sysclock_init();
@@ -72,10 +95,11 @@ static void init(void) {
 	SET_PIN_MODE(IGN_PORT, IGN_PIN, OUTPUT);
 	IGNITION_UNCUT();
 
-	can_subscribe(PADDLE_STATUS);
-	can_subscribe(NEUTRAL_ENABLED);
-	can_subscribe(GEAR_STOP_BUTTON);
+	can_on(PADDLE_STATUS, on_paddle);
+	can_on(NEUTRAL_ENABLED, on_neutral);
+	can_on(GEAR_STOP_BUTTON, on_gear_stop_button);
 	can_subscribe(RESET_GEAR_ESTIMATE);
+	can_update_filters();
 
 	sei();
 	puts_P(PSTR("Init complete\n\n"));
@@ -86,190 +110,146 @@ int main(void) {
 	init();
 
 	while (1) {
-//		if(usart1_has_data()) {
-//			char c = getchar();
-//
-//			switch (c) {
-//			case 27:
-//			case 91:
-//				continue;
-//				break;
-//			case 65:
-//				gear_up();
-//				printf("\n");
-//				break;
-//			case 66:
-//				gear_down();
-//				printf("\n");
-//				break;
-//			case '\r':
-//				printf("\r\n");
-//				break;
-//			default:
-//				break;
-//			}
-//		}
-
-		if (can_has_data()) {
-			struct can_message message;
-			read_message(&message);
-			switch (message.id) {
-			case PADDLE_STATUS:
-				if (message.data[0] == 1) {
-					gear_up();
-				}
-
-				if (message.data[0] == 0) {
-					gear_down();
-				}
-				break;
-			case NEUTRAL_ENABLED:
-				if (message.data[0] == 1) {
-					printf("NEUTRAL BUTTON ACTIVATED\n");
-					while(1) {
-						if (can_has_data()) {
-							struct can_message message;
-							read_message(&message);
-							switch (message.id) {
-							case PADDLE_STATUS:
-								if (message.data[0] == 1) {
-									gear(UP);
-									_delay_ms(30);
-									gear(STOP);
-								}
-
-								if (message.data[0] == 0) {
-									gear(DOWN);
-									_delay_ms(30);
-									gear(STOP);
-								}
-								break;
-							case NEUTRAL_ENABLED:
-								if (message.data[0] == 0) {
-									printf("NEUTRAL BUTTON DEACTIVATED\n");
-									goto NO_NEUTRAL;
-								}
-								break;
-							default:
-								break;
-							}
-						}
-					}
-				}
-				NO_NEUTRAL:
-				break;
-			default:
-				break;
-			}
-			can_init();
-		}
+		can_dispatch(CAN_BUDGET);
 
+		if (state != IDLE && state != NEUTRAL && get_tick() > deadline) {
+			shift_timeout();
+		}
 	}
 
 	return 0;
 }
 
 
-static void gear_up(void) {
-	printf("SHIFT UP\n");
-	IGNITION_CUT();
-	gear(UP);
+static void on_paddle(const struct can_message *msg) {
+	switch (state) {
+	case IDLE:
+		if (msg->data[0] == 1) {
+			gear_up();
+		}
 
-	uint32_t timer = get_tick() + 500;
+		if (msg->data[0] == 0) {
+			gear_down();
+		}
+		break;
+	case NEUTRAL:
+		if (msg->data[0] == 1) {
+			gear(UP);
+			_delay_ms(30);
+			gear(STOP);
+		}
 
-	while(1) {
-		if (get_tick() > timer) {
+		if (msg->data[0] == 0) {
+			gear(DOWN);
+			_delay_ms(30);
+			gear(STOP);
+		}
+		break;
+	default:
+		break; // Paddles are ignored while shifting
+	}
+}
+
+
+static void on_neutral(const struct can_message *msg) {
+	if (state == IDLE && msg->data[0] == 1) {
+		printf("NEUTRAL BUTTON ACTIVATED\n");
+		state = NEUTRAL;
+	} else if (state == NEUTRAL && msg->data[0] == 0) {
+		printf("NEUTRAL BUTTON DEACTIVATED\n");
+		state = IDLE;
+	}
+}
+
+
+static void on_gear_stop_button(const struct can_message *msg) {
+	switch (state) {
+	case UP_TO_END:
+		if (msg->data[0] == 2) {
 			gear(STOP);
 			IGNITION_UNCUT();
+			_delay_ms(50);
 			gear(DOWN);
+			deadline = get_tick() + 200;
+			state = UP_RELEASE;
+		}
+		break;
+	case UP_RELEASE:
+		if (msg->data[0] == 0) {
 			_delay_ms(100);
 			gear(STOP);
-			printf("DIDN'T REACH END\n");
-			return;
+			printf("PERFECT GEARSHIFT\n");
+			state = IDLE;
 		}
-
-		if (can_has_data()) {
-			struct can_message message;
-			read_message(&message);
-			if ((message.id == GEAR_STOP_BUTTON) && (message.data[0] == 2)) {
-				gear(STOP);
-				IGNITION_UNCUT();
-				_delay_ms(50);
-				gear(DOWN);
-
-				uint32_t timer2 = get_tick() + 200;
-				while(1) {
-					if (get_tick() > timer2) {
-						gear(STOP);
-						printf("FAILED TO RELEASE AFTER SHIFT\n");
-						return;
-					}
-
-					if (can_has_data()) {
-						struct can_message message;
-						read_message(&message);
-						if ((message.id == GEAR_STOP_BUTTON) && (message.data[0] == 0)) {
-							_delay_ms(100);
-							gear(STOP);
-							printf("PERFECT GEARSHIFT\n");
-							return;
-						}
-					}
-				}
-			}
+		break;
+	case DOWN_TO_END:
+		if (msg->data[0] == 1) {
+			gear(STOP);
+			_delay_ms(50);
+			gear(UP);
+			deadline = get_tick() + 200;
+			state = DOWN_RELEASE;
+		}
+		break;
+	case DOWN_RELEASE:
+		if (msg->data[0] == 0) {
+			gear(STOP);
+			gear(UP);
+			_delay_ms(150);
+			gear(STOP);
+			printf("PERFECT GEARSHIFT\n");
+			state = IDLE;
 		}
+		break;
+	default:
+		break;
 	}
 }
 
 
+static void gear_up(void) {
+	printf("SHIFT UP\n");
+	IGNITION_CUT();
+	gear(UP);
+	deadline = get_tick() + 500;
+	state = UP_TO_END;
+}
+
+
 static void gear_down(void) {
 	printf("SHIFT DOWN\n");
 	gear(DOWN);
+	deadline = get_tick() + 300;
+	state = DOWN_TO_END;
+}
 
-	uint32_t timer = get_tick() + 300;
 
-	while(1) {
-		if (get_tick() > timer) {
-			gear(STOP);
-			gear(UP);
-			_delay_ms(100);
-			gear(STOP);
-			printf("DIDN'T REACH END\n");
-			return;
-		}
-
-		if (can_has_data()) {
-			struct can_message message;
-			read_message(&message);
-			if ((message.id == GEAR_STOP_BUTTON) && (message.data[0] == 1)) {
-				gear(STOP);
-				_delay_ms(50);
-				gear(UP);
-
-				uint32_t timer2 = get_tick() + 200;
-				while(1) {
-					if (get_tick() > timer2) {
-						gear(STOP);
-						printf("FAILED TO RELEASE AFTER SHIFT\n");
-						return;
-					}
-
-					if (can_has_data()) {
-						struct can_message message;
-						read_message(&message);
-						if ((message.id == GEAR_STOP_BUTTON) && (message.data[0] == 0)) {
-							gear(STOP);
-							gear(UP);
-							_delay_ms(150);
-							gear(STOP);
-							printf("PERFECT GEARSHIFT\n");
-							return;
-						}
-					}
-				}
-			}
-		}
+static void shift_timeout(void) {
+	switch (state) {
+	case UP_TO_END:
+		gear(STOP);
+		IGNITION_UNCUT();
+		gear(DOWN);
+		_delay_ms(100);
+		gear(STOP);
+		printf("DIDN'T REACH END\n");
+		break;
+	case DOWN_TO_END:
+		gear(STOP);
+		gear(UP);
+		_delay_ms(100);
+		gear(STOP);
+		printf("DIDN'T REACH END\n");
+		break;
+	case UP_RELEASE:
+	case DOWN_RELEASE:
+		gear(STOP);
+		printf("FAILED TO RELEASE AFTER SHIFT\n");
+		break;
+	default:
+		break;
 	}
+	state = IDLE;
 }
 
 
@@ -31,6 +31,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <util/delay.h>
 #include <utils.h>            // for ARR_LEN, BIT_SET
 #include <can.h>
+#include <fixed.h>            // for q16_t, q16_map, q16_to_str, etc
 #include "system_messages.h"  // for message_id, etc
 
 
@@ -60,7 +61,10 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #define WHEEL_RADIUS	0.264
 #define PI 				3.1415926535
-#define WHEEL_CIRC		WHEEL_RADIUS * 2 * PI // Circumference in meters
+#define WHEEL_CIRC		(WHEEL_RADIUS * 2 * PI) // Circumference in meters
+
+// km/h at a hole per ms, 106.6. It must stay below 128 to fit a q24_t.
+#define KMPH_PR_HOLE_PR_MS	(WHEEL_CIRC * 3600.0 / HOLES_PR_WHEEL)
 
 
 void wheel_speed(enum message_id wheel_id, const uint32_t current_time, const uint16_t wheel_tick);
@@ -135,13 +139,19 @@ int main(void) {
 
 
 void wheel_speed(enum message_id wheel_id, const uint32_t duration, const uint16_t wheel_tick) {
-	const float holes_pr_ms = (float)wheel_tick / duration;
-	const float rpm = (1000.0 * 60.0) / (HOLES_PR_WHEEL / holes_pr_ms); // Convert ms to min
+	char s_holes[12], s_rpm[12], s_kmph[12], s_mps[12];
+
+	// Every tick within the duration adds the same speed
+	const struct q16_map kmph = {Q24(KMPH_PR_HOLE_PR_MS) / duration, 0, 0};
 
-	const float v_mps = WHEEL_CIRC * rpm / 60.0; // m/s
-	const float v_kmph  = v_mps * ((60.0*60.0)/1000.0); // km/h
+	const q16_t v_kmph = q16_map(wheel_tick, &kmph); // km/h
+	const q16_t v_mps = q16_scale(v_kmph, Q24(1000.0 / (60.0*60.0))); // m/s
+	const q16_t rpm = q16_scale(v_mps, Q24(60.0 / WHEEL_CIRC));
+	const q16_t holes_pr_s = q16_scale(rpm, Q24(HOLES_PR_WHEEL / 60.0));
 
-	printf("ticks: %4u, holes/s: %4.3f, rpm: %4.3f, v (km/h): %4.3f, v (m/s) %4.3f\n", wheel_tick, (double)holes_pr_ms*1000, (double)rpm, (double)v_kmph, (double)v_mps);
+	printf("ticks: %4u, holes/s: %s, rpm: %s, v (km/h): %s, v (m/s) %s\n", wheel_tick,
+	       q16_to_str(holes_pr_s, s_holes, 3), q16_to_str(rpm, s_rpm, 3),
+	       q16_to_str(v_kmph, s_kmph, 3), q16_to_str(v_mps, s_mps, 3));
 
 	//can_broadcast(wheel_id, (void*)&v_kmph);
 }
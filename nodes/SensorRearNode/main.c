@@ -34,6 +34,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <can.h>
 #include "system_messages.h"  // for message_id, etc
 #include <adc.h>
+#include <fixed.h>
 
 
 static uint8_t buf_in[64];
@@ -41,7 +42,7 @@ static uint8_t buf_out[64];
 
 
 void setup_thermistor(const uint8_t channel);
-float thermistor(const uint16_t rawADC);
+q16_t thermistor(const uint16_t rawADC);
 
 
 static void init(void) {
@@ -62,9 +63,10 @@ int main(void) {
 	setup_thermistor(ch2);
 
 	while(1) {
-		const float ch1_v = thermistor(adc_readChannel(ch1));
-		const float ch2_v = thermistor(adc_readChannel(ch2));
-		printf("ADC5: %5.3f | ADC6: %5.3f\n", ch1_v, ch2_v);
+		char ch1_v[12], ch2_v[12];
+		q16_to_str(thermistor(adc_readChannel(ch1)), ch1_v, 3);
+		q16_to_str(thermistor(adc_readChannel(ch2)), ch2_v, 3);
+		printf("ADC5: %s | ADC6: %s\n", ch1_v, ch2_v);
 		_delay_ms(100);
 	}
 
@@ -79,11 +81,24 @@ void setup_thermistor(const uint8_t channel) {
 }
 
 
-float thermistor(const uint16_t rawADC) {
-	float temp;
-	temp = log(10000.0 * ((1024.0 / rawADC - 1)));
-	temp = 1 / (0.001129148 + (0.000234125 + (0.0000000876741 * temp * temp)) * temp);
-	temp = temp - 273.15;            // Convert Kelvin to Celcius
-	//temp = (temp * 9.0) / 5.0 + 32.0; // Convert Celcius to Fahrenheit
-	return temp;
+/**
+ * Converts the reading of a 10k thermistor to degrees Celsius with the
+ * Steinhart-Hart equation. The resistance is in kOhm and the equation is
+ * scaled by 1000 so the values and coefficients keep their precision in fixed
+ * point.
+ */
+q16_t thermistor(const uint16_t rawADC) {
+	if (rawADC == 0) {
+		return Q16(-273.15); // Open circuit
+	}
+
+	const q16_t r_kohm = q16_div(q16_from_int(10 * (1024 - rawADC)), q16_from_int(rawADC));
+	const q16_t ln_r = q16_add(q16_ln(r_kohm), Q16(6.907755279)); // ln(1000 * r_kohm)
+	const q16_t ln_r3 = q16_mul(q16_mul(ln_r, ln_r), ln_r);
+
+	q16_t kilo_inv_t = Q16(1000 * 0.001129148);
+	kilo_inv_t = q16_add(kilo_inv_t, q16_scale(ln_r, Q24(1000 * 0.000234125)));
+	kilo_inv_t = q16_add(kilo_inv_t, q16_scale(ln_r3, Q24(1000 * 0.0000000876741)));
+
+	return q16_sub(q16_div(Q16(1000), kilo_inv_t), Q16(273.15)); // Convert Kelvin to Celcius
 }
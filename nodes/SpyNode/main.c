@@ -44,6 +44,7 @@ static void init(void) {
 	can_init();
 
 	can_subscribe_all();
+	can_update_filters();
 
 	sei();
 	puts_P(PSTR("Init complete\n\n"));
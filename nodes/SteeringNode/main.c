@@ -124,10 +124,12 @@ static void init(void) {
 	rot_init();
 	dip_init();
 
-	can_subscribe(CURRENT_GEAR);
-	can_subscribe(ECU_RPM);
-	can_subscribe(ECU_BATTERY_V);
-	can_subscribe(ECU_WATER_TEMP);
+	// We only ever care about the latest value of these
+	can_mailbox_enable(CURRENT_GEAR);
+	can_mailbox_enable(ECU_RPM);
+	can_mailbox_enable(ECU_BATTERY_V);
+	can_mailbox_enable(ECU_WATER_TEMP);
+	can_update_filters();
 
 	sei();
 	puts_P(PSTR("Init complete\n\n"));
@@ -146,37 +148,35 @@ int main(void) {
 	display_gear(fstate.gear);
 
 	while (1) {
-		while (can_has_data()) {
-			struct can_message msg;
-			read_message(&msg);
-			void* data = &msg.data[0];
-			switch (msg.id) {
-				case CURRENT_GEAR:
-					fstate.gear = *(uint8_t*)msg.data;
-					display_gear(fstate.gear);
-					break;
-				case ECU_RPM:
-					fstate.rpm = (int16_t)*(float*)data;
-					set_rpm(fstate.rpm);
-					break;
-				case ECU_BATTERY_V:
-					fstate.battery_volt = *(float*)data;
-					update_warning_light(WARN_BATTERY_VOLT_LED, fstate.battery_volt);
-					break;
-				case ECU_WATER_TEMP:
-					fstate.water_temp = *(float*)data;
-					update_warning_light(WARN_WATER_TEMP_LED, fstate.water_temp);
-					break;
-			}
+		struct can_message msg;
+		void* data = &msg.data[0];
+
+		if (can_get_latest(CURRENT_GEAR, &msg, NULL)) {
+			fstate.gear = *(uint8_t*)msg.data;
+			display_gear(fstate.gear);
+		}
+		if (can_get_latest(ECU_RPM, &msg, NULL)) {
+			fstate.rpm = (int16_t)*(float*)data;
+			set_rpm(fstate.rpm);
+		}
+		if (can_get_latest(ECU_BATTERY_V, &msg, NULL)) {
+			fstate.battery_volt = *(float*)data;
+			update_warning_light(WARN_BATTERY_VOLT_LED, fstate.battery_volt);
+		}
+		if (can_get_latest(ECU_WATER_TEMP, &msg, NULL)) {
+			fstate.water_temp = *(float*)data;
+			update_warning_light(WARN_WATER_TEMP_LED, fstate.water_temp);
 		}
 
-		// First lets store the current status of the paddleshifters
-		{
-			const uint8_t state = paddle_state();
-			if (state) {
-				can_broadcast(PADDLE_STATUS, (uint8_t [1]) {state} );
-				shiftlight_off();
-			}
+		// First lets store the current status of the paddleshifters. GearNode
+		// takes 1 as up and 0 as down, as sent by GearSensorNode.
+		const uint8_t state = paddle_state();
+		if (state & PADDLE_UP) {
+			can_broadcast(PADDLE_STATUS, (uint8_t [1]) {1} );
+			shiftlight_off();
+		} else if (state & PADDLE_DOWN) {
+			can_broadcast(PADDLE_STATUS, (uint8_t [1]) {0} );
+			shiftlight_off();
 		}
 
 		// Check if neutral enable button has changed state and broadcast the
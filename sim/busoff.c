@@ -0,0 +1,100 @@
+/**
+ * Bus off scenario. The transceiver of SteeringNode is faulty for a while, so
+ * every frame it sends ends in a bit error. The up paddle is pulled a few
+ * times during the fault, which drives the node error passive and then bus
+ * off. Once the fault is gone the frame that was in flight should still reach
+ * GearNode, without SteeringNode ever resetting its controller.
+ *
+ * Usage: busoff [bitrate]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim.h"
+#include "vcan.h"
+
+#define MS	( 1000000ull )
+
+#define FAULT_FROM	( 200 * MS )
+#define FAULT_TO	( 710 * MS )
+#define FIRST_PULL	( 250 * MS )
+#define PULL_EVERY	( 150 * MS )
+#define END_AT	( 900 * MS )
+
+static struct sim_node *steering;
+static struct sim_node *gear;
+
+static uint64_t shift_at;  //!< GearNode started pushing upwards
+
+
+static void on_frame(const struct vcan_frame *f) {
+	printf("%10.3f ms %-14s > id %3u len %u data %02x%s\n", f->start_ns / 1e6,
+	       sim_node_name(f->sender), f->id, f->len, f->data[0],
+	       f->acked ? "" : " (error)");
+}
+
+
+static void step(uint64_t now) {
+	static bool passive;
+	static bool bus_off;
+	static bool paddle;
+
+	vcan_set_faulty(steering, now >= FAULT_FROM && now < FAULT_TO);
+
+	// Pull the paddle for 10 ms every PULL_EVERY
+	const bool pull = now >= FIRST_PULL
+	                  && (now - FIRST_PULL) % PULL_EVERY < 10 * MS;
+	if (pull != paddle) {
+		sim_drive_pin(steering, 'E', 7, pull);
+		paddle = pull;
+	}
+
+	if ((vcan_tec(steering) >= 128) != passive) {
+		passive = !passive;
+		printf("%10.3f ms %-14s * %s\n", now / 1e6, sim_node_name(steering),
+		       passive ? "error passive" : "error active");
+	}
+	if (vcan_is_bus_off(steering) != bus_off) {
+		bus_off = !bus_off;
+		printf("%10.3f ms %-14s * %s\n", now / 1e6, sim_node_name(steering),
+		       bus_off ? "bus off" : "back on the bus");
+	}
+
+	if (shift_at == 0 && now >= FAULT_TO && sim_pin_level(gear, 'A', 1)
+	    && !sim_pin_level(gear, 'A', 0)) {
+		shift_at = now;
+	}
+}
+
+
+int main(int argc, char *argv[]) {
+	if (argc > 1) {
+		vcan_set_bitrate(strtoul(argv[1], NULL, 10));
+	}
+
+	steering = sim_add_node("SteeringNode", "./SteeringNode.so");
+	gear = sim_add_node("GearNode", "./GearNode.so");
+	if (steering == NULL || gear == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	sim_drive_pin(steering, 'E', 7, false);
+	sim_drive_pin(steering, 'E', 6, false);
+
+	sim_set_step_hook(step);
+	vcan_set_frame_hook(on_frame);
+	sim_run_until(END_AT);
+
+	const struct vcan_stats *st = vcan_stats();
+	printf("\n");
+	if (shift_at != 0) {
+		printf("fault over to actuator %8.3f ms\n", (shift_at - FAULT_TO) / 1e6);
+	} else {
+		printf("fault over to actuator never\n");
+	}
+	printf("frames                 %8u\n", st->frames);
+	printf("error frames           %8u\n", st->errors);
+
+	return shift_at != 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,86 @@
+/**
+ * Oversized DLC scenario. A device outside the simulated nodes sends frames
+ * to RxNode (rx_node.c), some with a DLC of 15. That is legal on the bus and
+ * still means 8 data bytes, so the driver must not take more than 8 bytes
+ * into a queue slot or mailbox. The frame with a DLC of 15 goes into the slot
+ * right before the oldest unread one, and into the mailbox right before
+ * another, so anything written past its 8 bytes shows up in those.
+ *
+ * Usage: dlc [bitrate]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "vcan.h"
+
+#include <system_messages.h>
+
+#define MS	( 1000000ull )
+
+#define FIRST_AT	( 100 * MS )  //!< RxNode is initialised by then
+#define REST_AT	( 200 * MS )
+#define READ_AT	( 300 * MS )
+#define END_AT	( 400 * MS )
+#define QUEUE_SIZE	( 8 )         //!< CAN_QUEUE_SIZE of RxNode
+#define LONG_DLC	( 15 )
+
+static struct sim_node *rx;
+
+
+static void on_frame(const struct vcan_frame *f) {
+	printf("%10.3f ms > id %3u dlc %2u data %02x%s\n", f->start_ns / 1e6,
+	       f->id, f->len, f->data[0], f->acked ? "" : " (no ack)");
+}
+
+
+static void inject(uint16_t id, uint8_t dlc, uint8_t value) {
+	uint8_t data[8];
+	memset(data, value, sizeof(data));
+	vcan_inject(id, dlc, data);
+}
+
+
+static void step(uint64_t now) {
+	static uint8_t phase;
+
+	if (phase == 0 && now >= FIRST_AT) {
+		inject(MSG_CAN_ID(PRIO_DIAGNOSTIC, HEARTBEAT), 0, 0);
+		++phase;
+	} else if (phase == 1 && now >= REST_AT) {
+		for (uint8_t n = 1; n <= QUEUE_SIZE; ++n) {
+			inject(MSG_CAN_ID(PRIO_DIAGNOSTIC, HEARTBEAT),
+			       (n < 8) ? n : LONG_DLC, n);
+		}
+		inject(MSG_CAN_ID(PRIO_STATUS, CURRENT_GEAR), 1, 0x42);
+		inject(MSG_CAN_ID(PRIO_DIAGNOSTIC, NODE_STATUS), LONG_DLC, 0x55);
+		++phase;
+	} else if (phase == 2 && now >= READ_AT) {
+		sim_drive_pin(rx, 'A', 0, true);
+		++phase;
+	}
+}
+
+
+int main(int argc, char *argv[]) {
+	if (argc > 1) {
+		vcan_set_bitrate(strtoul(argv[1], NULL, 10));
+	}
+
+	rx = sim_add_node("RxNode", "./RxNode.so");
+	if (rx == NULL) {
+		return EXIT_FAILURE;
+	}
+	vcan_set_frame_hook(on_frame);
+	sim_set_step_hook(step);
+	sim_run_until(END_AT);
+
+	const bool done = sim_pin_level(rx, 'B', 0);
+	const bool ok = sim_pin_level(rx, 'B', 1);
+	printf("RxNode %s\n", !done ? "did not check the frames"
+	                      : ok ? "got every frame as sent"
+	                      : "got frames that were not as sent");
+	return (done && ok) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
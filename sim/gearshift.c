@@ -0,0 +1,130 @@
+/**
+ * Paddle to actuator scenario. SteeringNode, GearNode and GearSensorNode run
+ * together on one simulated bus. The up paddle is pulled and the time until
+ * GearNode drives the actuator is measured, then GearSensorNode reports the
+ * end position and the release so the whole shift completes.
+ *
+ * Usage: gearshift [bitrate]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim.h"
+#include "vcan.h"
+
+#define MS	( 1000000ull )
+
+#define PADDLE_AT	( 300 * MS )  //!< All nodes are initialised by then
+#define TRAVEL_TIME	( 40 * MS )   //!< Time the actuator takes to the end stop
+#define RELEASE_TIME	( 20 * MS )   //!< Time it takes to get off the end stop
+#define END_AT	( 1000 * MS )
+
+static struct sim_node *steering;
+static struct sim_node *gear;
+static struct sim_node *sensor;
+
+static uint64_t shift_start;     //!< Actuator started pushing upwards
+static uint64_t return_start;    //!< Actuator started returning from the end
+static uint64_t shift_done;      //!< Actuator stopped after the release
+static uint64_t paddle_frame;    //!< PADDLE_STATUS is on the bus
+
+enum actuator { BRAKE, UP, DOWN, OFF };
+
+static enum actuator actuator(void) {
+	const bool ina = sim_pin_level(gear, 'A', 0);
+	const bool inb = sim_pin_level(gear, 'A', 1);
+	if (ina && inb) return BRAKE;
+	if (inb) return UP;
+	if (ina) return DOWN;
+	return OFF;
+}
+
+
+static void on_frame(const struct vcan_frame *f) {
+	printf("%10.3f ms %-14s > id %3u len %u data %02x%s\n", f->start_ns / 1e6,
+	       sim_node_name(f->sender), f->id, f->len, f->data[0],
+	       f->acked ? "" : " (no ack)");
+	if (paddle_frame == 0 && f->acked && f->start_ns >= PADDLE_AT
+	    && f->sender == steering) {
+		paddle_frame = f->end_ns;
+	}
+}
+
+
+static void step(uint64_t now) {
+	if (now < PADDLE_AT) return;
+
+	const enum actuator a = actuator();
+	if (shift_start == 0 && a == UP) {
+		shift_start = now;
+	} else if (shift_start != 0 && return_start == 0) {
+		if (now >= shift_start + TRAVEL_TIME) {
+			sim_drive_pin(sensor, 'F', 7, false); // Front stop button pressed
+		}
+		if (a == DOWN) {
+			return_start = now;
+		}
+	} else if (return_start != 0 && shift_done == 0) {
+		if (now >= return_start + RELEASE_TIME) {
+			sim_release_pin(sensor, 'F', 7);
+		}
+		if (a == BRAKE) {
+			shift_done = now;
+		}
+	}
+}
+
+
+int main(int argc, char *argv[]) {
+	if (argc > 1) {
+		vcan_set_bitrate(strtoul(argv[1], NULL, 10));
+	}
+
+	steering = sim_add_node("SteeringNode", "./SteeringNode.so");
+	gear = sim_add_node("GearNode", "./GearNode.so");
+	sensor = sim_add_node("GearSensorNode", "./GearSensorNode.so");
+	if (steering == NULL || gear == NULL || sensor == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	// The paddles have external pull downs
+	sim_drive_pin(steering, 'E', 7, false);
+	sim_drive_pin(steering, 'E', 6, false);
+
+	sim_set_step_hook(step);
+	vcan_set_frame_hook(on_frame);
+
+	sim_run_until(PADDLE_AT);
+	sim_drive_pin(steering, 'E', 7, true);
+	sim_run_until(END_AT);
+
+	const struct vcan_stats *st = vcan_stats();
+	printf("\n");
+	printf("bitrate               %u bit/s\n", vcan_bitrate());
+	if (paddle_frame != 0) {
+		printf("paddle to bus         %8.3f ms\n", (paddle_frame - PADDLE_AT) / 1e6);
+	}
+	if (shift_start != 0) {
+		printf("paddle to actuator    %8.3f ms\n", (shift_start - PADDLE_AT) / 1e6);
+	} else {
+		printf("paddle to actuator    never\n");
+	}
+	if (return_start != 0) {
+		printf("end stop to return    %8.3f ms\n",
+		       (return_start - shift_start - TRAVEL_TIME) / 1e6);
+	}
+	if (shift_done != 0) {
+		printf("whole shift           %8.3f ms\n", (shift_done - PADDLE_AT) / 1e6);
+	}
+	printf("bus load              %8.3f %%\n", 100.0 * st->busy_ns / sim_now());
+	printf("frames                %8u\n", st->frames);
+	printf("error frames          %8u\n", st->errors);
+	for (uint16_t id = 0; id < VCAN_MAX_ID; ++id) {
+		if (st->frames_by_id[id] != 0) {
+			printf("  id %3u              %8u\n", id, st->frames_by_id[id]);
+		}
+	}
+
+	return shift_done != 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,62 @@
+/**
+ * Host stand-in for <avr/interrupt.h> used by the simulator.
+ *
+ * An ISR becomes an ordinary function named after its vector, which the
+ * simulator looks up in the node firmware and calls when the interrupt is
+ * pending and the global interrupt flag in SREG is set.
+ */
+
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+#define _VECTOR(n)	__vector_ ## n
+
+#define INT0_vect	_VECTOR(1)
+#define INT1_vect	_VECTOR(2)
+#define INT2_vect	_VECTOR(3)
+#define INT3_vect	_VECTOR(4)
+#define INT4_vect	_VECTOR(5)
+#define INT5_vect	_VECTOR(6)
+#define INT6_vect	_VECTOR(7)
+#define INT7_vect	_VECTOR(8)
+#define TIMER2_COMP_vect	_VECTOR(9)
+#define TIMER2_OVF_vect	_VECTOR(10)
+#define TIMER1_CAPT_vect	_VECTOR(11)
+#define TIMER1_COMPA_vect	_VECTOR(12)
+#define TIMER1_COMPB_vect	_VECTOR(13)
+#define TIMER1_COMPC_vect	_VECTOR(14)
+#define TIMER1_OVF_vect	_VECTOR(15)
+#define TIMER0_COMP_vect	_VECTOR(16)
+#define TIMER0_OVF_vect	_VECTOR(17)
+#define CANIT_vect	_VECTOR(18)
+#define OVRIT_vect	_VECTOR(19)
+#define SPI_STC_vect	_VECTOR(20)
+#define USART0_RX_vect	_VECTOR(21)
+#define USART0_UDRE_vect	_VECTOR(22)
+#define USART0_TX_vect	_VECTOR(23)
+#define ANALOG_COMP_vect	_VECTOR(24)
+#define ADC_vect	_VECTOR(25)
+#define EE_READY_vect	_VECTOR(26)
+#define TIMER3_CAPT_vect	_VECTOR(27)
+#define TIMER3_COMPA_vect	_VECTOR(28)
+#define TIMER3_COMPB_vect	_VECTOR(29)
+#define TIMER3_COMPC_vect	_VECTOR(30)
+#define TIMER3_OVF_vect	_VECTOR(31)
+#define USART1_RX_vect	_VECTOR(32)
+#define USART1_UDRE_vect	_VECTOR(33)
+#define USART1_TX_vect	_VECTOR(34)
+#define TWI_vect	_VECTOR(35)
+#define SPM_READY_vect	_VECTOR(36)
+#define _VECTORS_SIZE	37
+
+#define ISR(vector, ...) \
+	void vector(void); \
+	void vector(void)
+
+#define sei()	(SREG |= (1 << SREG_I))
+#define cli()	(SREG &= ~(1 << SREG_I))
+#define reti()	return
+
+#endif /* SIM_AVR_INTERRUPT_H */
@@ -0,0 +1,558 @@
+/**
+ * Host stand-in for <avr/io.h> used by the simulator.
+ *
+ * Every register of the at90can128 is an access to the register file of the
+ * node that is currently running, through sim_sfr8() and sim_sfr16(). The
+ * addresses are the data memory addresses from the datasheet, so code that
+ * does pointer arithmetic on registers (like PIN_PORT() in io.h) still works.
+ * The CAN MOB registers are paged by CANPAGE as on the real controller.
+ */
+
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+
+#include <stdint.h>
+
+volatile uint8_t* sim_sfr8(uint16_t addr);
+volatile uint16_t* sim_sfr16(uint16_t addr);
+
+#define _SFR_MEM8(addr)	(*sim_sfr8(addr))
+#define _SFR_MEM16(addr)	(*sim_sfr16(addr))
+#define _SFR_IO8(addr)	_SFR_MEM8((addr) + 0x20)
+#define _SFR_IO16(addr)	_SFR_MEM16((addr) + 0x20)
+#define _BV(bit)	(1 << (bit))
+
+/* Ports */
+#define PINA	_SFR_MEM8(0x20)
+#define DDRA	_SFR_MEM8(0x21)
+#define PORTA	_SFR_MEM8(0x22)
+#define PINB	_SFR_MEM8(0x23)
+#define DDRB	_SFR_MEM8(0x24)
+#define PORTB	_SFR_MEM8(0x25)
+#define PINC	_SFR_MEM8(0x26)
+#define DDRC	_SFR_MEM8(0x27)
+#define PORTC	_SFR_MEM8(0x28)
+#define PIND	_SFR_MEM8(0x29)
+#define DDRD	_SFR_MEM8(0x2A)
+#define PORTD	_SFR_MEM8(0x2B)
+#define PINE	_SFR_MEM8(0x2C)
+#define DDRE	_SFR_MEM8(0x2D)
+#define PORTE	_SFR_MEM8(0x2E)
+#define PINF	_SFR_MEM8(0x2F)
+#define DDRF	_SFR_MEM8(0x30)
+#define PORTF	_SFR_MEM8(0x31)
+#define PING	_SFR_MEM8(0x32)
+#define DDRG	_SFR_MEM8(0x33)
+#define PORTG	_SFR_MEM8(0x34)
+
+#define PIN0	0
+#define PIN1	1
+#define PIN2	2
+#define PIN3	3
+#define PIN4	4
+#define PIN5	5
+#define PIN6	6
+#define PIN7	7
+#define PB0	0
+#define PB1	1
+#define PB2	2
+#define PB3	3
+#define PB4	4
+#define PB5	5
+#define PB6	6
+#define PB7	7
+
+/* Interrupt flags */
+#define TIFR0	_SFR_MEM8(0x35)
+#define TIFR1	_SFR_MEM8(0x36)
+#define TIFR2	_SFR_MEM8(0x37)
+#define TIFR3	_SFR_MEM8(0x38)
+#define EIFR	_SFR_MEM8(0x3C)
+#define EIMSK	_SFR_MEM8(0x3D)
+#define GPIOR0	_SFR_MEM8(0x3E)
+#define EECR	_SFR_MEM8(0x3F)
+#define EEDR	_SFR_MEM8(0x40)
+#define EEAR	_SFR_MEM16(0x41)
+#define EEARL	_SFR_MEM8(0x41)
+#define EEARH	_SFR_MEM8(0x42)
+#define GTCCR	_SFR_MEM8(0x43)
+#define TCCR0A	_SFR_MEM8(0x44)
+#define TCNT0	_SFR_MEM8(0x46)
+#define OCR0A	_SFR_MEM8(0x47)
+#define GPIOR1	_SFR_MEM8(0x4A)
+#define GPIOR2	_SFR_MEM8(0x4B)
+#define SPCR	_SFR_MEM8(0x4C)
+#define SPSR	_SFR_MEM8(0x4D)
+#define SPDR	_SFR_MEM8(0x4E)
+#define ACSR	_SFR_MEM8(0x50)
+#define SMCR	_SFR_MEM8(0x53)
+#define MCUSR	_SFR_MEM8(0x54)
+#define MCUCR	_SFR_MEM8(0x55)
+#define SPMCSR	_SFR_MEM8(0x57)
+#define RAMPZ	_SFR_MEM8(0x5B)
+#define SPL	_SFR_MEM8(0x5D)
+#define SPH	_SFR_MEM8(0x5E)
+#define SREG	_SFR_MEM8(0x5F)
+#define WDTCR	_SFR_MEM8(0x60)
+#define CLKPR	_SFR_MEM8(0x61)
+#define OSCCAL	_SFR_MEM8(0x66)
+#define EICRA	_SFR_MEM8(0x69)
+#define EICRB	_SFR_MEM8(0x6A)
+#define TIMSK0	_SFR_MEM8(0x6E)
+#define TIMSK1	_SFR_MEM8(0x6F)
+#define TIMSK2	_SFR_MEM8(0x70)
+#define TIMSK3	_SFR_MEM8(0x71)
+#define XMCRA	_SFR_MEM8(0x74)
+#define XMCRB	_SFR_MEM8(0x75)
+
+/* ADC */
+#define ADC	_SFR_MEM16(0x78)
+#define ADCW	_SFR_MEM16(0x78)
+#define ADCL	_SFR_MEM8(0x78)
+#define ADCH	_SFR_MEM8(0x79)
+#define ADCSRA	_SFR_MEM8(0x7A)
+#define ADCSRB	_SFR_MEM8(0x7B)
+#define ADMUX	_SFR_MEM8(0x7C)
+#define DIDR0	_SFR_MEM8(0x7E)
+#define DIDR1	_SFR_MEM8(0x7F)
+
+/* Timer 1 */
+#define TCCR1A	_SFR_MEM8(0x80)
+#define TCCR1B	_SFR_MEM8(0x81)
+#define TCCR1C	_SFR_MEM8(0x82)
+#define TCNT1	_SFR_MEM16(0x84)
+#define TCNT1L	_SFR_MEM8(0x84)
+#define TCNT1H	_SFR_MEM8(0x85)
+#define ICR1	_SFR_MEM16(0x86)
+#define ICR1L	_SFR_MEM8(0x86)
+#define ICR1H	_SFR_MEM8(0x87)
+#define OCR1A	_SFR_MEM16(0x88)
+#define OCR1AL	_SFR_MEM8(0x88)
+#define OCR1AH	_SFR_MEM8(0x89)
+#define OCR1B	_SFR_MEM16(0x8A)
+#define OCR1BL	_SFR_MEM8(0x8A)
+#define OCR1BH	_SFR_MEM8(0x8B)
+#define OCR1C	_SFR_MEM16(0x8C)
+#define OCR1CL	_SFR_MEM8(0x8C)
+#define OCR1CH	_SFR_MEM8(0x8D)
+
+/* Timer 3 */
+#define TCCR3A	_SFR_MEM8(0x90)
+#define TCCR3B	_SFR_MEM8(0x91)
+#define TCCR3C	_SFR_MEM8(0x92)
+#define TCNT3	_SFR_MEM16(0x94)
+#define TCNT3L	_SFR_MEM8(0x94)
+#define TCNT3H	_SFR_MEM8(0x95)
+#define ICR3	_SFR_MEM16(0x96)
+#define ICR3L	_SFR_MEM8(0x96)
+#define ICR3H	_SFR_MEM8(0x97)
+#define OCR3A	_SFR_MEM16(0x98)
+#define OCR3AL	_SFR_MEM8(0x98)
+#define OCR3AH	_SFR_MEM8(0x99)
+#define OCR3B	_SFR_MEM16(0x9A)
+#define OCR3BL	_SFR_MEM8(0x9A)
+#define OCR3BH	_SFR_MEM8(0x9B)
+#define OCR3C	_SFR_MEM16(0x9C)
+#define OCR3CL	_SFR_MEM8(0x9C)
+#define OCR3CH	_SFR_MEM8(0x9D)
+
+/* Timer 2 */
+#define TCCR2A	_SFR_MEM8(0xB0)
+#define TCNT2	_SFR_MEM8(0xB2)
+#define OCR2A	_SFR_MEM8(0xB3)
+#define ASSR	_SFR_MEM8(0xB6)
+
+/* TWI */
+#define TWBR	_SFR_MEM8(0xB8)
+#define TWSR	_SFR_MEM8(0xB9)
+#define TWAR	_SFR_MEM8(0xBA)
+#define TWDR	_SFR_MEM8(0xBB)
+#define TWCR	_SFR_MEM8(0xBC)
+
+/* USART */
+#define UCSR0A	_SFR_MEM8(0xC0)
+#define UCSR0B	_SFR_MEM8(0xC1)
+#define UCSR0C	_SFR_MEM8(0xC2)
+#define UBRR0L	_SFR_MEM8(0xC4)
+#define UBRR0H	_SFR_MEM8(0xC5)
+#define UDR0	_SFR_MEM8(0xC6)
+#define UCSR1A	_SFR_MEM8(0xC8)
+#define UCSR1B	_SFR_MEM8(0xC9)
+#define UCSR1C	_SFR_MEM8(0xCA)
+#define UBRR1L	_SFR_MEM8(0xCC)
+#define UBRR1H	_SFR_MEM8(0xCD)
+#define UDR1	_SFR_MEM8(0xCE)
+
+/* CAN */
+#define CANGCON	_SFR_MEM8(0xD8)
+#define CANGSTA	_SFR_MEM8(0xD9)
+#define CANGIT	_SFR_MEM8(0xDA)
+#define CANGIE	_SFR_MEM8(0xDB)
+#define CANEN2	_SFR_MEM8(0xDC)
+#define CANEN1	_SFR_MEM8(0xDD)
+#define CANIE2	_SFR_MEM8(0xDE)
+#define CANIE1	_SFR_MEM8(0xDF)
+#define CANSIT2	_SFR_MEM8(0xE0)
+#define CANSIT1	_SFR_MEM8(0xE1)
+#define CANBT1	_SFR_MEM8(0xE2)
+#define CANBT2	_SFR_MEM8(0xE3)
+#define CANBT3	_SFR_MEM8(0xE4)
+#define CANTCON	_SFR_MEM8(0xE5)
+#define CANTIM	_SFR_MEM16(0xE6)
+#define CANTIML	_SFR_MEM8(0xE6)
+#define CANTIMH	_SFR_MEM8(0xE7)
+#define CANTTC	_SFR_MEM16(0xE8)
+#define CANTTCL	_SFR_MEM8(0xE8)
+#define CANTTCH	_SFR_MEM8(0xE9)
+#define CANTEC	_SFR_MEM8(0xEA)
+#define CANREC	_SFR_MEM8(0xEB)
+#define CANHPMOB	_SFR_MEM8(0xEC)
+#define CANPAGE	_SFR_MEM8(0xED)
+#define CANSTMOB	_SFR_MEM8(0xEE)
+#define CANCDMOB	_SFR_MEM8(0xEF)
+#define CANIDT4	_SFR_MEM8(0xF0)
+#define CANIDT3	_SFR_MEM8(0xF1)
+#define CANIDT2	_SFR_MEM8(0xF2)
+#define CANIDT1	_SFR_MEM8(0xF3)
+#define CANIDM4	_SFR_MEM8(0xF4)
+#define CANIDM3	_SFR_MEM8(0xF5)
+#define CANIDM2	_SFR_MEM8(0xF6)
+#define CANIDM1	_SFR_MEM8(0xF7)
+#define CANSTM	_SFR_MEM16(0xF8)
+#define CANSTML	_SFR_MEM8(0xF8)
+#define CANSTMH	_SFR_MEM8(0xF9)
+#define CANMSG	_SFR_MEM8(0xFA)
+
+/* SREG */
+#define SREG_I	7
+
+/* EIMSK, EIFR */
+#define INT0	0
+#define INT1	1
+#define INT2	2
+#define INT3	3
+#define INT4	4
+#define INT5	5
+#define INT6	6
+#define INT7	7
+#define INTF0	0
+#define INTF1	1
+#define INTF2	2
+#define INTF3	3
+#define INTF4	4
+#define INTF5	5
+#define INTF6	6
+#define INTF7	7
+
+/* EICRA, EICRB */
+#define ISC00	0
+#define ISC01	1
+#define ISC10	2
+#define ISC11	3
+#define ISC20	4
+#define ISC21	5
+#define ISC30	6
+#define ISC31	7
+#define ISC40	0
+#define ISC41	1
+#define ISC50	2
+#define ISC51	3
+#define ISC60	4
+#define ISC61	5
+#define ISC70	6
+#define ISC71	7
+
+/* EECR */
+#define EERE	0
+#define EEWE	1
+#define EEMWE	2
+#define EERIE	3
+
+/* MCUCR, WDTCR */
+#define IVCE	0
+#define IVSEL	1
+#define PUD	4
+#define JTD	7
+#define WDP0	0
+#define WDP1	1
+#define WDP2	2
+#define WDE	3
+#define WDCE	4
+
+/* SPCR, SPSR */
+#define SPR0	0
+#define SPR1	1
+#define CPHA	2
+#define CPOL	3
+#define MSTR	4
+#define DORD	5
+#define SPE	6
+#define SPIE	7
+#define SPI2X	0
+#define WCOL	6
+#define SPIF	7
+
+/* ADCSRA, ADCSRB, ADMUX */
+#define ADPS0	0
+#define ADPS1	1
+#define ADPS2	2
+#define ADIE	3
+#define ADIF	4
+#define ADATE	5
+#define ADSC	6
+#define ADEN	7
+#define ADTS0	0
+#define ADTS1	1
+#define ADTS2	2
+#define ACME	6
+#define ADHSM	7
+#define MUX0	0
+#define MUX1	1
+#define MUX2	2
+#define MUX3	3
+#define MUX4	4
+#define ADLAR	5
+#define REFS0	6
+#define REFS1	7
+
+/* Timer 0 */
+#define CS00	0
+#define CS01	1
+#define CS02	2
+#define WGM01	3
+#define COM0A0	4
+#define COM0A1	5
+#define WGM00	6
+#define FOC0A	7
+#define TOV0	0
+#define OCF0A	1
+#define TOIE0	0
+#define OCIE0A	1
+
+/* Timer 1 */
+#define WGM10	0
+#define WGM11	1
+#define COM1C0	2
+#define COM1C1	3
+#define COM1B0	4
+#define COM1B1	5
+#define COM1A0	6
+#define COM1A1	7
+#define CS10	0
+#define CS11	1
+#define CS12	2
+#define WGM12	3
+#define WGM13	4
+#define ICES1	6
+#define ICNC1	7
+#define TOV1	0
+#define OCF1A	1
+#define OCF1B	2
+#define OCF1C	3
+#define ICF1	5
+#define TOIE1	0
+#define OCIE1A	1
+#define OCIE1B	2
+#define OCIE1C	3
+#define ICIE1	5
+
+/* Timer 2 */
+#define CS20	0
+#define CS21	1
+#define CS22	2
+#define WGM21	3
+#define COM2A0	4
+#define COM2A1	5
+#define WGM20	6
+#define FOC2A	7
+#define TOV2	0
+#define OCF2A	1
+#define TOIE2	0
+#define OCIE2A	1
+
+/* Timer 3 */
+#define WGM30	0
+#define WGM31	1
+#define COM3C0	2
+#define COM3C1	3
+#define COM3B0	4
+#define COM3B1	5
+#define COM3A0	6
+#define COM3A1	7
+#define CS30	0
+#define CS31	1
+#define CS32	2
+#define WGM32	3
+#define WGM33	4
+#define ICES3	6
+#define ICNC3	7
+#define TOV3	0
+#define OCF3A	1
+#define OCF3B	2
+#define OCF3C	3
+#define ICF3	5
+#define TOIE3	0
+#define OCIE3A	1
+#define OCIE3B	2
+#define OCIE3C	3
+#define ICIE3	5
+
+/* TWCR */
+#define TWIE	0
+#define TWEN	2
+#define TWWC	3
+#define TWSTO	4
+#define TWSTA	5
+#define TWEA	6
+#define TWINT	7
+
+/* USART */
+#define MPCM0	0
+#define U2X0	1
+#define UPE0	2
+#define DOR0	3
+#define FE0	4
+#define UDRE0	5
+#define TXC0	6
+#define RXC0	7
+#define TXB80	0
+#define RXB80	1
+#define UCSZ02	2
+#define TXEN0	3
+#define RXEN0	4
+#define UDRIE0	5
+#define TXCIE0	6
+#define RXCIE0	7
+#define UCPOL0	0
+#define UCSZ00	1
+#define UCSZ01	2
+#define USBS0	3
+#define UPM00	4
+#define UPM01	5
+#define UMSEL0	6
+#define MPCM1	0
+#define U2X1	1
+#define UPE1	2
+#define DOR1	3
+#define FE1	4
+#define UDRE1	5
+#define TXC1	6
+#define RXC1	7
+#define TXB81	0
+#define RXB81	1
+#define UCSZ12	2
+#define TXEN1	3
+#define RXEN1	4
+#define UDRIE1	5
+#define TXCIE1	6
+#define RXCIE1	7
+#define UCPOL1	0
+#define UCSZ10	1
+#define UCSZ11	2
+#define USBS1	3
+#define UPM10	4
+#define UPM11	5
+#define UMSEL1	6
+#define RXEN	RXEN0
+#define TXEN	TXEN0
+#define UCSZ0	UCSZ00
+#define UCSZ1	UCSZ10
+
+/* CANGCON */
+#define SWRES	0
+#define ENASTB	1
+#define TEST	2
+#define LISTEN	3
+#define SYNTTC	4
+#define TTC	5
+#define OVRQ	6
+#define ABRQ	7
+
+/* CANGSTA */
+#define ERRP	0
+#define BOFF	1
+#define ENFG	2
+#define RXBSY	3
+#define TXBSY	4
+#define OVRG	6
+
+/* CANGIT */
+#define AERG	0
+#define FERG	1
+#define CERG	2
+#define SERG	3
+#define BXOK	4
+#define OVRTIM	5
+#define BOFFIT	6
+#define CANIT	7
+
+/* CANGIE */
+#define ENOVRT	0
+#define ENERG	1
+#define ENBX	2
+#define ENERR	3
+#define ENTX	4
+#define ENRX	5
+#define ENBOFF	6
+#define ENIT	7
+
+/* CANBT1, CANBT2, CANBT3 */
+#define BRP0	1
+#define BRP1	2
+#define BRP2	3
+#define BRP3	4
+#define BRP4	5
+#define BRP5	6
+#define PRS0	1
+#define PRS1	2
+#define PRS2	3
+#define SJW0	5
+#define SJW1	6
+#define SMP	0
+#define PHS10	1
+#define PHS11	2
+#define PHS12	3
+#define PHS20	4
+#define PHS21	5
+#define PHS22	6
+
+/* CANPAGE, CANHPMOB */
+#define INDX0	0
+#define INDX1	1
+#define INDX2	2
+#define AINC	3
+#define MOBNB0	4
+#define MOBNB1	5
+#define MOBNB2	6
+#define MOBNB3	7
+#define CGP0	0
+#define HPMOB0	4
+
+/* CANSTMOB */
+#define AERR	0
+#define FERR	1
+#define CERR	2
+#define SERR	3
+#define BERR	4
+#define RXOK	5
+#define TXOK	6
+#define DLCW	7
+
+/* CANCDMOB */
+#define DLC0	0
+#define DLC1	1
+#define DLC2	2
+#define DLC3	3
+#define IDE	4
+#define RPLV	5
+#define CONMOB0	6
+#define CONMOB1	7
+
+/* CANIDT4, CANIDM4 */
+#define RB0TAG	0
+#define RB1TAG	1
+#define RTRTAG	2
+#define IDEMSK	0
+#define RTRMSK	2
+
+#endif /* SIM_AVR_IO_H */
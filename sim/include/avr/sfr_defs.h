@@ -0,0 +1,15 @@
+/**
+ * Host stand-in for <avr/sfr_defs.h> used by the simulator.
+ */
+
+#ifndef SIM_AVR_SFR_DEFS_H
+#define SIM_AVR_SFR_DEFS_H
+
+#include <avr/io.h>
+
+#define bit_is_set(sfr, bit)	((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit)	(!((sfr) & _BV(bit)))
+#define loop_until_bit_is_set(sfr, bit)	do { } while (bit_is_clear(sfr, bit))
+#define loop_until_bit_is_clear(sfr, bit)	do { } while (bit_is_set(sfr, bit))
+
+#endif /* SIM_AVR_SFR_DEFS_H */
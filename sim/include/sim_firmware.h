@@ -0,0 +1,21 @@
+/**
+ * Included ahead of every firmware source built for the simulator. Output
+ * that the firmware sends to its usart ends up on the host stdout, prefixed
+ * with the simulated time and the name of the node.
+ */
+
+#ifndef SIM_FIRMWARE_H
+#define SIM_FIRMWARE_H
+
+#include <stdio.h>
+
+int sim_printf(const char *fmt, ...);
+int sim_puts(const char *s);
+
+#define printf(...)	sim_printf(__VA_ARGS__)
+#define puts(s)	sim_puts(s)
+
+// The firmware entry point, so it does not clash with the one of the host
+#define main	node_main
+
+#endif /* SIM_FIRMWARE_H */
@@ -0,0 +1,33 @@
+/**
+ * Host stand-in for <util/atomic.h> used by the simulator. Interrupts are
+ * only ever taken between register accesses while the I flag in SREG is set,
+ * so clearing it is enough to make a block atomic.
+ */
+
+#ifndef SIM_UTIL_ATOMIC_H
+#define SIM_UTIL_ATOMIC_H
+
+#include <stdint.h>
+#include <avr/io.h>
+
+static inline uint8_t sim_atomic_enter(void) {
+	const uint8_t sreg = SREG;
+	SREG = sreg & ~(1 << SREG_I);
+	return 1;
+}
+
+#define ATOMIC_RESTORESTATE	uint8_t sim_sreg_save = SREG
+#define ATOMIC_FORCEON	uint8_t sim_sreg_save = SREG | (1 << SREG_I)
+
+#define ATOMIC_BLOCK(type) \
+	for (type, sim_todo = sim_atomic_enter(); sim_todo; \
+	     SREG = sim_sreg_save, sim_todo = 0)
+
+#define NONATOMIC_BLOCK(type) \
+	for (type, sim_todo = (SREG |= (1 << SREG_I), 1); sim_todo; \
+	     SREG = sim_sreg_save, sim_todo = 0)
+
+#define NONATOMIC_RESTORESTATE	ATOMIC_RESTORESTATE
+#define NONATOMIC_FORCEOFF	uint8_t sim_sreg_save = SREG & ~(1 << SREG_I)
+
+#endif /* SIM_UTIL_ATOMIC_H */
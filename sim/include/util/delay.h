@@ -0,0 +1,16 @@
+/**
+ * Host stand-in for <util/delay.h> used by the simulator. A delay advances the
+ * simulated clock of the node instead of spinning.
+ */
+
+#ifndef SIM_UTIL_DELAY_H
+#define SIM_UTIL_DELAY_H
+
+#include <stdint.h>
+
+void sim_delay_ns(uint64_t ns);
+
+static inline void _delay_ms(double ms) { sim_delay_ns((uint64_t)(ms * 1e6)); }
+static inline void _delay_us(double us) { sim_delay_ns((uint64_t)(us * 1e3)); }
+
+#endif /* SIM_UTIL_DELAY_H */
@@ -0,0 +1,93 @@
+/**
+ * Shift latency under telemetry load. SteeringNode and GearNode run next to
+ * TelemetryNode, which keeps the bus saturated with ECU messages. The up paddle
+ * is pulled many times at different phases of the telemetry stream and the
+ * time from each pull until PADDLE_STATUS has been sent is measured.
+ *
+ * Usage: priority [bitrate]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim.h"
+#include "vcan.h"
+
+#define MS	( 1000000ull )
+#define US	( 1000ull )
+
+#define FIRST_PULL	( 300 * MS )  //!< All nodes are initialised by then
+#define PULL_EVERY	( 150 * MS + 137 * US ) //!< Longer than the debounce time
+#define PULL_LENGTH	( 20 * MS )
+#define NB_PULLS	( 40 )
+
+static struct sim_node *steering;
+static struct sim_node *gear;
+static struct sim_node *telemetry;
+
+static uint64_t pulled_at;   //!< Time of the pull waiting for its frame
+static uint64_t worst;
+static uint64_t total;
+static unsigned sent;
+
+
+static void on_frame(const struct vcan_frame *f) {
+	if (f->sender == steering && f->acked && pulled_at != 0) {
+		const uint64_t latency = f->end_ns - pulled_at;
+		if (latency > worst) worst = latency;
+		total += latency;
+		++sent;
+		pulled_at = 0;
+	}
+}
+
+
+int main(int argc, char *argv[]) {
+	if (argc > 1) {
+		vcan_set_bitrate(strtoul(argv[1], NULL, 10));
+	}
+
+	steering = sim_add_node("SteeringNode", "./SteeringNode.so");
+	gear = sim_add_node("GearNode", "./GearNode.so");
+	telemetry = sim_add_node("TelemetryNode", "./TelemetryNode.so");
+	if (steering == NULL || gear == NULL || telemetry == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	// The paddles have external pull downs
+	sim_drive_pin(steering, 'E', 7, false);
+	sim_drive_pin(steering, 'E', 6, false);
+
+	vcan_set_frame_hook(on_frame);
+
+	for (unsigned i = 0; i < NB_PULLS; ++i) {
+		const uint64_t t = FIRST_PULL + i * PULL_EVERY;
+		sim_run_until(t);
+		if (pulled_at != 0) {
+			printf("pull at %10.3f ms never reached the bus\n", pulled_at / 1e6);
+		}
+		sim_drive_pin(steering, 'E', 7, true);
+		pulled_at = t;
+		sim_run_until(t + PULL_LENGTH);
+		sim_drive_pin(steering, 'E', 7, false);
+	}
+	sim_run_until(FIRST_PULL + NB_PULLS * PULL_EVERY);
+
+	const struct vcan_stats *st = vcan_stats();
+	printf("bitrate               %u bit/s\n", vcan_bitrate());
+	printf("bus load              %8.3f %%\n", 100.0 * st->busy_ns / sim_now());
+	printf("paddle pulls          %8u\n", NB_PULLS);
+	printf("sent                  %8u\n", sent);
+	if (sent != 0) {
+		printf("paddle to bus mean    %8.3f ms\n", total / 1e6 / sent);
+		printf("paddle to bus worst   %8.3f ms\n", worst / 1e6);
+	}
+	printf("frames                %8u\n", st->frames);
+	for (uint16_t id = 0; id < VCAN_MAX_ID; ++id) {
+		if (st->frames_by_id[id] != 0) {
+			printf("  id %3u              %8u\n", id, st->frames_by_id[id]);
+		}
+	}
+
+	return sent == NB_PULLS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,72 @@
+/**
+ * Firmware of a stand-in node that checks the frames the CAN driver receives.
+ * HEARTBEAT goes to the receive queue, and NODE_STATUS and CURRENT_GEAR to
+ * mailboxes enabled in that order, so the mailbox of NODE_STATUS comes right
+ * before the one of CURRENT_GEAR.
+ *
+ * The first HEARTBEAT is read at once, the next CAN_QUEUE_SIZE when the
+ * scenario drives PA0 high. By then the queue has wrapped, and the last frame
+ * is in the slot right before the oldest unread one. HEARTBEAT n has n data
+ * bytes of value n, up to 8 bytes. CURRENT_GEAR has 1 byte 0x42 and
+ * NODE_STATUS 8 bytes 0x55. The frames with 8 bytes are sent with a DLC of 15.
+ * PB0 is set when the frames have been checked, and PB1 if they were all as
+ * sent.
+ */
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <can.h>
+#include <can_queue.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sysclock.h>
+#include <util/delay.h>
+#include <utils.h>
+
+#include "system_messages.h"
+
+
+static bool check_frame(const struct can_message *msg, uint16_t id,
+                        uint8_t len, uint8_t value) {
+	if (msg->id != id || msg->len != len) return false;
+	for (uint8_t i = 0; i < len; ++i) {
+		if (msg->data[i] != value) return false;
+	}
+	return true;
+}
+
+
+int main(void) {
+	can_init();
+	sysclock_init();
+	can_mailbox_enable(NODE_STATUS);
+	can_mailbox_enable(CURRENT_GEAR);
+	can_subscribe(HEARTBEAT);
+	can_update_filters();
+	DDRB = (1 << PB0) | (1 << PB1);
+	sei();
+
+	struct can_message msg;
+	while (!can_has_data());
+	read_message(&msg);
+	bool ok = check_frame(&msg, HEARTBEAT, 0, 0);
+
+	while (!BIT_CHECK(PINA, PIN0));
+	for (uint8_t n = 1; n <= CAN_QUEUE_SIZE; ++n) {
+		ok = ok && can_has_data();
+		read_message(&msg);
+		ok = ok && check_frame(&msg, HEARTBEAT, (n < 8) ? n : 8, n);
+	}
+	ok = ok && !can_has_data();
+	ok = ok && can_get_latest(CURRENT_GEAR, &msg, NULL)
+	     && check_frame(&msg, CURRENT_GEAR, 1, 0x42);
+	ok = ok && can_get_latest(NODE_STATUS, &msg, NULL)
+	     && check_frame(&msg, NODE_STATUS, 8, 0x55);
+
+	PORTB = (1 << PB0) | (ok ? (1 << PB1) : 0);
+	while (1) {
+		_delay_ms(10);
+	}
+
+	return 0;
+}
@@ -0,0 +1,580 @@
+/**
+ * Scheduler and register file of the simulated nodes.
+ *
+ * The scheduler runs the nodes in lock step slices of SIM_SLICE_NS. Within a
+ * slice each node runs on its own stack until its local clock reaches the end
+ * of the slice. A node only gives up control on a register access, a function
+ * call or a delay, which are also where pending interrupts are taken, so the
+ * interleaving only depends on the firmware and never on the host.
+ */
+
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include "sim.h"
+#include "sim_node.h"
+#include "vcan.h"
+
+#define MAX_NODES	( 8 )
+#define STACK_SIZE	( 1 << 20 )
+
+// Register addresses that need more than plain storage
+#define SFR_PIN_FIRST	( 0x20 )
+#define SFR_PIN_LAST	( 0x32 )
+#define SFR_TIFR3	( 0x38 )
+#define SFR_EIFR	( 0x3C )
+#define SFR_EIMSK	( 0x3D )
+#define SFR_EECR	( 0x3F )
+#define SFR_SPSR	( 0x4D )
+#define SFR_EICRA	( 0x69 )
+#define SFR_EICRB	( 0x6A )
+#define SFR_TIMSK3	( 0x71 )
+#define SFR_ADC	( 0x78 )
+#define SFR_ADCSRA	( 0x7A )
+#define SFR_ADMUX	( 0x7C )
+#define SFR_TCCR3A	( 0x90 )
+#define SFR_TCCR3B	( 0x91 )
+#define SFR_TCNT3	( 0x94 )
+#define SFR_OCR3A	( 0x98 )
+#define SFR_TWCR	( 0xBC )
+#define SFR_UCSR0A	( 0xC0 )
+#define SFR_UCSR1A	( 0xC8 )
+#define SFR_CANEN2	( 0xDC )
+#define SFR_CANEN1	( 0xDD )
+#define SFR_CANSIT2	( 0xE0 )
+#define SFR_CANSIT1	( 0xE1 )
+#define SFR_CANTIM	( 0xE6 )
+#define SFR_CANHPMOB	( 0xEC )
+
+#define VECT_INT0	( 1 )
+#define VECT_CANIT	( 18 )
+#define VECT_TIMER3_COMPA	( 28 )
+
+#define SREG_I	( 1 << 7 )
+#define OCF3A	( 1 << 1 )
+#define OCIE3A	( 1 << 1 )
+#define WGM32	( 1 << 3 )
+#define WGM33	( 1 << 4 )
+
+static struct sim_node *nodes[MAX_NODES];
+static uint8_t nb_nodes;
+static struct sim_node *cur;
+static ucontext_t sched_ctx;
+static uint64_t now;
+static void (*step_hook)(uint64_t now);
+
+
+uint64_t sim_cycles_to_ns(uint64_t cycles) {
+	return (uint64_t)(((unsigned __int128)cycles * 1000000000u) / F_CPU);
+}
+
+
+uint64_t sim_ns_to_cycles(uint64_t ns) {
+	return (uint64_t)(((unsigned __int128)ns * F_CPU + 999999999u) / 1000000000u);
+}
+
+
+uint64_t sim_now(void) {
+	return now;
+}
+
+
+const char* sim_node_name(const struct sim_node *n) {
+	return n->name;
+}
+
+
+void sim_set_step_hook(void (*hook)(uint64_t now)) {
+	step_hook = hook;
+}
+
+
+static void node_start(void) {
+	cur->entry();
+	cur->done = true;
+	swapcontext(&cur->ctx, &sched_ctx);
+}
+
+
+/**
+ * Loads a node firmware built as a shared object. Each object gets its own
+ * copy of the firmware globals.
+ */
+struct sim_node* sim_add_node(const char *name, const char *path) {
+	if (nb_nodes == MAX_NODES) return NULL;
+
+	struct sim_node *n = calloc(1, sizeof(*n));
+	snprintf(n->name, sizeof(n->name), "%s", name);
+
+	n->so = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (n->so == NULL) {
+		fprintf(stderr, "sim: %s\n", dlerror());
+		exit(EXIT_FAILURE);
+	}
+
+	n->entry = (int (*)(void))dlsym(n->so, "node_main");
+	if (n->entry == NULL) {
+		fprintf(stderr, "sim: %s has no node_main\n", path);
+		exit(EXIT_FAILURE);
+	}
+
+	for (uint8_t v = 0; v < SIM_NB_VECTOR; ++v) {
+		char sym[16];
+		snprintf(sym, sizeof(sym), "__vector_%u", v);
+		n->vector[v] = (void (*)(void))dlsym(n->so, sym);
+	}
+
+	n->stack = malloc(STACK_SIZE);
+	getcontext(&n->ctx);
+	n->ctx.uc_stack.ss_sp = n->stack;
+	n->ctx.uc_stack.ss_size = STACK_SIZE;
+	n->ctx.uc_link = NULL;
+	makecontext(&n->ctx, node_start, 0);
+
+	n->cycles = sim_ns_to_cycles(now);
+	n->t3_last = n->cycles;
+
+	nodes[nb_nodes++] = n;
+	return n;
+}
+
+
+static void yield(struct sim_node *n) {
+	swapcontext(&n->ctx, &sched_ctx);
+}
+
+
+/**
+ * Runs all nodes and the bus until t_ns.
+ */
+void sim_run_until(uint64_t t_ns) {
+	while (now < t_ns) {
+		const uint64_t end = now + SIM_SLICE_NS;
+		vcan_update(nodes, nb_nodes, now);
+
+		for (uint8_t i = 0; i < nb_nodes; ++i) {
+			struct sim_node *n = nodes[i];
+			n->slice_end = sim_ns_to_cycles(end);
+			if (!n->done && n->cycles < n->slice_end) {
+				cur = n;
+				swapcontext(&sched_ctx, &n->ctx);
+				cur = NULL;
+			}
+		}
+
+		now = end;
+		if (step_hook != NULL) {
+			step_hook(now);
+		}
+	}
+}
+
+
+static uint8_t port_index(char port) {
+	return (uint8_t)(port - 'A');
+}
+
+
+/**
+ * External interrupt n is on PD0-3 for n < 4 and PE4-7 otherwise.
+ */
+static int8_t ext_int_of(uint8_t port, uint8_t pin) {
+	if (port == port_index('D') && pin < 4) return pin;
+	if (port == port_index('E') && pin >= 4) return pin;
+	return -1;
+}
+
+
+static uint8_t ext_int_sense(const struct sim_node *n, uint8_t irq) {
+	const uint8_t eicr = (irq < 4) ? n->sfr[SFR_EICRA] : n->sfr[SFR_EICRB];
+	return (eicr >> (2 * (irq & 3))) & 0x03;
+}
+
+
+bool sim_pin_level(const struct sim_node *n, char port, uint8_t pin) {
+	const uint8_t p = port_index(port);
+	const uint8_t bit = 1 << pin;
+	const uint8_t ddr = n->sfr[SFR_PIN_FIRST + 3 * p + 1];
+	const uint8_t out = n->sfr[SFR_PIN_FIRST + 3 * p + 2];
+
+	if (ddr & bit) return out & bit;
+	if (n->pin_driven[p] & bit) return n->pin_level[p] & bit;
+	return out & bit; // Pull-up, or a floating input read as low
+}
+
+
+/**
+ * Drives an input pin of the node from outside, raising the external
+ * interrupt flag on the edges it is configured for.
+ */
+void sim_drive_pin(struct sim_node *n, char port, uint8_t pin, bool level) {
+	const bool before = sim_pin_level(n, port, pin);
+	const uint8_t p = port_index(port);
+
+	n->pin_driven[p] |= 1 << pin;
+	if (level) {
+		n->pin_level[p] |= 1 << pin;
+	} else {
+		n->pin_level[p] &= ~(1 << pin);
+	}
+
+	const int8_t irq = ext_int_of(p, pin);
+	if (irq < 0 || before == level) return;
+
+	const uint8_t sense = ext_int_sense(n, irq);
+	const bool any_edge = (sense == 1 && irq >= 4);
+	const bool falling = (sense == 2 && !level);
+	const bool rising = (sense == 3 && level);
+	if (any_edge || falling || rising) {
+		n->sfr[SFR_EIFR] |= 1 << irq;
+	}
+}
+
+
+void sim_release_pin(struct sim_node *n, char port, uint8_t pin) {
+	n->pin_driven[port_index(port)] &= ~(1 << pin);
+}
+
+
+void sim_set_adc(struct sim_node *n, uint8_t channel, uint16_t value) {
+	n->adc_in[channel & 7] = value;
+}
+
+
+static void update_timer3(struct sim_node *n) {
+	static const uint16_t prescaler[] = {0, 1, 8, 64, 256, 1024};
+	const uint8_t cs = n->sfr[SFR_TCCR3B] & 0x07;
+	if (cs == 0 || cs >= sizeof(prescaler) / sizeof(prescaler[0])) {
+		n->t3_last = n->cycles;
+		return;
+	}
+
+	const uint64_t ticks = (n->cycles - n->t3_last) / prescaler[cs];
+	if (ticks == 0) return;
+	n->t3_last += ticks * prescaler[cs];
+
+	uint16_t *tcnt = (uint16_t *)&n->sfr[SFR_TCNT3];
+	const uint16_t ocr = *(uint16_t *)&n->sfr[SFR_OCR3A];
+	const bool ctc = (n->sfr[SFR_TCCR3B] & (WGM32 | WGM33)) == WGM32
+	                 && (n->sfr[SFR_TCCR3A] & 0x03) == 0;
+	const uint32_t top = ctc ? ocr : 0xFFFF;
+
+	const uint64_t count = *tcnt + ticks;
+	if (count > top) {
+		n->sfr[SFR_TIFR3] |= OCF3A;
+		*tcnt = (uint16_t)((count - top - 1) % (top + 1));
+	} else {
+		if (*tcnt < ocr && count >= ocr) {
+			n->sfr[SFR_TIFR3] |= OCF3A;
+		}
+		*tcnt = (uint16_t)count;
+	}
+}
+
+
+static bool can_mob_pending(const struct sim_node *n, uint8_t mob) {
+	const uint16_t ie = n->sfr[SFR_CANIE2] | (n->sfr[SFR_CANIE1] << 8);
+	if (!(ie & (1 << mob))) return false;
+
+	const uint8_t st = n->mob[mob].reg[MOB_STMOB];
+	const uint8_t gie = n->sfr[SFR_CANGIE];
+	return ((st & (1 << 6)) && (gie & (1 << 4)))   // TXOK and ENTX
+	    || ((st & (1 << 5)) && (gie & (1 << 5)))   // RXOK and ENRX
+	    || ((st & 0x1F) && (gie & (1 << 3)));      // errors and ENERR
+}
+
+
+static void update_can_status(struct sim_node *n) {
+	uint16_t sit = 0;
+	uint16_t en = 0;
+	uint8_t hp = 0xF0;
+	for (int8_t mob = SIM_NB_MOB - 1; mob >= 0; --mob) {
+		if (can_mob_pending(n, mob)) {
+			sit |= 1 << mob;
+			hp = mob << 4;
+		}
+		if (n->mob[mob].reg[MOB_CDMOB] & CONMOB_MSK) {
+			en |= 1 << mob;
+		}
+	}
+	n->sfr[SFR_CANSIT2] = sit & 0xFF;
+	n->sfr[SFR_CANSIT1] = sit >> 8;
+	n->sfr[SFR_CANEN2] = en & 0xFF;
+	n->sfr[SFR_CANEN1] = en >> 8;
+	n->sfr[SFR_CANHPMOB] = hp;
+	n->sfr[SFR_CANTEC] = (n->tec > 0xFF) ? 0xFF : n->tec;
+	n->sfr[SFR_CANREC] = (n->rec > 0xFF) ? 0xFF : n->rec;
+
+	uint8_t gsta = n->sfr[SFR_CANGSTA] & ~0x07;
+	if (n->sfr[SFR_CANGCON] & (1 << 1)) gsta |= 1 << 2;   // ENFG
+	if (n->bus_off_until_ns > 0) gsta |= 1 << 1;          // BOFF
+	if (n->tec >= 128 || n->rec >= 128) gsta |= 1 << 0;   // ERRP
+	n->sfr[SFR_CANGSTA] = gsta;
+}
+
+
+static bool can_pending(struct sim_node *n) {
+	if (!(n->sfr[SFR_CANGIE] & (1 << 7))) return false; // ENIT
+	if (n->cangit & n->sfr[SFR_CANGIE] & (1 << 6)) return true; // BOFFIT
+	for (uint8_t mob = 0; mob < SIM_NB_MOB; ++mob) {
+		if (can_mob_pending(n, mob)) return true;
+	}
+	return false;
+}
+
+
+static int8_t pending_vector(struct sim_node *n) {
+	for (uint8_t irq = 0; irq < 8; ++irq) {
+		if (!(n->sfr[SFR_EIMSK] & (1 << irq))) continue;
+		if (n->sfr[SFR_EIFR] & (1 << irq)) return VECT_INT0 + irq;
+
+		// Level triggered interrupts are pending for as long as the pin is low
+		const char port = (irq < 4) ? 'D' : 'E';
+		if (ext_int_sense(n, irq) == 0 && !sim_pin_level(n, port, irq)) {
+			return VECT_INT0 + irq;
+		}
+	}
+
+	if (can_pending(n)) return VECT_CANIT;
+
+	if ((n->sfr[SFR_TIMSK3] & OCIE3A) && (n->sfr[SFR_TIFR3] & OCF3A)) {
+		return VECT_TIMER3_COMPA;
+	}
+
+	return -1;
+}
+
+
+static void service_interrupts(struct sim_node *n) {
+	while (n->sfr[SFR_SREG] & SREG_I) {
+		const int8_t v = pending_vector(n);
+		if (v < 0) return;
+
+		// The hardware clears the flag of edge and compare interrupts
+		if (v >= VECT_INT0 && v < VECT_INT0 + 8) {
+			n->sfr[SFR_EIFR] &= ~(1 << (v - VECT_INT0));
+		} else if (v == VECT_TIMER3_COMPA) {
+			n->sfr[SFR_TIFR3] &= ~OCF3A;
+		}
+
+		if (n->vector[v] == NULL) {
+			if (!n->warned_vector) {
+				fprintf(stderr, "sim: %s has no handler for vector %d\n",
+				        n->name, v);
+				n->warned_vector = true;
+			}
+			if (v == VECT_CANIT) return; // Would fire forever
+			continue;
+		}
+
+		n->sfr[SFR_SREG] &= ~SREG_I;
+		n->in_isr = true;
+		n->cycles += SIM_ISR_CYCLES;
+		n->cangit_seen = 0;
+		n->vector[v]();
+		n->in_isr = false;
+		n->sfr[SFR_SREG] |= SREG_I;
+
+		// Writing a one clears a flag in CANGIT, which a plain register
+		// file cannot tell from a read. Flags the handler has seen are
+		// taken as cleared when it returns.
+		if (v == VECT_CANIT) {
+			n->cangit &= ~n->cangit_seen;
+		}
+	}
+}
+
+
+/**
+ * Advances the local clock of the running node, takes pending interrupts and
+ * gives control back to the scheduler at the end of the slice.
+ */
+static void tick(struct sim_node *n, uint64_t cycles) {
+	n->cycles += cycles;
+	update_timer3(n);
+
+	if (n->sfr[SFR_CANGCON] & (1 << 0)) { // SWRES
+		vcan_reset_node(n);
+	}
+
+	if (!n->in_isr) {
+		service_interrupts(n);
+	}
+
+	while (n->cycles >= n->slice_end) {
+		yield(n);
+	}
+}
+
+
+/**
+ * Brings registers whose value is derived from other state up to date before
+ * the firmware accesses them.
+ */
+static void update_register(struct sim_node *n, uint16_t addr) {
+	// libat90 io.h reaches PINx through the address of PORTx, so the input
+	// register is refreshed on any access to the port
+	if (addr >= SFR_PIN_FIRST && addr <= SFR_PIN_LAST + 2) {
+		const uint8_t p = (addr - SFR_PIN_FIRST) / 3;
+		uint8_t v = 0;
+		for (uint8_t pin = 0; pin < 8; ++pin) {
+			v |= sim_pin_level(n, 'A' + p, pin) << pin;
+		}
+		n->sfr[SFR_PIN_FIRST + 3 * p] = v;
+		return;
+	}
+
+	switch (addr) {
+	case SFR_SPSR:
+		n->sfr[addr] |= 1 << 7; // SPIF, transfers complete at once
+		break;
+	case SFR_ADCSRA:
+	case SFR_ADC:
+	case SFR_ADC + 1:
+		if (n->sfr[SFR_ADCSRA] & (1 << 6)) { // ADSC
+			n->sfr[SFR_ADCSRA] &= ~(1 << 6);
+			n->sfr[SFR_ADCSRA] |= 1 << 4;    // ADIF
+			*(uint16_t *)&n->sfr[SFR_ADC] = n->adc_in[n->sfr[SFR_ADMUX] & 0x07];
+		}
+		break;
+	case SFR_EECR:
+		n->sfr[addr] &= ~(1 << 1); // EEWE, writes complete at once
+		break;
+	case SFR_TWCR:
+		n->sfr[addr] |= 1 << 7; // TWINT
+		break;
+	case SFR_UCSR0A:
+	case SFR_UCSR1A:
+		n->sfr[addr] |= (1 << 5) | (1 << 6); // UDRE, TXC
+		break;
+	case SFR_CANGIT:
+		n->sfr[addr] = n->cangit;
+		n->cangit_seen |= n->cangit;
+		break;
+	case SFR_CANTIM:
+	case SFR_CANTIM + 1:
+		*(uint16_t *)&n->sfr[SFR_CANTIM] = vcan_timer(n, n->cycles);
+		break;
+	case SFR_CANGSTA:
+	case SFR_CANEN2:
+	case SFR_CANEN1:
+	case SFR_CANSIT2:
+	case SFR_CANSIT1:
+	case SFR_CANTEC:
+	case SFR_CANREC:
+	case SFR_CANHPMOB:
+		update_can_status(n);
+		break;
+	default:
+		break;
+	}
+}
+
+
+static volatile uint8_t* register_ptr(struct sim_node *n, uint16_t addr) {
+	addr &= 0xFF;
+
+	if (addr >= SFR_MOB_FIRST && addr <= SFR_MOB_LAST) {
+		const uint8_t mob = n->sfr[SFR_CANPAGE] >> 4;
+		return &n->mob[mob].reg[addr - SFR_MOB_FIRST];
+	}
+
+	if (addr == SFR_CANMSG) {
+		const uint8_t page = n->sfr[SFR_CANPAGE];
+		volatile uint8_t *p = &n->mob[page >> 4].msg[page & 0x07];
+		if (!(page & (1 << 3))) { // AINC clear means auto increment
+			n->sfr[SFR_CANPAGE] = (page & 0xF8) | ((page + 1) & 0x07);
+		}
+		return p;
+	}
+
+	update_register(n, addr);
+	return &n->sfr[addr];
+}
+
+
+volatile uint8_t* sim_sfr8(uint16_t addr) {
+	tick(cur, SIM_ACCESS_CYCLES);
+	return register_ptr(cur, addr);
+}
+
+
+volatile uint16_t* sim_sfr16(uint16_t addr) {
+	tick(cur, SIM_ACCESS_CYCLES);
+	return (volatile uint16_t *)register_ptr(cur, addr);
+}
+
+
+void sim_delay_ns(uint64_t ns) {
+	struct sim_node *n = cur;
+	const uint64_t until = n->cycles + sim_ns_to_cycles(ns);
+	while (n->cycles < until) {
+		const uint64_t step = (n->slice_end > n->cycles) ? n->slice_end - n->cycles : 1;
+		tick(n, (until - n->cycles < step) ? until - n->cycles : step);
+	}
+}
+
+
+/**
+ * Prefixes everything a node prints with the simulated time and its name.
+ */
+int sim_vprintf(const char *fmt, va_list ap) {
+	static bool line_start = true;
+	static const struct sim_node *last;
+
+	if (last != cur && !line_start) {
+		putchar('\n');
+		line_start = true;
+	}
+	last = cur;
+
+	char buf[512];
+	const int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+	for (const char *c = buf; *c; ++c) {
+		if (*c == '\n' && line_start) continue; // Skip blank lines
+		if (line_start) {
+			printf("%10.3f ms %-14s | ", sim_cycles_to_ns(cur->cycles) / 1e6,
+			       cur->name);
+			line_start = false;
+		}
+		putchar(*c);
+		line_start = (*c == '\n');
+	}
+	return len;
+}
+
+
+int sim_printf(const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	const int len = sim_vprintf(fmt, ap);
+	va_end(ap);
+	return len;
+}
+
+
+int sim_puts(const char *s) {
+	return sim_printf("%s\n", s);
+}
+
+
+/**
+ * The firmware is built with -finstrument-functions, so every function call
+ * is charged SIM_CALL_CYCLES and is a point where the node can be suspended.
+ * Without it a main loop that only polls RAM would never give control back.
+ */
+void __cyg_profile_func_enter(void *fn, void *site) {
+	if (cur != NULL) {
+		tick(cur, SIM_CALL_CYCLES);
+	}
+}
+
+
+void __cyg_profile_func_exit(void *fn, void *site) {
+}
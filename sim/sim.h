@@ -0,0 +1,41 @@
+/**
+ * Runs several node firmwares on the host against one simulated CAN bus.
+ *
+ * Every node is built from its own sources, with no changes for the simulator,
+ * into a shared object (see the Makefile) and loaded with its own copy of all
+ * globals. The firmware runs as a coroutine and gives control back to the
+ * scheduler whenever it has used up its time slice, which it only ever does on
+ * a register access, a function call or a delay. Simulated time is therefore
+ * fully deterministic and independent of the speed of the host.
+ *
+ * Time is kept per node in CPU cycles. Every register access is charged
+ * SIM_ACCESS_CYCLES and every function call SIM_CALL_CYCLES as a stand-in for
+ * the instructions around them, so absolute latencies inside a node are
+ * estimates, while bus timing is exact to the bit.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SIM_ACCESS_CYCLES	( 8 )    //!< Cycles charged per register access
+#define SIM_CALL_CYCLES	( 4 )    //!< Cycles charged per function call
+#define SIM_ISR_CYCLES	( 10 )   //!< Cycles to enter and leave an ISR
+#define SIM_SLICE_NS	( 5000 ) //!< Nodes run in lock step slices of this length
+
+struct sim_node;
+
+struct sim_node* sim_add_node(const char *name, const char *path);
+void sim_run_until(uint64_t t_ns);
+uint64_t sim_now(void);
+void sim_set_step_hook(void (*hook)(uint64_t now));
+
+void sim_drive_pin(struct sim_node *n, char port, uint8_t pin, bool level);
+void sim_release_pin(struct sim_node *n, char port, uint8_t pin);
+bool sim_pin_level(const struct sim_node *n, char port, uint8_t pin);
+void sim_set_adc(struct sim_node *n, uint8_t channel, uint16_t value);
+const char* sim_node_name(const struct sim_node *n);
+
+#endif /* SIM_H */
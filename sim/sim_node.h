@@ -0,0 +1,103 @@
+/**
+ * State of a simulated node, shared between the scheduler in sim.c and the
+ * bus in vcan.c. Not for use by scenarios.
+ */
+
+#ifndef SIM_NODE_H
+#define SIM_NODE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <ucontext.h>
+
+#define SIM_NB_MOB	( 15 )
+#define SIM_NB_PORT	( 7 )
+#define SIM_NB_VECTOR	( 37 )
+
+#define SFR_SREG	( 0x5F )
+#define SFR_CANGCON	( 0xD8 )
+#define SFR_CANGSTA	( 0xD9 )
+#define SFR_CANGIT	( 0xDA )
+#define SFR_CANGIE	( 0xDB )
+#define SFR_CANIE2	( 0xDE )
+#define SFR_CANIE1	( 0xDF )
+#define SFR_CANBT1	( 0xE2 )
+#define SFR_CANBT2	( 0xE3 )
+#define SFR_CANBT3	( 0xE4 )
+#define SFR_CANTCON	( 0xE5 )
+#define SFR_CANTEC	( 0xEA )
+#define SFR_CANREC	( 0xEB )
+#define SFR_CANPAGE	( 0xED )
+#define SFR_MOB_FIRST	( 0xEE ) //!< CANSTMOB, the first paged register
+#define SFR_MOB_LAST	( 0xF9 ) //!< CANSTMH, the last paged register
+#define SFR_CANMSG	( 0xFA )
+
+// Offsets of the paged registers in sim_mob.reg
+enum mob_reg {
+	MOB_STMOB,
+	MOB_CDMOB,
+	MOB_IDT4,
+	MOB_IDT3,
+	MOB_IDT2,
+	MOB_IDT1,
+	MOB_IDM4,
+	MOB_IDM3,
+	MOB_IDM2,
+	MOB_IDM1,
+	MOB_STML,
+	MOB_STMH,
+	MOB_NB_REG
+};
+
+#define CONMOB_MSK	( 0xC0 )
+#define CONMOB_TX	( 0x40 )
+#define CONMOB_RX	( 0x80 )
+#define CONMOB_BUF	( 0xC0 )
+
+struct sim_mob {
+	uint8_t reg[MOB_NB_REG] __attribute__((aligned(2)));
+	uint8_t msg[8];
+};
+
+struct sim_node {
+	char name[32];
+	void *so;
+	int (*entry)(void);
+	void (*vector[SIM_NB_VECTOR])(void);
+
+	uint8_t sfr[0x100] __attribute__((aligned(2)));
+	struct sim_mob mob[SIM_NB_MOB + 1]; // The last one absorbs invalid pages
+
+	uint8_t pin_driven[SIM_NB_PORT]; //!< Pins driven from outside the node
+	uint8_t pin_level[SIM_NB_PORT];  //!< Level of the driven pins
+	uint16_t adc_in[8];
+
+	uint64_t cycles;     //!< Local clock
+	uint64_t slice_end;  //!< Give control back when cycles reaches this
+	uint64_t t3_last;    //!< Cycle timer 3 was last brought up to date
+
+	// CAN controller state that is not visible in a register
+	uint16_t tec;
+	uint16_t rec;
+	uint64_t bus_off_until_ns;
+	bool tx_faulty;      //!< Every frame it sends ends in a bit error
+	uint8_t cangit;      //!< General interrupt flags, CANGIT shows a copy
+	uint8_t cangit_seen; //!< Flags the CAN interrupt handler has read
+
+	ucontext_t ctx;
+	void *stack;
+	bool done;
+	bool in_isr;
+	bool warned_vector;
+	bool warned_bitrate;
+};
+
+uint64_t sim_cycles_to_ns(uint64_t cycles);
+uint64_t sim_ns_to_cycles(uint64_t ns);
+
+bool vcan_node_online(const struct sim_node *n);
+void vcan_reset_node(struct sim_node *n);
+void vcan_update(struct sim_node **nodes, uint8_t nb_nodes, uint64_t now);
+uint16_t vcan_timer(const struct sim_node *n, uint64_t cycles);
+
+#endif /* SIM_NODE_H */
@@ -0,0 +1,29 @@
+/**
+ * Firmware of a stand-in for the node that puts the ECU data on the bus. It
+ * broadcasts every ECU message back to back as fast as it can, so the bus is
+ * saturated with telemetry.
+ */
+
+#include <avr/interrupt.h>
+#include <can.h>
+#include <stdint.h>
+#include <sysclock.h>
+
+#include "system_messages.h"
+
+
+int main(void) {
+	can_init();
+	sysclock_init();
+	sei();
+
+	float value = 0;
+	while (1) {
+		for (uint8_t id = ECU_FUEL_PRESSURE; id <= ECU_TIME; ++id) {
+			can_broadcast(id, &value);
+			value += 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,42 @@
+/**
+ * Stand-in for libat90/usart.c in the simulator. The real driver is built on
+ * the avr-libc stdio streams, which glibc does not have. Nothing is ever
+ * received, and printf() is routed to the host by sim_firmware.h.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <usart.h>
+
+int usart0_init(uint32_t baudrate, uint8_t* in_buf, size_t in_size,
+                uint8_t* out_buf, size_t out_size) {
+	return 0;
+}
+
+int usart1_init(uint32_t baudrate, uint8_t* in_buf, size_t in_size,
+                uint8_t* out_buf, size_t out_size) {
+	return 0;
+}
+
+bool usart0_has_data(void) { return false; }
+bool usart1_has_data(void) { return false; }
+size_t usart0_input_buffer_bytes(void) { return 0; }
+size_t usart1_input_buffer_bytes(void) { return 0; }
+size_t usart0_output_buffer_bytes(void) { return 0; }
+size_t usart1_output_buffer_bytes(void) { return 0; }
+
+void usart0_read_span(uint8_t **ptr, size_t *len) { *ptr = NULL; *len = 0; }
+void usart1_read_span(uint8_t **ptr, size_t *len) { *ptr = NULL; *len = 0; }
+void usart0_commit(size_t n) {}
+void usart1_commit(size_t n) {}
+
+// Bytes written into the output span are thrown away on commit
+static uint8_t scratch[64];
+void usart0_write_span(uint8_t **ptr, size_t *len) { *ptr = scratch; *len = sizeof(scratch); }
+void usart1_write_span(uint8_t **ptr, size_t *len) { *ptr = scratch; *len = sizeof(scratch); }
+void usart0_write_commit(size_t n) {}
+void usart1_write_commit(size_t n) {}
+void usart0_set_rx_handler(usart_rx_handler_t handler) {}
+void usart1_set_rx_handler(usart_rx_handler_t handler) {}
@@ -0,0 +1,409 @@
+/**
+ * Simulated CAN bus shared by the nodes of the simulator.
+ *
+ * A frame is put on the bus whenever the bus is idle and some node has a MOB
+ * enabled for transmission. Each node offers its lowest numbered transmit MOB,
+ * as the at90can128 does, and the frame with the lowest identifier wins the
+ * arbitration. The frame occupies the bus for its exact number of bits,
+ * including stuff bits, so the bus load comes out as on the real wire.
+ *
+ * A frame is acknowledged when at least one other node is active on the bus.
+ * Otherwise the sender sees an acknowledgement error, its transmit error
+ * counter goes up by 8 and the MOB stays enabled so the frame is retried, as
+ * on the real controller. Error passive and bus off follow the CAN rules, and
+ * a node leaves bus off after 128 times 11 recessive bits. A node can be made
+ * faulty, so every frame it sends ends in a bit error.
+ *
+ * The scenario can also put frames on the bus from a device that is not one of
+ * the nodes with vcan_inject(). They arbitrate like the frames of the nodes.
+ * The DLC of a frame is carried as sent, so it can be 9 to 15, but no frame
+ * has more than 8 data bytes.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim_node.h"
+#include "vcan.h"
+
+#define ENASTB	( 1 << 1 )
+#define LISTEN	( 1 << 3 )
+#define BOFFIT	( 1 << 6 )
+#define TXOK	( 1 << 6 )
+#define RXOK	( 1 << 5 )
+#define DLCW	( 1 << 7 )
+#define AERR	( 1 << 0 )
+#define BERR	( 1 << 4 )
+#define IDE	( 1 << 4 )
+#define RTRTAG	( 1 << 2 )
+#define RTRMSK	( 1 << 2 )
+#define IDEMSK	( 1 << 0 )
+#define DLC_MSK	( 0x0F )
+
+#define ERROR_PASSIVE	( 128 )
+#define BUS_OFF	( 256 )
+#define ERROR_FRAME_BITS	( 6 + 8 + 3 ) //!< Error flag, delimiter and interframe space
+#define SUSPEND_BITS	( 8 )  //!< Extra idle time an error passive sender waits
+#define BUS_OFF_BITS	( 128 * 11 )
+#define INJECT_QUEUE	( 16 )
+
+#define DATA_LEN(dlc)	( ((dlc) > 8) ? 8 : (dlc) ) //!< Data bytes of a frame with that DLC
+
+static uint32_t bitrate = CAN_BAUDRATE;
+static struct vcan_stats stats;
+static void (*frame_hook)(const struct vcan_frame *f);
+
+static bool busy;
+static struct vcan_frame frame;
+static struct sim_node *tx_node; //!< NULL if the sender was reset mid frame
+static uint8_t tx_mob;
+static bool tx_injected;  //!< The frame on the bus came from vcan_inject()
+static struct vcan_frame injected[INJECT_QUEUE];
+static uint8_t nb_injected;
+static uint64_t free_at;   //!< When the bus last became idle
+static uint64_t last_now;  //!< Time of the previous vcan_update()
+
+
+void vcan_set_bitrate(uint32_t rate) {
+	bitrate = rate;
+}
+
+
+uint32_t vcan_bitrate(void) {
+	return bitrate;
+}
+
+
+void vcan_set_frame_hook(void (*hook)(const struct vcan_frame *f)) {
+	frame_hook = hook;
+}
+
+
+const struct vcan_stats* vcan_stats(void) {
+	return &stats;
+}
+
+
+/**
+ * Queues a frame from a device outside the simulated nodes. It is sent when it
+ * wins the arbitration, and is always acknowledged if a node is on the bus.
+ * @return false if INJECT_QUEUE frames are already waiting
+ */
+bool vcan_inject(uint16_t id, uint8_t dlc, const uint8_t *data) {
+	if (nb_injected == INJECT_QUEUE) return false;
+
+	struct vcan_frame *f = &injected[nb_injected++];
+	*f = (struct vcan_frame){ .id = id, .len = dlc & DLC_MSK };
+	memcpy(f->data, data, DATA_LEN(f->len));
+	return true;
+}
+
+
+static uint64_t bits_to_ns(uint32_t bits) {
+	return ((uint64_t)bits * 1000000000u + bitrate / 2) / bitrate;
+}
+
+
+/**
+ * The CAN timer of a node runs at F_CPU / 8 / (CANTCON + 1).
+ */
+uint16_t vcan_timer(const struct sim_node *n, uint64_t cycles) {
+	return (uint16_t)(cycles / (8u * (n->sfr[SFR_CANTCON] + 1u)));
+}
+
+
+static uint16_t crc15(uint16_t crc, bool bit) {
+	const bool top = (crc >> 14) & 1;
+	crc = (crc << 1) & 0x7FFF;
+	return (top ^ bit) ? crc ^ 0x4599 : crc;
+}
+
+
+/**
+ * Number of bits a standard data frame occupies on the bus, from the start of
+ * frame to the end of the interframe space, including stuff bits.
+ */
+uint16_t vcan_frame_bits(uint16_t id, uint8_t len, const uint8_t *data) {
+	// Start of frame, identifier, RTR, IDE, r0, DLC and data
+	bool bits[1 + 11 + 3 + 4 + 64 + 15];
+	uint8_t n = 0;
+	bits[n++] = 0;
+	for (int8_t i = 10; i >= 0; --i) bits[n++] = (id >> i) & 1;
+	bits[n++] = 0;
+	bits[n++] = 0;
+	bits[n++] = 0;
+	for (int8_t i = 3; i >= 0; --i) bits[n++] = (len >> i) & 1;
+	for (uint8_t b = 0; b < DATA_LEN(len); ++b) {
+		for (int8_t i = 7; i >= 0; --i) bits[n++] = (data[b] >> i) & 1;
+	}
+
+	uint16_t crc = 0;
+	for (uint8_t i = 0; i < n; ++i) crc = crc15(crc, bits[i]);
+	for (int8_t i = 14; i >= 0; --i) bits[n++] = (crc >> i) & 1;
+
+	// Stuff bits are inserted after five equal bits and count themselves
+	uint8_t stuff = 0;
+	uint8_t run = 1;
+	bool last = bits[0];
+	for (uint8_t i = 1; i < n; ++i) {
+		if (bits[i] == last) {
+			if (++run == 5) {
+				++stuff;
+				last = !last;
+				run = 1;
+			}
+		} else {
+			last = bits[i];
+			run = 1;
+		}
+	}
+
+	// CRC delimiter, ACK slot and delimiter, end of frame, interframe space
+	return n + stuff + 1 + 2 + 7 + 3;
+}
+
+
+static uint32_t node_bitrate(const struct sim_node *n) {
+	const uint8_t brp = (n->sfr[SFR_CANBT1] >> 1) & 0x3F;
+	const uint8_t prs = (n->sfr[SFR_CANBT2] >> 1) & 0x07;
+	const uint8_t phs1 = (n->sfr[SFR_CANBT3] >> 1) & 0x07;
+	const uint8_t phs2 = (n->sfr[SFR_CANBT3] >> 4) & 0x07;
+	const uint32_t tq = 1 + (prs + 1) + (phs1 + 1) + (phs2 + 1);
+	return F_CPU / ((brp + 1) * tq);
+}
+
+
+void vcan_set_faulty(struct sim_node *n, bool faulty) {
+	n->tx_faulty = faulty;
+}
+
+
+uint16_t vcan_tec(const struct sim_node *n) {
+	return n->tec;
+}
+
+
+bool vcan_is_bus_off(const struct sim_node *n) {
+	return n->bus_off_until_ns != 0;
+}
+
+
+bool vcan_node_online(const struct sim_node *n) {
+	return (n->sfr[SFR_CANGCON] & ENASTB) && !(n->sfr[SFR_CANGCON] & LISTEN)
+	       && n->bus_off_until_ns == 0;
+}
+
+
+/**
+ * Software reset of the CAN controller of a node. The MOB registers keep their
+ * contents as on the real controller, but nothing is enabled any more.
+ */
+void vcan_reset_node(struct sim_node *n) {
+	for (uint16_t addr = SFR_CANGCON; addr < SFR_CANPAGE; ++addr) {
+		n->sfr[addr] = 0;
+	}
+	n->sfr[SFR_CANPAGE] = 0;
+	for (uint8_t mob = 0; mob < SIM_NB_MOB; ++mob) {
+		n->mob[mob].reg[MOB_CDMOB] &= ~CONMOB_MSK;
+	}
+	n->tec = n->rec = 0;
+	n->bus_off_until_ns = 0;
+	n->cangit = n->cangit_seen = 0;
+
+	if (busy && tx_node == n) {
+		tx_node = NULL;
+	}
+}
+
+
+static uint16_t mob_id(const struct sim_mob *m) {
+	return (m->reg[MOB_IDT1] << 3) | (m->reg[MOB_IDT2] >> 5);
+}
+
+
+static uint16_t mob_mask(const struct sim_mob *m) {
+	return (m->reg[MOB_IDM1] << 3) | (m->reg[MOB_IDM2] >> 5);
+}
+
+
+static int8_t tx_candidate(const struct sim_node *n) {
+	if (!vcan_node_online(n)) return -1;
+	for (uint8_t mob = 0; mob < SIM_NB_MOB; ++mob) {
+		const uint8_t cd = n->mob[mob].reg[MOB_CDMOB];
+		if ((cd & CONMOB_MSK) == CONMOB_TX && !(cd & IDE)) {
+			return mob;
+		}
+	}
+	return -1;
+}
+
+
+static void stamp(struct sim_node *n, struct sim_mob *m, uint64_t t_ns) {
+	const uint16_t t = vcan_timer(n, sim_ns_to_cycles(t_ns));
+	m->reg[MOB_STML] = t & 0xFF;
+	m->reg[MOB_STMH] = t >> 8;
+}
+
+
+static void receive(struct sim_node *n, const struct vcan_frame *f) {
+	for (uint8_t i = 0; i < SIM_NB_MOB; ++i) {
+		struct sim_mob *m = &n->mob[i];
+		const uint8_t cd = m->reg[MOB_CDMOB];
+		if (!(cd & CONMOB_RX)) continue;
+		if ((f->id ^ mob_id(m)) & mob_mask(m)) continue;
+		if ((m->reg[MOB_IDM4] & IDEMSK) && (cd & IDE)) continue;
+		if ((m->reg[MOB_IDM4] & RTRMSK) && (m->reg[MOB_IDT4] & RTRTAG)) continue;
+
+		m->reg[MOB_IDT1] = f->id >> 3;
+		m->reg[MOB_IDT2] = (f->id & 0x07) << 5;
+		m->reg[MOB_IDT4] &= ~RTRTAG;
+		if ((cd & DLC_MSK) != f->len) {
+			m->reg[MOB_STMOB] |= DLCW;
+		}
+		m->reg[MOB_CDMOB] = (cd & ~(CONMOB_MSK | DLC_MSK)) | f->len;
+		memcpy(m->msg, f->data, DATA_LEN(f->len));
+		m->reg[MOB_STMOB] |= RXOK;
+		stamp(n, m, f->end_ns);
+		if (n->rec > 0) --n->rec;
+		return;
+	}
+}
+
+
+static void transmit_error(struct sim_node *n) {
+	n->tec += 8;
+	if (n->tec >= BUS_OFF) {
+		n->bus_off_until_ns = frame.end_ns + bits_to_ns(BUS_OFF_BITS);
+		n->cangit |= BOFFIT;
+	}
+}
+
+
+static void complete(struct sim_node **nodes, uint8_t nb_nodes) {
+	if (tx_injected) {
+		if (frame.acked) {
+			memmove(&injected[0], &injected[1], --nb_injected * sizeof(injected[0]));
+		}
+	} else if (tx_node != NULL) {
+		struct sim_mob *m = &tx_node->mob[tx_mob];
+		if (frame.acked) {
+			m->reg[MOB_STMOB] |= TXOK;
+			m->reg[MOB_CDMOB] &= ~CONMOB_MSK;
+			stamp(tx_node, m, frame.end_ns);
+			if (tx_node->tec > 0) --tx_node->tec;
+		} else {
+			m->reg[MOB_STMOB] |= tx_node->tx_faulty ? BERR : AERR;
+			transmit_error(tx_node);
+		}
+	}
+
+	if (frame.acked) {
+		for (uint8_t i = 0; i < nb_nodes; ++i) {
+			if (nodes[i] != frame.sender && vcan_node_online(nodes[i])) {
+				receive(nodes[i], &frame);
+			}
+		}
+		++stats.frames;
+		++stats.frames_by_id[frame.id & (VCAN_MAX_ID - 1)];
+	} else {
+		++stats.errors;
+	}
+	stats.busy_ns += frame.end_ns - frame.start_ns;
+
+	if (frame_hook != NULL) {
+		frame_hook(&frame);
+	}
+}
+
+
+static bool start(struct sim_node **nodes, uint8_t nb_nodes, uint64_t t) {
+	struct sim_node *winner = NULL;
+	int8_t winner_mob = -1;
+	uint16_t winner_id = 0;
+
+	for (uint8_t i = 0; i < nb_nodes; ++i) {
+		const int8_t mob = tx_candidate(nodes[i]);
+		if (mob < 0) continue;
+		const uint16_t id = mob_id(&nodes[i]->mob[mob]);
+		if (winner == NULL || id < winner_id) {
+			winner = nodes[i];
+			winner_mob = mob;
+			winner_id = id;
+		}
+	}
+
+	tx_injected = nb_injected != 0 && (winner == NULL || injected[0].id < winner_id);
+	if (winner == NULL && !tx_injected) return false;
+
+	if (tx_injected) {
+		frame = injected[0];
+		winner = NULL;
+		winner_mob = 0;
+	} else {
+		const uint32_t rate = node_bitrate(winner);
+		if ((rate > bitrate + bitrate / 50 || rate < bitrate - bitrate / 50)
+		    && !winner->warned_bitrate) {
+			fprintf(stderr, "vcan: %s bit timing gives %u bit/s on a %u bit/s bus\n",
+			        winner->name, rate, bitrate);
+			winner->warned_bitrate = true;
+		}
+
+		const struct sim_mob *m = &winner->mob[winner_mob];
+		frame.sender = winner;
+		frame.id = winner_id;
+		frame.len = m->reg[MOB_CDMOB] & DLC_MSK;
+		memcpy(frame.data, m->msg, DATA_LEN(frame.len));
+	}
+	frame.bits = vcan_frame_bits(frame.id, frame.len, frame.data);
+
+	frame.acked = false;
+	for (uint8_t i = 0; i < nb_nodes && (winner == NULL || !winner->tx_faulty); ++i) {
+		if (nodes[i] != winner && vcan_node_online(nodes[i])) {
+			frame.acked = true;
+		}
+	}
+
+	uint32_t bits = frame.bits;
+	if (!frame.acked) {
+		bits = frame.bits - 3 - 7 - 1 + ERROR_FRAME_BITS; // Error after the ACK slot
+	}
+	if (winner != NULL && winner->tec >= ERROR_PASSIVE) {
+		bits += SUSPEND_BITS;
+	}
+
+	frame.start_ns = t;
+	frame.end_ns = t + bits_to_ns(bits);
+	tx_node = winner;
+	tx_mob = winner_mob;
+	busy = true;
+	return true;
+}
+
+
+/**
+ * Moves the bus forward to now. Frames that have ended are delivered, and the
+ * next frame is started right where the previous one ended if any node has
+ * one ready, or else at the start of the current slice.
+ */
+void vcan_update(struct sim_node **nodes, uint8_t nb_nodes, uint64_t now) {
+	for (;;) {
+		if (busy) {
+			if (frame.end_ns > now) break;
+			complete(nodes, nb_nodes);
+			busy = false;
+			free_at = frame.end_ns;
+		}
+
+		for (uint8_t i = 0; i < nb_nodes; ++i) {
+			struct sim_node *n = nodes[i];
+			if (n->bus_off_until_ns != 0 && n->bus_off_until_ns <= now) {
+				n->bus_off_until_ns = 0;
+				n->tec = n->rec = 0;
+			}
+		}
+
+		const uint64_t t = (free_at > last_now) ? free_at : now;
+		if (!start(nodes, nb_nodes, t)) break;
+	}
+	last_now = now;
+}
@@ -0,0 +1,47 @@
+/**
+ * Simulated CAN bus shared by the nodes of the simulator.
+ *
+ * Models the at90can128 MOB pool of each node, arbitration by identifier
+ * between nodes, acknowledgement by any other active node, bit stuffing,
+ * error counters with error passive and bus off, and the frame time stamps.
+ */
+
+#ifndef VCAN_H
+#define VCAN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define VCAN_MAX_ID	( 0x800 )
+
+struct sim_node;
+
+struct vcan_frame {
+	const struct sim_node *sender; //!< NULL for a frame from vcan_inject()
+	uint16_t id;
+	uint8_t len;      //!< DLC, up to 15 for 8 data bytes
+	uint8_t data[8];
+	uint64_t start_ns;
+	uint64_t end_ns;
+	uint16_t bits;  //!< Including stuff bits and interframe space
+	bool acked;
+};
+
+struct vcan_stats {
+	uint64_t busy_ns;
+	uint32_t frames;
+	uint32_t errors;
+	uint32_t frames_by_id[VCAN_MAX_ID];
+};
+
+void vcan_set_bitrate(uint32_t bitrate);
+uint32_t vcan_bitrate(void);
+void vcan_set_frame_hook(void (*hook)(const struct vcan_frame *f));
+const struct vcan_stats* vcan_stats(void);
+uint16_t vcan_frame_bits(uint16_t id, uint8_t len, const uint8_t *data);
+void vcan_set_faulty(struct sim_node *n, bool faulty);
+bool vcan_inject(uint16_t id, uint8_t dlc, const uint8_t *data);
+uint16_t vcan_tec(const struct sim_node *n);
+bool vcan_is_bus_off(const struct sim_node *n);
+
+#endif /* VCAN_H */